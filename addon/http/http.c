@@ -195,16 +195,10 @@ static HttpHeader* dict_to_headers(Value* dict_val, int* out_count) {
     if (!headers) return NULL;
     
     int idx = 0;
-    for (size_t i = 0; i < dict->capacity; i++) {
-        DictEntry* entry = dict->buckets[i];
-        while (entry && idx < (int)dict->size) {
-            Value* tmp = eval_str(entry->key, NULL);
-            headers[idx].key = as_c_string(tmp);
-            val_release(tmp);
-            headers[idx].value = as_c_string(entry->value);
-            idx++;
-            entry = entry->next;
-        }
+    ITERATE_DICT(dict) {
+        headers[idx].key = as_c_string(entry->key);
+        headers[idx].value = as_c_string(entry->value);
+        idx++;
     }
     
     *out_count = idx;
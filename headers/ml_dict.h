@@ -2,18 +2,39 @@
 #pragma once
 #include "../mila.h"
 #include <stddef.h>
+#include <stdint.h>
 
+/*
+    Ints, uints, floats, bools and strings are keys by value, the entry
+    holds a private copy in key. Anything else is keyed by its repr, key is
+    then a string holding it and dict_keys evaluates it back into a value.
+*/
 typedef struct DictEntry {
-    ValueType key_type;
-    char *key;
+    Value *key;
     Value *value;
-    struct DictEntry *next;
+    unsigned long hash; // hash of key, kept so resizing never rehashes
+    ValueType key_type; // type of key, the original type for repr keys
+    char by_repr;
 } DictEntry;
 
+/*
+    Entries are kept in insertion order in a dense array. The hash index is
+    open addressing with linear probing over positions into it: ctrl holds
+    one byte per index slot, DICT_EMPTY or the top 7 bits of the entry's
+    hash, and lookups compare DICT_GROUP of them at a time. The first
+    DICT_GROUP - 1 bytes are mirrored past the end so a group never wraps.
+    Removal shifts the rest of the probe run back in the index and leaves
+    a hole (key == NULL) in entries, which the next resize squeezes out.
+*/
 typedef struct {
-    DictEntry **buckets;
-    size_t capacity;
+    unsigned char *ctrl;
+    uint32_t *index;
+    DictEntry *entries;
+    size_t capacity; // index slots, power of two, at least DICT_GROUP
+    size_t used;     // entries filled, holes included
     size_t size;
+    unsigned long seed; // hash seed when the dict was made
+    MRefCount refcount; // dict values sharing this storage, see dict_unshare
 } Dict;
 
 typedef struct {
@@ -23,28 +44,32 @@ typedef struct {
 
 #define INITIAL_CAPACITY 16
 #define LOAD_FACTOR 0.75
+#define DICT_GROUP 16
+#define DICT_EMPTY 0x80
 
+// Walks the entries in insertion order
 #define ITERATE_DICT(dict)                                                     \
-    for (size_t _i = 0; _i < (dict)->capacity; ++_i)                           \
-        for (DictEntry *entry = (dict)->buckets[_i]; entry; entry = entry->next)
+    for (size_t _i = 0; _i < (dict)->used; ++_i)                               \
+        for (DictEntry *entry = &(dict)->entries[_i]; entry && entry->key;     \
+             entry = NULL)
 
-void hash_set_seed(unsigned long seed);
-static unsigned long hash_string(const char *str);
-FN_UNUSED static unsigned long hash_value(Value *val);
-static DictEntry *dict_entry_create(const char *key, Value *value);
-static void dict_entry_free(DictEntry *entry);
 Dict *dict_create();
-static void dict_resize(Dict *dict);
+static int dict_resize(Dict *dict);
 char *substitute_text(const char *needle, Value *replacement, const char *text);
 int dict_set(Dict *dict, Value *key, Value *value);
-int dict_set_raw(Dict *dict, char *key, Value *value);
 Value *dict_get_str(Dict *dict, const char *key);
 int dict_set_str(Dict *dict, char *str_key, Value *value);
+int dict_set_entry(Dict *dict, Dict *from, DictEntry *entry, Value *value);
+int dict_has_entry(Dict *dict, Dict *from, DictEntry *entry);
 Value *dict_get(Dict *dict, Value *key);
+int dict_has(Dict *dict, Value *key);
 int dict_remove(Dict *dict, Value *key);
 void dict_free(Dict *dict);
 Value *dict_repr(Value *self);
 Value *dict_str(Value *self);
+Dict *dict_clone(Dict *original);
 Value *dict_copy(Value *self);
+void dict_unshare(Value *self);
+Value *dict_entry_key(DictEntry *entry);
 Value **dict_keys(Dict *dict);
 void dict_free_keys(char **entries);
\ No newline at end of file
@@ -0,0 +1,40 @@
+// This project is licensed under the GNU Affero General Public License
+#pragma once
+#include <stddef.h>
+
+/*
+ * Backup cycle collector.
+ * Refcounting still frees everything it can, this only looks for
+ * containers (lists, dicts, arrays, function closures) that keep each
+ * other alive and nothing else refers to.
+ */
+
+typedef struct Value Value;
+
+typedef struct {
+    size_t collections; // completed passes
+    size_t collected;   // containers freed by the collector
+    size_t tracked;     // containers currently tracked
+    size_t pending;     // containers created since the last pass
+    size_t threshold;   // pending count that starts a pass, 0 = manual only
+} GCStats;
+
+#ifndef ML_GC_DEFAULT_THRESHOLD
+#define ML_GC_DEFAULT_THRESHOLD 10000
+#endif
+
+extern GCStats mila_gc_stats;
+
+void gc_track(Value *v);
+void gc_untrack(Value *v);
+size_t gc_collect(void);
+void gc_deinit(void);
+
+// Checked between statements, where every live container is held through
+// a counted reference
+#define ML_GC_SAFEPOINT()                                                      \
+    do {                                                                       \
+        if (mila_gc_stats.threshold &&                                         \
+            mila_gc_stats.pending >= mila_gc_stats.threshold)                  \
+            gc_collect();                                                      \
+    } while (0)
@@ -0,0 +1,75 @@
+// This project is licensed under the GNU Affero General Public License
+#pragma once
+#include "../mila.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    Glob patterns, compiled once into a list of byte classes and matched by
+    stepping every live position of the pattern along the string together,
+    so matching is O(len(pattern) * len(string)) where backtracking over the
+    pattern text could go exponential on `*a*a*a*b`. Patterns under 64 ops
+    keep the live positions as bits of a word, a byte is a few word ops.
+
+    A match is the one backtracking would have found: the leftmost start,
+    and from there `*` and `{}` take as little as they can (lazy) or as
+    much as they can (greedy), the earlier ones getting their way first.
+
+    Compiled patterns are refcounted and kept in a small cache keyed by the
+    pattern text, so the same pattern string is only compiled once.
+*/
+
+// Patterns the cache keeps around, least recently used goes first
+#define GLOB_CACHE_SIZE 64
+
+typedef enum {
+    GLOB_BYTE, // one byte
+    GLOB_SET,  // one byte out of set
+    GLOB_STAR, // any run of bytes out of set, an empty one too
+    GLOB_END,
+} GlobOpKind;
+
+typedef struct {
+    GlobOpKind kind;
+    unsigned char byte;
+    uint64_t set[4];
+} GlobOp;
+
+typedef struct {
+    char *src;
+    size_t src_len;
+    unsigned long hash;
+    long refcount;
+    int never;   // ends in a lone `\`, matches nothing
+    int literal; // no wildcards, src is matched as it is
+    int first;   // byte every match starts with, -1 for any
+    size_t nops; // ops[nops] is GLOB_END
+    GlobOp *ops;
+    char *lit; // the bytes of a literal pattern, unescaped
+    size_t lit_len;
+    // with fewer than 64 ops a set of positions in the pattern is a word,
+    // acc[c] has the ops that take byte c and star the ones that are * or
+    // the tail of a {}. NULL acc means matching goes through ops
+    uint64_t *acc;
+    uint64_t star;
+    uint64_t init; // where matching starts, the * at the front skipped
+    int lead_any;  // starts with a *
+} MGlob;
+
+MGlob *glob_compile(const char *pattern);
+MGlob *glob_get(const char *pattern);
+MGlob *glob_retain(MGlob *g);
+void glob_release(MGlob *g);
+void glob_cache_clear(void);
+
+int glob_match(MGlob *g, const char *s, size_t n);
+int glob_find(MGlob *g, const char *s, size_t n, int greedy, size_t *start,
+              size_t *len);
+char *glob_replace(MGlob *g, const char *s, const char *replacement,
+                   int count, int greedy, int dollar);
+
+MGlob *glob_from_value(Value *v);
+Value *glob_value(MGlob *g);
+Value *glob_str(Value *self);
+Value *glob_free(Value *self);
+Value *glob_copy(Value *self);
@@ -0,0 +1,23 @@
+// This project is licensed under the GNU Affero General Public License
+#pragma once
+#include "../mila.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    Hashing for dicts and the hash builtin.
+    Strings go through a wyhash style function that reads 8 bytes at a
+    time, ints, floats and bools through a bijective mixer. The seed is
+    random per process unless hash.set_seed picks one.
+*/
+
+extern unsigned long HASH_SEED;
+
+unsigned long hash_get_seed(void);
+void hash_set_seed(unsigned long seed);
+static unsigned long hash_mix(unsigned long x);
+static unsigned long hash_bytes(const void *data, size_t len,
+                                unsigned long seed);
+static unsigned long hash_string(const char *str, unsigned long seed);
+static unsigned long hash_scalar(Value *val, unsigned long seed);
+FN_UNUSED static unsigned long hash_value(Value *val);
@@ -0,0 +1,36 @@
+// This project is licensed under the GNU Affero General Public License
+#pragma once
+#include "../mila.h"
+
+/*
+    Binary heaps, the smallest key (or the largest for max heaps) is
+    always at the top. Keys are numbers, strings or lists of those and
+    are compared in C, a key function is called once per pushed item and
+    never while the heap is reordered.
+*/
+
+typedef struct {
+    Value *item;
+    Value *key; // NULL when the item is its own key
+} HeapNode;
+
+typedef struct {
+    HeapNode *nodes;
+    size_t size;
+    size_t capacity;
+    Value *key_fn; // NULL compares the items themselves
+    int max;       // pops the largest key first
+    MRefCount refcount;
+} Heap;
+
+#define HEAP_SHARED(val) (((Heap *)(val)->v)->refcount > 1)
+
+Heap *heap_create(Value *key_fn, int max);
+Heap *heap_clone(Heap *heap);
+void heap_destroy(Heap *heap);
+void heap_unshare(Value *self);
+Value *heap_new(Heap *heap);
+Value *heap_str(Value *self);
+Value *heap_free(Value *self);
+Value *heap_copy(Value *self);
+void heap_visit(Value *self, value_visitor fn, void *ctx);
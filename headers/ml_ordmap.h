@@ -0,0 +1,78 @@
+// This project is licensed under the GNU Affero General Public License
+#pragma once
+#include "../mila.h"
+
+/*
+    Ordered maps, a B-tree keyed by numbers, strings or lists of those
+    (see val_order_cmp). Each node holds up to ORDMAP_MAX_KEYS keys side
+    by side so a lookup touches a handful of nodes, leaves are allocated
+    without the child pointers.
+*/
+
+#define ORDMAP_MIN_DEGREE 16
+#define ORDMAP_MAX_KEYS (2 * ORDMAP_MIN_DEGREE - 1)
+// more levels than 2^64 keys could fill
+#define ORDMAP_MAX_DEPTH 24
+
+typedef struct OrdMapNode {
+    int count;
+    int leaf;
+    Value *keys[ORDMAP_MAX_KEYS];
+    Value *values[ORDMAP_MAX_KEYS];
+    // ORDMAP_MAX_KEYS + 1 of them, leaves are allocated without
+    struct OrdMapNode *children[];
+} OrdMapNode;
+
+typedef struct {
+    OrdMapNode *root;
+    size_t size;
+    MRefCount refcount;
+} OrdMap;
+
+// A position in the tree, the next pair is path[depth - 1] at
+// index[depth - 1]. depth is 0 once it ran off the end
+typedef struct {
+    OrdMapNode *path[ORDMAP_MAX_DEPTH];
+    int index[ORDMAP_MAX_DEPTH];
+    int depth;
+} OrdMapCursor;
+
+// What ordmap.range and ordmap.prefix hand out, a lazy slice of the map
+typedef struct {
+    OrdMap *map;  // the map as it was when the view was made
+    Value *lo;    // NULL starts at the first key
+    Value *hi;    // NULL runs to the last key, otherwise excluded
+    char *prefix; // only string keys starting with it
+} OrdMapView;
+
+typedef struct {
+    OrdMap *map; // held for the whole loop, changes go to a copy
+    OrdMapCursor cursor;
+    Value *hi;
+    const char *prefix;
+    size_t prefix_len;
+} OrdMapIterState;
+
+#define ORDMAP_SHARED(val) (((OrdMap *)(val)->v)->refcount > 1)
+
+OrdMap *ordmap_create(void);
+OrdMap *ordmap_clone(OrdMap *map);
+void ordmap_destroy(OrdMap *map);
+Value *ordmap_get(OrdMap *map, Value *key);
+int ordmap_set(OrdMap *map, Value *key, Value *value);
+int ordmap_remove(OrdMap *map, Value *key);
+void ordmap_unshare(Value *self);
+Value *ordmap_new(OrdMap *map);
+Value *ordmap_str(Value *self);
+Value *ordmap_free(Value *self);
+Value *ordmap_copy(Value *self);
+Value *get_ordmap(Value *self, Value *key);
+Value *set_ordmap(Value *self, Value *key, Value *value);
+void ordmap_visit(Value *self, value_visitor fn, void *ctx);
+OrdMapIterState *ordmap_iter_init(Value *self);
+Value *ordmap_iter_next(OrdMapIterState *state);
+void ordmap_iter_cleanup(OrdMapIterState *state);
+Value *ordmap_view_str(Value *self);
+Value *ordmap_view_free(Value *self);
+Value *ordmap_view_copy(Value *self);
+OrdMapIterState *ordmap_view_iter_init(Value *self);
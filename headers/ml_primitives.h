@@ -9,6 +9,14 @@ extern MethodTable *list_meta;
 extern MethodTable *array_meta;
 extern MethodTable *range_meta;
 extern MethodTable *istring_meta;
+extern MethodTable *set_meta;
+extern MethodTable *heap_meta;
+extern MethodTable *ordmap_meta;
+extern MethodTable *ordmap_view_meta;
+extern MethodTable *tarray_meta;
+extern MethodTable *strbuf_meta;
+extern MethodTable *str_split_meta;
+extern MethodTable *glob_meta;
 
 typedef struct {
     long start;
@@ -22,11 +30,43 @@ typedef struct {
     size_t end;
 } ArrayIterState;
 
+// A string to split lazily, see str.split_iter
+typedef struct {
+    MString *str; // holds a reference
+    char *delim;
+    size_t delim_len;
+    long max; // splits to make, -1 for all of them
+} StrSplit;
+
+typedef struct {
+    MString *str; // held for the whole loop
+    const char *delim;
+    size_t delim_len;
+    size_t pos;
+    long left;
+    int done;
+} StrSplitState;
+
 typedef struct {
     Value **array; /* array of Value* */
     int size;
 } Array;
 
+int val_is_shared(Value *v);
+void val_unshare(Value *v);
+/*
+    Whether copy() can hand out self's storage instead of cloning it. Not
+    when weakrefs point at the storage, or when a container or string
+    somewhere in it is also held from elsewhere: a change made through that holder would
+    show through the copy. Cloning copies the items, the copy functions
+    count how deep those clones nest in val_copy_depth.
+*/
+int val_copy_shares(Value *self);
+int val_is_mutable(Value *v);
+extern _Thread_local int val_copy_depth;
+int val_orderable(Value *v);
+int val_order_cmp(Value *a, Value *b);
+void list_unshare(Value *self);
 Value *list_to_iter(Value *self);
 Value *list_repr(Value *self);
 Value *list_str(Value *self);
@@ -39,6 +79,7 @@ Value *get_list(Value *self, Value *index);
 Value *native_list_len(Env *e, int argc, Value **argv);
 Value *native_list_pop(Env *e, int argc, Value **argv);
 Value *list_free(Value *self);
+void list_visit(Value *self, value_visitor fn, void *ctx);
 Value *native_new_dict(Env *env, int argc, Value **argv);
 Value *native_list_append(Env *, int, Value **);
 Value *native_keys_dict(Env *env, int argc, Value **argv);
@@ -48,6 +89,7 @@ Value *set_dict(Value *self, Value *name, Value *val);
 Value *get_dict(Value *self, Value *name);
 Value *native_rem_dict(Env *env, int argc, Value **argv);
 Value *free_dict(Value *self);
+void dict_visit(Value *self, value_visitor fn, void *ctx);
 Value *array_to_str(Value *self);
 Value *array_to_repr(Value *self);
 Value *array_to_iter(Value *self);
@@ -69,6 +111,7 @@ Value *native_len_array(Env *env, int argc, Value **argv);
 Value *get_array(Value *self, Value *index);
 Value *set_array(Value *self, Value *index, Value *val);
 Value *free_array(Value *self);
+void array_visit(Value *self, value_visitor fn, void *ctx);
 Value *native_str_pop_start(Env *env, int argc, Value **argv);
 Value *native_str_pop_end(Env *env, int argc, Value **argv);
 Value *native_ascii_from_int(Env *env, int argc, Value **argv);
@@ -79,6 +122,13 @@ Value *native_str_index(Env *env, int argc, Value **argv);
 Value *native_str_patch(Env *env, int argc, Value **argv);
 Value *native_str_len(Env *env, int argc, Value **argv);
 Value *native_str_split(Env *env, int argc, Value **argv);
+Value *native_str_split_exact(Env *env, int argc, Value **argv);
+Value *native_str_split_iter(Env *env, int argc, Value **argv);
+StrSplitState *str_split_iter_init(Value *self);
+Value *str_split_iter_next(StrSplitState *state);
+void str_split_iter_cleanup(StrSplitState *state);
+Value *str_split_str(Value *self);
+Value *str_split_free(Value *self);
 Value *native_str_join(Env *env, int argc, Value **argv);
 Value *native_str_startsw(Env *env, int argc, Value **argv);
 Value *native_str_endsw(Env *env, int argc, Value **argv);
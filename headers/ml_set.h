@@ -0,0 +1,24 @@
+// This project is licensed under the GNU Affero General Public License
+#pragma once
+#include "../mila.h"
+#include "ml_dict.h"
+
+/*
+    Sets are dicts without values, members are the keys and are hashed
+    and compared the same way. Storage is shared between copies like a
+    dict's, see dict_unshare.
+*/
+
+typedef struct {
+    Dict *storage; // held for the whole loop, changes go to a copy
+    size_t index;
+} SetIterState;
+
+Value *set_new(Dict *members);
+Value *set_str(Value *self);
+Value *set_repr(Value *self);
+Value *set_free(Value *self);
+Value *set_copy(Value *self);
+SetIterState *set_iter_init(Value *self);
+Value *set_iter_next(SetIterState *state);
+void set_iter_cleanup(SetIterState *state);
@@ -0,0 +1,17 @@
+// This project is licensed under the GNU Affero General Public License
+#pragma once
+#include "../mila.h"
+#include "ml_string.h"
+
+/*
+    String builders. Appending to one is amortized O(1), where building a
+    string with + copies everything built so far on every step.
+*/
+
+strbuf *strbuf_create(void);
+void strbuf_destroy(strbuf *sb);
+Value *strbuf_new(strbuf *sb);
+Value *strbuf_str(Value *self);
+Value *strbuf_repr(Value *self);
+Value *strbuf_free(Value *self);
+Value *strbuf_copy(Value *self);
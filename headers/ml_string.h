@@ -1,8 +1,40 @@
 // This project is licensed under the GNU Affero General Public License
 #pragma once
+#include "../mila.h"
 #include <stddef.h>
 
 char *mila_strdup(const char *s);
 char *mila_strndup(const char *s, size_t n);
 char *mila_strcat_alloc(const char *a, const char *b);
-char *mila_strtok(char *str, const char *delim);
\ No newline at end of file
+char *mila_strtok(char *str, const char *delim);
+// Buffers for string values, see MString
+
+// Slices shorter than this are copied, a view costs about as much
+#define MSTRING_VIEW_MIN 32
+// and so are those that would keep a string this many times their size
+// alive
+#define MSTRING_VIEW_RATIO 8
+
+char *mstring_alloc(size_t len);
+char *mstring_new(const char *s, size_t len);
+char *mstring_view(MString *base, const char *bytes, size_t len);
+void mstring_release(char *s);
+int mstring_eq(MString *a, MString *b);
+
+// Growable buffer for building strings, appends are amortized O(1). The
+// bytes sit where an MString keeps them, so sb_mstring hands them to a
+// string value without a copy
+typedef struct {
+    char *buf; // NUL terminated, NULL once taken
+    size_t len;
+    size_t cap; // bytes at buf, the NUL included
+} strbuf;
+
+void sb_init(strbuf *b);
+int sb_reserve(strbuf *b, size_t n);
+int sb_append(strbuf *b, const char *data, size_t n);
+int sb_append_str(strbuf *b, const char *s);
+int sb_appendf(strbuf *b, const char *fmt, ...);
+char *sb_cstr(strbuf *b);
+char *sb_mstring(strbuf *b);
+void sb_free(strbuf *b);
@@ -0,0 +1,42 @@
+// This project is licensed under the GNU Affero General Public License
+#pragma once
+#include "../mila.h"
+#include "ml_vec.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    Byte scanning kernels for the str builtins: substring search, ASCII
+    case folding and finding the next byte out of a set. Picked like the
+    vec kernels, AVX2 or SSE2 where the CPU has them and plain C
+    otherwise. Case folding only touches A-Z and a-z, like toupper and
+    tolower do in the C locale.
+*/
+
+#define STR_NPOS ((size_t)-1)
+
+// Sets of up to this many bytes are compared a vector at a time, bigger
+// ones go through the table a byte at a time
+#define STRSET_VEC_MAX 8
+
+typedef struct {
+    unsigned char table[256];
+    unsigned char bytes[STRSET_VEC_MAX];
+    int count; // bytes in the set, 0 when it's bigger than STRSET_VEC_MAX
+} StrSet;
+
+typedef struct {
+    const char *name;
+    // index of the first needle in hay or STR_NPOS, an empty needle is
+    // found at 0
+    size_t (*find)(const char *hay, size_t n, const char *needle, size_t m);
+    size_t (*find_caseless)(const char *hay, size_t n, const char *needle,
+                            size_t m);
+    // index of the first byte that is in set, n when there is none
+    size_t (*scan)(const char *s, size_t n, const StrSet *set);
+    // dst may be src
+    void (*fold)(const char *src, char *dst, size_t n, int upper);
+} StrKernels;
+
+const StrKernels *str_kernels(void);
+void strset_init(StrSet *set, const char *bytes, size_t len);
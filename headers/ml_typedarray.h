@@ -0,0 +1,53 @@
+// This project is licensed under the GNU Affero General Public License
+#pragma once
+#include "../mila.h"
+#include <stdint.h>
+
+/*
+    Typed arrays keep raw int64_t, double or uint8_t elements in one
+    buffer. Elements are boxed into a Value only when they are read, and
+    the box is reused once nobody else holds it. Boxes belong to the
+    reading thread or loop, never to the storage.
+*/
+
+typedef enum {
+    TA_I64,
+    TA_F64,
+    TA_U8,
+} TypedArrayKind;
+
+typedef struct {
+    void *data;
+    size_t len;
+    TypedArrayKind kind;
+    MRefCount refcount;
+} TypedArray;
+
+typedef struct {
+    TypedArray *storage; // held for the whole loop, changes go to a copy
+    size_t index;
+    Value *box;
+} TypedArrayIterState;
+
+#define TARRAY_SHARED(val) (((TypedArray *)(val)->v)->refcount > 1)
+#define TARRAY_I64(arr) ((int64_t *)(arr)->data)
+#define TARRAY_F64(arr) ((double *)(arr)->data)
+#define TARRAY_U8(arr) ((uint8_t *)(arr)->data)
+
+TypedArray *tarray_create(TypedArrayKind kind, size_t len);
+TypedArray *tarray_clone(TypedArray *arr);
+void tarray_destroy(TypedArray *arr);
+void tarray_unshare(Value *self);
+Value *tarray_new(TypedArray *arr);
+int tarray_format_elem(char *out, size_t size, TypedArray *arr, size_t i);
+Value *tarray_str(Value *self);
+Value *tarray_repr(Value *self);
+Value *tarray_free(Value *self);
+Value *tarray_copy(Value *self);
+Value *get_tarray(Value *self, Value *index);
+Value *set_tarray(Value *self, Value *index, Value *value);
+TypedArrayIterState *tarray_iter_init(Value *self);
+Value *tarray_iter_next(TypedArrayIterState *state);
+void tarray_iter_cleanup(TypedArrayIterState *state);
+// Frees the calling thread's index read boxes, for threads that finish
+void tarray_read_boxes_release(void);
@@ -0,0 +1,66 @@
+// This project is licensed under the GNU Affero General Public License
+#pragma once
+#include "../mila.h"
+#include "ml_typedarray.h"
+#include <stddef.h>
+
+/*
+    Kernels over typed arrays for the vec builtins. The f64 kernels come
+    in AVX2, SSE2 and plain C versions, the one to use is picked the
+    first time a kernel runs from what the CPU supports, so a portable
+    build still gets AVX2 where it's there. ML_NO_SIMD leaves only the
+    plain C ones.
+*/
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) &&        \
+    (defined(__GNUC__) || defined(__clang__)) && !defined(ML_NO_SIMD)
+#define ML_VEC_X86 1
+#else
+#define ML_VEC_X86 0
+#endif
+
+#if ML_VEC_X86
+// For the AVX2 kernels, compiled in whatever the build targets
+#define ML_AVX2 __attribute__((target("avx2")))
+#endif
+
+typedef enum {
+    VEC_ADD,
+    VEC_SUB,
+    VEC_MUL,
+    VEC_DIV,
+    VEC_RSUB, // scalar - x
+    VEC_RDIV, // scalar / x
+} VecOp;
+
+typedef enum {
+    VEC_SQRT,
+    VEC_FLOOR,
+    VEC_CEIL,
+    VEC_FABS,
+    VEC_SIN,
+    VEC_COS,
+} VecMath;
+
+typedef struct {
+    const char *name;
+    double (*sum)(const double *x, size_t n);
+    double (*dot)(const double *x, const double *y, size_t n);
+    double (*min)(const double *x, size_t n); // n > 0
+    double (*max)(const double *x, size_t n); // n > 0
+    void (*axpy)(double a, const double *x, double *y, size_t n);
+    void (*binop)(VecOp op, const double *x, const double *y, double *out,
+                  size_t n);
+    void (*binop_scalar)(VecOp op, const double *x, double s, double *out,
+                         size_t n);
+#ifndef ML_NO_LIBM
+    // out may be x
+    void (*math)(VecMath fn, const double *x, double *out, size_t n);
+#endif
+} VecKernels;
+
+const VecKernels *vec_kernels(void);
+#ifndef ML_NO_LIBM
+Value *vec_map(VecMath fn, const char *who, Value *x);
+Value *vec_pow(Value *base, Value *exp);
+#endif
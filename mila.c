@@ -67,6 +67,7 @@ pthread_mutex_t mila_cached_modules_lock_read = {0};
 #endif
 pthread_mutex_t mila_search_path_lock = {0};
 pthread_mutex_t mila_search_path_lock_read = {0};
+volatile char mila_refs_shared = 0;
 #endif
 
 const char *MILA_ERROR_NAMES[] = {
@@ -94,7 +95,8 @@ const char *MILA_OP_NAME[] = {
     "UMethodFree",
     "UMethodKill",
     "UMethodCopy",
-    "UMethodCopyShallow"
+    "UMethodCopyShallow",
+    "UMethodVisit"
 };
 const int MILA_OP_COUNT = sizeof(MILA_OP_NAME)/sizeof(MILA_OP_NAME[0]);
 const int MILA_TYPE_COUNT = T_ARG_END;
@@ -618,8 +620,9 @@ Value *_copy(Value *src) {
     /* Deep copy based on type */
     switch (src->type) {
     case T_STRING:
-        /* Strings: duplicate the string buffer */
-        copy->v = (void *)mila_strdup(GET_STRING(src));
+        /* Strings: bytes never change in place, so share the buffer */
+        ML_REF_INC(GET_MSTRING(src));
+        copy->v = src->v;
         break;
     case T_INT:
         copy->v = (ValueValue *)mila_malloc(sizeof(ValueValue));
@@ -721,6 +724,8 @@ MethodTable *val_make_table(void) {
 void val_set_table(Value *v, MethodTable *t) {
     v->owns_table = 0;
     v->method_table = t;
+    if (t && t[UMethodVisit])
+        gc_track(v);
 }
 
 FN_UNUSED void val_set_method(Value *v, MethodType t, void *func) {
@@ -744,7 +749,7 @@ FN_UNUSED int is_truthy(Value *value) {
     case T_BOOL:
         return GET_BOOL(value) ? 1 : 0;
     case T_STRING:
-        return strlen(GET_STRING(value)) ? 1 : 0;
+        return GET_STRING_LEN(value) ? 1 : 0;
     case T_FUNCTION:
     case T_NATIVE:
         return 1;
@@ -779,230 +784,24 @@ FN_UNUSED int is_truthy(Value *value) {
     return 0;
 }
 
-static const char *find_close(const char *p, char close) {
-    while (*p) {
-        if (*p == '\\' && *(p + 1)) {
-            p += 2;
-            continue;
-        }
-        if (*p == close)
-            return p;
-        p++;
-    }
-    return NULL;
-}
-
-static int set_match(const char *start, const char *end, char c) {
-    const char *p = start;
-    while (p < end) {
-        char lo;
-        if (*p == '\\' && p + 1 < end) {
-            lo = *(p + 1);
-            p += 2;
-        } else {
-            lo = *p;
-            p++;
-        }
-
-        if (p < end && *p == '-' && p + 1 < end) {
-            char hi;
-            p++;
-            if (*p == '\\' && p + 1 < end) {
-                hi = *(p + 1);
-                p += 2;
-            } else {
-                hi = *p;
-                p++;
-            }
-            if (c >= lo && c <= hi)
-                return 1;
-        } else {
-            if (c == lo)
-                return 1;
-        }
-    }
-    return 0;
-}
-
-static int do_match(const char *p, const char *s) {
-    if (*p == '\0')
-        return *s == '\0';
-
-    if (*p == '\\') {
-        p++;
-        if (*p == '\0')
-            return 0;
-        if (*s == '\0' || *s != *p)
-            return 0;
-        return do_match(p + 1, s + 1);
-    }
-
-    if (*p == '?') {
-        if (*s == '\0')
-            return 0;
-        return do_match(p + 1, s + 1);
-    }
-
-    if (*p == '*') {
-        const char *rest = p + 1;
-        const char *cur = s;
-        while (1) {
-            if (do_match(rest, cur))
-                return 1;
-            if (*cur == '\0')
-                return 0;
-            cur++;
-        }
-    }
-
-    if (*p == '[') {
-        const char *close = find_close(p + 1, ']');
-        if (!close) {
-            if (*s != '[')
-                return 0;
-            return do_match(p + 1, s + 1);
-        }
-        if (*s == '\0' || !set_match(p + 1, close, *s))
-            return 0;
-        return do_match(close + 1, s + 1);
-    }
-
-    if (*p == '{') {
-        const char *close = find_close(p + 1, '}');
-        if (!close) {
-            if (*s != '{')
-                return 0;
-            return do_match(p + 1, s + 1);
-        }
-        const char *cur = s;
-        if (*cur == '\0' || !set_match(p + 1, close, *cur))
-            return 0;
-        cur++;
-        while (1) {
-            if (do_match(close + 1, cur))
-                return 1;
-            if (*cur == '\0' || !set_match(p + 1, close, *cur))
-                return 0;
-            cur++;
-        }
-    }
-
-    if (*s == '\0' || *s != *p)
-        return 0;
-    return do_match(p + 1, s + 1);
-}
-
+// Glob patterns are compiled once and cached, see ml_glob.c
 int match(const char *pattern, const char *str) {
-    return do_match(pattern, str);
-}
-
-static const char *match_end(const char *p, const char *s) {
-    if (*p == '\0')
-        return s;
-
-    if (*p == '\\') {
-        p++;
-        if (*p == '\0' || *s == '\0' || *s != *p)
-            return NULL;
-        return match_end(p + 1, s + 1);
-    }
-
-    if (*p == '?') {
-        if (*s == '\0')
-            return NULL;
-        return match_end(p + 1, s + 1);
-    }
-
-    if (*p == '*') {
-        const char *rest = p + 1;
-        const char *cur = s;
-        while (1) {
-            const char *r = match_end(rest, cur);
-            if (r)
-                return r;
-            if (*cur == '\0')
-                return NULL;
-            cur++;
-        }
-    }
-
-    if (*p == '[') {
-        const char *close = find_close(p + 1, ']');
-        if (!close) {
-            if (*s != '[')
-                return NULL;
-            return match_end(p + 1, s + 1);
-        }
-        if (*s == '\0' || !set_match(p + 1, close, *s))
-            return NULL;
-        return match_end(close + 1, s + 1);
-    }
-
-    if (*p == '{') {
-        const char *close = find_close(p + 1, '}');
-        if (!close) {
-            if (*s != '{')
-                return NULL;
-            return match_end(p + 1, s + 1);
-        }
-        const char *cur = s;
-        if (*cur == '\0' || !set_match(p + 1, close, *cur))
-            return NULL;
-        cur++;
-        while (1) {
-            const char *r = match_end(close + 1, cur);
-            if (r)
-                return r;
-            if (*cur == '\0' || !set_match(p + 1, close, *cur))
-                return NULL;
-            cur++;
-        }
-    }
-
-    if (*s == '\0' || *s != *p)
-        return NULL;
-    return match_end(p + 1, s + 1);
+    MGlob *g = glob_get(pattern);
+    int res = glob_match(g, str, strlen(str));
+    glob_release(g);
+    return res;
 }
 
+/* leftmost match of pattern in str, * and {} take as little as they can */
 int find_match(const char *pattern, const char *str, const char **out_start,
                size_t *out_len) {
-    const char *s = str;
-    while (1) {
-        const char *end = match_end(pattern, s);
-        if (end) {
-            *out_start = s;
-            *out_len = (size_t)(end - s);
-            return 1;
-        }
-        if (*s == '\0')
-            break;
-        s++;
-    }
-    return 0;
-}
-
-typedef struct {
-    char *buf;
-    size_t len;
-    size_t cap;
-} strbuf;
-
-static void sb_init(strbuf *b) {
-    b->cap = 16;
-    b->buf = mila_malloc(b->cap);
-    b->len = 0;
-    b->buf[0] = '\0';
-}
-
-static void sb_append(strbuf *b, const char *data, size_t n) {
-    if (b->len + n + 1 > b->cap) {
-        while (b->len + n + 1 > b->cap)
-            b->cap *= 2;
-        b->buf = realloc(b->buf, b->cap);
-    }
-    memcpy(b->buf + b->len, data, n);
-    b->len += n;
-    b->buf[b->len] = '\0';
+    MGlob *g = glob_get(pattern);
+    size_t start;
+    int res = glob_find(g, str, strlen(str), 0, &start, out_len);
+    glob_release(g);
+    if (res)
+        *out_start = str + start;
+    return res;
 }
 
 char *replace_dollar(const char *rep, const char *input) {
@@ -1041,188 +840,34 @@ char *replace_dollar(const char *rep, const char *input) {
 
 char *mapped_replace_match(const char *pattern, const char *str,
                            const char *replacement, int count) {
-    strbuf out;
-    sb_init(&out);
-    size_t rep_len = strlen(replacement);
-    const char *cursor = str;
-    int done = 0;
-
-    while (count == -1 || done < count) {
-        const char *m_start, *m_end;
-        size_t m_len;
-        if (!find_match(pattern, cursor, &m_start, &m_len))
-            break;
-        m_end = m_start + m_len;
-
-        sb_append(&out, cursor, (size_t)(m_start - cursor));
-        sb_append(&out, replacement, rep_len);
-
-        if (m_len == 0) {
-            if (*m_end == '\0') {
-                cursor = m_end;
-                done++;
-                break;
-            }
-            sb_append(&out, m_end, 1);
-            cursor = m_end + 1;
-        } else {
-            cursor = m_end;
-        }
-        done++;
-        if (*cursor == '\0')
-            break;
-    }
-
-    sb_append(&out, cursor, strlen(cursor));
-    return out.buf;
+    MGlob *g = glob_get(pattern);
+    char *res = glob_replace(g, str, replacement, count, 0, 0);
+    glob_release(g);
+    return res;
 }
 
-static int find_match_greedy(const char *pattern, const char *str,
-                             const char **out_start, size_t *out_len);
-/* like find_match but returns index of first match, -1 if none, out_len
- * optional */
+/* like find_match but returns index of the leftmost longest match, -1 if
+ * none, out_len optional */
 long find_match_index(const char *pattern, const char *str, size_t *out_len) {
-    const char *start;
-    size_t len;
-    if (!find_match_greedy(pattern, str, &start, &len))
+    MGlob *g = glob_get(pattern);
+    size_t start, len;
+    int res = glob_find(g, str, strlen(str), 1, &start, &len);
+    glob_release(g);
+    if (!res)
         return -1;
     if (out_len)
         *out_len = len;
-    return (long)(start - str);
-}
-
-/* greedy version of match_end: * and {} consume max chars, backtrack only if
- * needed */
-static const char *greedy_match_end(const char *p, const char *s) {
-    if (*p == '\0')
-        return s;
-
-    if (*p == '\\') {
-        p++;
-        if (*p == '\0' || *s == '\0' || *s != *p)
-            return NULL;
-        return greedy_match_end(p + 1, s + 1);
-    }
-
-    if (*p == '?') {
-        if (*s == '\0')
-            return NULL;
-        return greedy_match_end(p + 1, s + 1);
-    }
-
-    if (*p == '*') {
-        const char *rest = p + 1;
-        const char *cur = s + strlen(s);
-        while (cur >= s) {
-            const char *r = greedy_match_end(rest, cur);
-            if (r)
-                return r;
-            if (cur == s)
-                break;
-            cur--;
-        }
-        return NULL;
-    }
-
-    if (*p == '[') {
-        const char *close = find_close(p + 1, ']');
-        if (!close) {
-            if (*s != '[')
-                return NULL;
-            return greedy_match_end(p + 1, s + 1);
-        }
-        if (*s == '\0' || !set_match(p + 1, close, *s))
-            return NULL;
-        return greedy_match_end(close + 1, s + 1);
-    }
-
-    if (*p == '{') {
-        const char *close = find_close(p + 1, '}');
-        if (!close) {
-            if (*s != '{')
-                return NULL;
-            return greedy_match_end(p + 1, s + 1);
-        }
-        const char *run_end = s;
-        while (*run_end && set_match(p + 1, close, *run_end))
-            run_end++;
-        if (run_end == s)
-            return NULL;
-        const char *cur = run_end;
-        while (cur > s) {
-            const char *r = greedy_match_end(close + 1, cur);
-            if (r)
-                return r;
-            cur--;
-        }
-        return NULL;
-    }
-
-    if (*s == '\0' || *s != *p)
-        return NULL;
-    return greedy_match_end(p + 1, s + 1);
-}
-
-/* find leftmost longest substring of str matching pattern */
-static int find_match_greedy(const char *pattern, const char *str,
-                             const char **out_start, size_t *out_len) {
-    const char *s = str;
-    while (1) {
-        const char *end = greedy_match_end(pattern, s);
-        if (end) {
-            *out_start = s;
-            *out_len = (size_t)(end - s);
-            return 1;
-        }
-        if (*s == '\0')
-            break;
-        s++;
-    }
-    return 0;
+    return (long)start;
 }
 
 /* replace up to count full matches (-1 = replace all), caller must free result
  */
 char *replace_match(const char *pattern, const char *str,
                     const char *replacement, int count) {
-    strbuf out;
-    sb_init(&out);
-    const char *cursor = str;
-    int done = 0;
-
-    while (count == -1 || done < count) {
-        const char *m_start, *m_end;
-        size_t m_len;
-        if (!find_match_greedy(pattern, cursor, &m_start, &m_len))
-            break;
-        m_end = m_start + m_len;
-
-        sb_append(&out, cursor, (size_t)(m_start - cursor));
-        char *cursor_tmp = NULL;
-        malloc_sprintf(&cursor_tmp, "%.*s", m_len, m_start);
-        char *tmp = replace_dollar(cursor_tmp, replacement);
-        sb_append(&out, tmp, strlen(tmp));
-        mila_free(tmp);
-        mila_free(cursor_tmp);
-
-        if (m_len == 0) {
-            if (*m_end == '\0') {
-                cursor = m_end;
-                done++;
-                break;
-            }
-            sb_append(&out, m_end, 1);
-            cursor = m_end + 1;
-        } else {
-            cursor = m_end;
-        }
-        done++;
-        if (*cursor == '\0')
-            break;
-    }
-
-    sb_append(&out, cursor, strlen(cursor));
-    return out.buf;
+    MGlob *g = glob_get(pattern);
+    char *res = glob_replace(g, str, replacement, count, 1, 1);
+    glob_release(g);
+    return res;
 }
 
 Value *vnull() { return val_new_raw(T_NULL); }
@@ -1361,9 +1006,7 @@ __attribute__((format(printf, 1, 2))) Value *vstring_fmt(char *fmt, ...) {
 
     vsnprintf(buf, len + 1, fmt, ap);
     va_end(ap);
-    Value *v = val_new_raw(T_STRING);
-    v->v = (void *)buf;
-    return v;
+    return vstring_take(buf);
 }
 
 Value *vint(long x) {
@@ -1391,17 +1034,42 @@ Value *vbool(int b) {
 }
 
 Value *vstring_dup(const char *restrict s) {
-    Value *v = val_new_raw(T_STRING);
-    v->v = (void *)mila_strdup(s ? s : "");
-    return v;
+    return vstring_len(s ? s : "", s ? strlen(s) : 0);
 }
 
+// Plain C strings get their header here, so this is a copy. Code that
+// knows the length up front fills an mstring_alloc buffer instead
 Value *vstring_take(char *s) {
+    Value *v = vstring_dup(s);
+    mila_free(s);
+    return v;
+}
+
+Value *vstring_len(const char *restrict s, size_t len) {
+    return vstring_mstring(mstring_new(s, len));
+}
+
+Value *vstring_mstring(char *s) {
+    if (!s)
+        return verror("Couldn't allocate a string");
     Value *v = val_new_raw(T_STRING);
     v->v = (void *)s;
     return v;
 }
 
+Value *vstring_view(Value *str, size_t start, size_t len) {
+    MString *m = GET_MSTRING(str);
+    if (start > m->len)
+        return verror("Out of bounds string slice!");
+    if (len > m->len - start)
+        len = m->len - start;
+    const char *bytes = MSTRING_BYTES(m) + start;
+    MString *base = m->view ? m->view->base : m;
+    if (len < MSTRING_VIEW_MIN || len < base->len / MSTRING_VIEW_RATIO)
+        return vstring_len(bytes, len);
+    return vstring_mstring(mstring_view(base, bytes, len));
+}
+
 // String
 Value *vstring_slice(const char *restrict src, size_t start, size_t len) {
     size_t n = strlen(src);
@@ -1411,14 +1079,7 @@ Value *vstring_slice(const char *restrict src, size_t start, size_t len) {
     if (start + len > n)
         len = n - start;
 
-    char *buf = mila_malloc(len + 1);
-    if (!buf)
-        return vnull();
-
-    memcpy(buf, src + start, len);
-    buf[len] = '\0';
-
-    return vstring_take(buf);
+    return vstring_len(src + start, len);
 }
 
 Value *vstring_index(const char *restrict src, size_t index) {
@@ -1426,14 +1087,40 @@ Value *vstring_index(const char *restrict src, size_t index) {
     if (index >= n)
         return vnull();
 
-    char *buf = mila_malloc(sizeof(char) * 2);
-    if (!buf)
-        return vnull();
+    return vstring_byte(src[index]);
+}
 
-    buf[0] = src[index];
-    buf[1] = '\0';
+// Every one byte string. Indexing and iterating a string hand these out,
+// a parser going through a string a byte at a time allocates nothing
+static Value *vstring_bytes[256] = {0};
 
-    return vstring_take(buf);
+void vstring_bytes_init(void) {
+    for (int c = 0; c < 256; c++) {
+        Value *v = vstring_len((char[]){(char)c}, 1);
+        v->refcount = ML_IMMORTAL_REFS;
+        vstring_bytes[c] = v;
+    }
+}
+
+void vstring_bytes_free(void) {
+    for (int c = 0; c < 256; c++) {
+        Value *v = vstring_bytes[c];
+        vstring_bytes[c] = NULL;
+        if (!v)
+            continue;
+        mstring_release((char *)v->v);
+        mila_free(v);
+    }
+}
+
+Value *vstring_byte(char c) {
+    Value *v = vstring_bytes[(unsigned char)c];
+    return v ? v : vstring_len(&c, 1);
+}
+
+int vstring_is_byte(Value *v) {
+    return GET_TYPE(v) == T_STRING && GET_STRING_LEN(v) == 1 &&
+           vstring_bytes[(unsigned char)*GET_STRING_BYTES(v)] == v;
 }
 
 Value *vstring_replace(const char *restrict src, const char *restrict needle,
@@ -1540,6 +1227,8 @@ Value *vfunction(FunctionParameters *params, char *return_type,
     function->closure = closure;
     function->name = NULL;
     v->v = (void *)function;
+    if (closure)
+        gc_track(v);
     return v;
 }
 
@@ -1785,7 +1474,7 @@ int raw_print_value(Value *v) {
         return printf("%s", buf);
     }
     case T_STRING:
-        return printf("%s", GET_STRING(v) ? GET_STRING(v) : "");
+        return (int)fwrite(GET_STRING_BYTES(v), 1, GET_STRING_LEN(v), stdout);
     case T_BOOL:
         return printf("%s", v->v ? "true" : "false");
     case T_FUNCTION: {
@@ -2111,10 +1800,9 @@ Value *val_retain(Value *v) {
 #endif
     if (!v)
         return NULL;
-    if (v->refcount == ML_WEAK_REF_TRIGGER)
+    if (v->refcount >= ML_IMMORTAL_REFS)
         return v;
-    v->refcount++;
-    if (v->refcount >= ML_MAX_REFS) {
+    if (ML_REF_INC(v) >= ML_MAX_REFS) {
         fprintf(stderr, "MAXIMUM REF COUNTS REACHED FOR VALUE: ");
         print_value_debug(v);
         abort();
@@ -2122,6 +1810,40 @@ Value *val_retain(Value *v) {
     return v;
 }
 
+// Frozen roots, kept reachable so immortal values are not reported as leaks.
+static struct {
+    Value **items;
+    size_t size, count;
+} frozen_roots = {0};
+
+static void val_freeze_child(Value **slot, void *ctx) {
+    (void)ctx;
+    Value *v = *slot;
+    if (!v || v->refcount >= ML_IMMORTAL_REFS)
+        return;
+    // immortal values can never be part of a collectable cycle
+    gc_untrack(v);
+    v->refcount = ML_IMMORTAL_REFS;
+    visit_method visit = (visit_method)GET_METHOD(v, UMethodVisit);
+    if (visit)
+        visit(v, val_freeze_child, NULL);
+}
+
+// Make v and everything reachable from it immutable and immortal.
+// Refcount operations on frozen values are no-ops, so they can be shared
+// between threads without any synchronization.
+void val_freeze(Value *v) {
+    if (!v || v->refcount >= ML_IMMORTAL_REFS)
+        return;
+    if (frozen_roots.count >= frozen_roots.size) {
+        frozen_roots.size = frozen_roots.size ? frozen_roots.size * 2 : 16;
+        frozen_roots.items = mila_realloc(frozen_roots.items,
+                                          sizeof(Value *) * frozen_roots.size);
+    }
+    frozen_roots.items[frozen_roots.count++] = v;
+    val_freeze_child(&v, NULL);
+}
+
 void val_kill_incomplete(Value *v);
 
 // release
@@ -2143,17 +1865,18 @@ void val_release(Value *v) {
     print_value_repr(v);
     puts("");
 #endif
-    if (v->refcount == ML_WEAK_REF_TRIGGER)
+    if (v->refcount >= ML_IMMORTAL_REFS)
         return;
-    v->refcount--;
-    if (v->refcount <= 0) {
+    if (ML_REF_DEC(v) == 0) {
+        if (v->type == T_FUNCTION || GET_METHOD(v, UMethodVisit))
+            gc_untrack(v);
         if (v->method_table && v->method_table[UMethodFree]) {
             ((unary_method)v->method_table[UMethodFree])(v);
             goto cleanup;
         }
         // mila_free internals
-        if (v->type == T_STRING && GET_STRING(v))
-            mila_free(GET_STRING(v));
+        if (v->type == T_STRING && v->v)
+            mstring_release((char *)v->v);
         if (v->type == T_ERROR && GET_ERROR_MESSAGE(v))
             mila_free(GET_ERROR_MESSAGE(v));
         if (v->type == T_TAGGED_ERROR && v->v->tagged_error.message)
@@ -2243,7 +1966,7 @@ void val_release(Value *v) {
 }
 
 void val_kill(Value *v) {
-    if (!v)
+    if (!v || v->refcount >= ML_IMMORTAL_REFS)
         return;
 #ifdef MILA_DEBUG
     printf("  -- val_kill: %p\n     type: %s\n     refcount %i -> 0 (forced)\n "
@@ -2254,6 +1977,8 @@ void val_kill(Value *v) {
     print_value_repr(v);
     puts("");
 #endif
+    if (v->type == T_FUNCTION || GET_METHOD(v, UMethodVisit))
+        gc_untrack(v);
     if (v->method_table && v->method_table[UMethodKill]) {
         ((unary_method)v->method_table[UMethodKill])(v);
         goto cleanup;
@@ -2263,8 +1988,8 @@ void val_kill(Value *v) {
         goto cleanup;
     }
     // mila_free internals
-    if (v->type == T_STRING && GET_STRING(v))
-        mila_free(GET_STRING(v));
+    if (v->type == T_STRING && v->v)
+        mstring_release((char *)v->v);
     if (v->type == T_ERROR && GET_ERROR_MESSAGE(v))
         mila_free(GET_ERROR_MESSAGE(v));
     if (v->type == T_TAGGED_ERROR && v->v->tagged_error.message)
@@ -2366,6 +2091,8 @@ void val_kill_incomplete(Value *v) {
     print_value_repr(v);
     puts("");
 #endif
+    if (v->type == T_FUNCTION || GET_METHOD(v, UMethodVisit))
+        gc_untrack(v);
     if (v->method_table && v->method_table[UMethodKill]) {
         ((unary_method)v->method_table[UMethodKill])(v);
         goto cleanup;
@@ -2375,8 +2102,8 @@ void val_kill_incomplete(Value *v) {
         goto cleanup;
     }
     // mila_free internals
-    if (v->type == T_STRING && GET_STRING(v))
-        mila_free(GET_STRING(v));
+    if (v->type == T_STRING && v->v)
+        mstring_release((char *)v->v);
     if (v->type == T_ERROR && GET_ERROR_MESSAGE(v))
         mila_free(GET_ERROR_MESSAGE(v));
     if (v->type == T_TAGGED_ERROR && v->v->tagged_error.message)
@@ -3496,7 +3223,7 @@ const char *skip_parse_statement(Src *s) {
         return match_char(s, ';') ? ERR_SUCCESS : ERR_EXPECTED_SEMICOLON;
     }
 
-    if (is_keyword_at(s, "set")) {
+    if (is_set_statement(s)) {
         s->pos += 3;
         char *id = parse_ident(s);
         if (!id)
@@ -4364,6 +4091,14 @@ int is_keyword_at(Src *s, const char *kw) {
     return 0;
 }
 
+// `set x = ...`, and not a call into the set builtins like `set.add(s, x)`
+int is_set_statement(Src *s) {
+    if (!is_keyword_at(s, "set"))
+        return 0;
+    char after = s->src[s->pos + 3];
+    return after != '.' && after != '(';
+}
+
 char *dup_substr(Src *s, int a, int b) {
     int n = b - a;
     char *r = mila_malloc(n + 1);
@@ -4532,6 +4267,7 @@ Value *eval_block(Src *s, Env *env) {
         if (match_char(s, '}'))
             break;
         val_release(last);
+        ML_GC_SAFEPOINT();
         Value *st = eval_statement(s, frame);
         last = st;
 
@@ -4562,6 +4298,7 @@ Value *eval_block_raw(Src *s, Env *frame) {
             break;
         if (match_char(s, '}'))
             break;
+        ML_GC_SAFEPOINT();
         Value *st = eval_statement(s, frame);
         val_release(last);
         last = st;
@@ -4879,13 +4616,41 @@ Value *call_function(Value *fnval, Env *env, int argc, Value **argv) {
     return vnull();
 }
 
+static int is_inert_operand(Src *s, int min_prec);
+
+// Call arguments that are plain variable reads are borrowed while nothing
+// else in the argument list can run code. A function's parameters retain
+// what they bind before its body runs, so it takes them borrowed. A native
+// may run code through a callback or an overload while still reading argv,
+// it gets references of its own.
+// Bit i of borrowed is set for a borrowed args[i], only the first 64 are.
+static void call_args_own(Value **args, uint64_t *borrowed, int argc) {
+    for (int i = 0; *borrowed && i < argc && i < 64; i++)
+        if (*borrowed & (1ull << i))
+            val_retain(args[i]);
+    *borrowed = 0;
+}
+
+static void call_args_release(Value **args, uint64_t borrowed, int argc) {
+    for (int i = 0; i < argc; i++)
+        if (i >= 64 || !(borrowed & (1ull << i)))
+            val_release(args[i]);
+    mila_free(args);
+}
+
 // parse expression with precedence:
 // We'll implement: primary, unary, multiplicative(*,/), additive(+,-),
 // comparison (<,>,<=,>=,==,!=), logical (&&,||)
 
 // parse primary: numbers, strings, identifiers (variables or function calls),
 // parentheses, function literal
-Value *eval_primary(Src *s, Env *env) {
+// Evaluates a primary expression. When `borrowed` is non-NULL a plain
+// variable read hands back the binding's value without retaining it and sets
+// *borrowed; the caller must not release it and must retain it before
+// storing it or running anything that could rebind the variable.
+Value *eval_primary_ex(Src *s, Env *env, char *borrowed) {
+    if (borrowed)
+        *borrowed = 0;
     skip_ws(s);
     char c = src_peek(s);
     if (c == '\0')
@@ -4907,8 +4672,11 @@ Value *eval_primary(Src *s, Env *env) {
         if (res->refcount == 1) {
             val_release(res);
             return vnull();
-        } else if (res->refcount == ML_WEAK_REF_TRIGGER)
+        } else if (res->refcount >= ML_IMMORTAL_REFS)
             return res;
+        // the weakref keeps pointing at this storage, copies must not
+        // pull it away from under it
+        val_unshare(res);
         if (res->wrefs == NULL) {
             res->wrefs = (Wrefs *)mila_malloc(sizeof(Wrefs));
             res->wrefs->items = NULL;
@@ -4957,6 +4725,7 @@ Value *eval_primary(Src *s, Env *env) {
                 args[argc++] = a;
                 if (expand &&
                     strcmp(GET_TYPENAME(a), MILA_LPREFIX "list") == 0) {
+                    list_unshare(a);
                     Value **vl = ll_to_iter((LinkedList *)a->v);
                     unsigned long vl_len = GET_UINTEGER(vl[0]);
                     for (unsigned long i = 1; i < vl_len; i++) {
@@ -5129,12 +4898,9 @@ Value *eval_primary(Src *s, Env *env) {
     }
     if (c == '!') {
         src_get(s);
-        Value *v = eval_expr(s, env);
-        if (IS_ERROR(v))
-            return v;
-        Value *res = vbool(!is_truthy(v));
-        val_release(v);
-        return res;
+        Value *err = NULL;
+        int truth = eval_truth(s, env, &err);
+        return err ? err : vbool(!truth);
     }
     // function literal
     if (is_keyword_at(s, "fn")) {
@@ -5261,20 +5027,28 @@ Value *eval_primary(Src *s, Env *env) {
             src_get(s); // consume '('
             // parse comma separated expressions
             Value **args = NULL;
+            uint64_t borrowed = 0; // args that are a variable's value
             int argc = 0;
             skip_ws(s);
 
             // handle (value)(...) calls
             if (src_peek(s) != ')') {
                 for (;;) {
-                    Value *a = eval_expr(s, env);
+                    // an argument that can run code could rebind the
+                    // variables the borrowed ones came from
+                    if (borrowed && !is_inert_operand(s, 1))
+                        call_args_own(args, &borrowed, argc);
+                    char a_borrowed = 0;
+                    Value *a = eval_expr_prec_ex(s, env, 1, &a_borrowed);
                     if (IS_ERROR(a)) {
                         mila_free(id);
-                        for (int i = 0; i < argc; i++)
-                            val_release(args[i]);
-                        mila_free(args);
-                        return a;
+                        call_args_release(args, borrowed, argc);
+                        return a_borrowed ? val_retain(a) : a;
                     }
+                    if (a_borrowed && argc >= 64)
+                        val_retain(a);
+                    else if (a_borrowed)
+                        borrowed |= 1ull << argc;
                     args = mila_realloc(args, sizeof(Value *) * (argc + 1));
                     args[argc++] = a;
                     if (match_char(s, ','))
@@ -5282,9 +5056,7 @@ Value *eval_primary(Src *s, Env *env) {
                     if (match_char(s, ')'))
                         break;
                     mila_free(id);
-                    for (int i = 0; i < argc; i++)
-                        val_release(args[i]);
-                    mila_free(args);
+                    call_args_release(args, borrowed, argc);
 
                     int k = 1;
                     while (k) {
@@ -5310,10 +5082,7 @@ Value *eval_primary(Src *s, Env *env) {
             if (!callee) {
                 Value *res = verror("Undefined function '%s'", id);
                 mila_free(id);
-                // release args
-                for (int i = 0; i < argc; i++)
-                    val_release(args[i]);
-                mila_free(args);
+                call_args_release(args, borrowed, argc);
                 return res;
             }
             mila_free(id);
@@ -5321,10 +5090,10 @@ Value *eval_primary(Src *s, Env *env) {
 #ifdef MILA_DEBUG
             printf("  ?? Call to %s\n", ((NativeFunctionV *)(callee->v))->name);
 #endif
+            if (callee->type != T_FUNCTION)
+                call_args_own(args, &borrowed, argc);
             Value *res = call_function(callee, env, argc, args);
-            for (int i = 0; i < argc; i++)
-                val_release(args[i]);
-            mila_free(args);
+            call_args_release(args, borrowed, argc);
             HANDLE_RETURN(res);
             return res;
         } else if (src_peek(s) == '[') {
@@ -5375,6 +5144,10 @@ Value *eval_primary(Src *s, Env *env) {
                 // undefined variable -> null
                 return vnull();
             }
+            if (borrowed) {
+                *borrowed = 1;
+                return vv;
+            }
             val_retain(vv);
             return vv;
         }
@@ -5384,6 +5157,8 @@ Value *eval_primary(Src *s, Env *env) {
     return vnull();
 }
 
+Value *eval_primary(Src *s, Env *env) { return eval_primary_ex(s, env, NULL); }
+
 // helper to convert numeric types and do arithmetic
 int is_numeric(Value *v) {
     return v && (v->type == T_INT || v->type == T_FLOAT || v->type == T_UINT);
@@ -5653,7 +5428,7 @@ Value *binary_op(Value *a, MethodType op, Value *b) {
         if (!a || !b)
             return vbool(0);
         if (a->type == T_STRING && b->type == T_STRING)
-            return vbool(strcmp(GET_STRING(a), GET_STRING(b)) == 0);
+            return vbool(mstring_eq(GET_MSTRING(a), GET_MSTRING(b)));
         // fallback pointer equality (document this!!!)
         return vbool(a == b);
     } else if (BMethodNe == op) {
@@ -5664,47 +5439,54 @@ Value *binary_op(Value *a, MethodType op, Value *b) {
     }
     // string concatenation for '+'
     else if (op == BMethodAdd && a->type == T_STRING && b->type == T_STRING) {
-        size_t la = strlen(GET_STRING(a)), lb = strlen(GET_STRING(b));
-        char *buf = mila_malloc(la + lb + 1);
-        memcpy(buf, GET_STRING(a), la);
-        memcpy(buf + la, GET_STRING(b), lb);
-        buf[la + lb] = 0;
-        return vstring_take(buf);
+        size_t la = GET_STRING_LEN(a), lb = GET_STRING_LEN(b);
+        char *buf = mstring_alloc(la + lb);
+        if (!buf)
+            return vnull();
+        memcpy(buf, GET_STRING_BYTES(a), la);
+        memcpy(buf + la, GET_STRING_BYTES(b), lb);
+        return vstring_mstring(buf);
     } else if (op == BMethodAdd && a->type == T_STRING) {
-        size_t la = strlen(GET_STRING(a));
+        size_t la = GET_STRING_LEN(a);
         char *stringyfied = as_c_string(b);
         if (stringyfied) {
-            char *buf = mila_malloc(la + strlen(stringyfied) + 1);
-            if (!buf)
+            size_t lb = strlen(stringyfied);
+            char *buf = mstring_alloc(la + lb);
+            if (!buf) {
+                mila_free(stringyfied);
                 return vnull();
-            strcpy(buf, GET_STRING(a));
-            strcat(buf, stringyfied);
+            }
+            memcpy(buf, GET_STRING_BYTES(a), la);
+            memcpy(buf + la, stringyfied, lb);
             mila_free(stringyfied);
-            return vstring_take(buf);
+            return vstring_mstring(buf);
         }
         return vnull();
     } else if (op == BMethodAdd && b->type == T_STRING) {
-        size_t la = strlen(GET_STRING(b));
+        size_t lb = GET_STRING_LEN(b);
         char *stringyfied = as_c_string(a);
         if (stringyfied) {
-            char *buf = mila_malloc(la + strlen(stringyfied) + 1);
-            if (!buf)
+            size_t la = strlen(stringyfied);
+            char *buf = mstring_alloc(la + lb);
+            if (!buf) {
+                mila_free(stringyfied);
                 return vnull();
-            strcpy(buf, stringyfied);
-            strcat(buf, GET_STRING(b));
+            }
+            memcpy(buf, stringyfied, la);
+            memcpy(buf + la, GET_STRING_BYTES(b), lb);
             mila_free(stringyfied);
-            return vstring_take(buf);
+            return vstring_mstring(buf);
         }
         return vnull();
-    } else if (b->type == T_STRING && a->type == T_STRING &&
-               op == BMethodGlob) {
-        char *string, *pattern;
-        string = GET_STRING(a);
-        pattern = GET_STRING(b);
-        if (match(pattern, string))
-            return vbool(1);
-        else
-            return vbool(0);
+    } else if (a->type == T_STRING && op == BMethodGlob) {
+        // the pattern can be a string or a pattern.compile'd one
+        MGlob *g = glob_from_value(b);
+        if (g) {
+            char *string = GET_STRING(a);
+            int res = glob_match(g, string, strlen(string));
+            glob_release(g);
+            return vbool(res);
+        }
     }
     if (a->type_name && strcmp(a->type_name, MILA_LPREFIX "dict") == 0) {
         return binary_op_objects(NULL, 1, a, op, b);
@@ -5877,9 +5659,53 @@ MethodType parse_op(Src *s) {
     return MethodNone;
 }
 
-Value *eval_expr_prec(Src *s, Env *env, int min_prec) {
+// Checks whether the operand ahead is a literal or a plain variable read that
+// ends before any operator binding tighter than min_prec. Evaluating such an
+// operand cannot run code, so a borrowed lhs stays valid across it.
+static int is_inert_operand(Src *s, int min_prec) {
+    size_t saved_pos = s->pos;
+    int inert = 0;
+    skip_ws(s);
+    char c = src_peek(s);
+    if (isdigit((unsigned char)c)) {
+        while (isalnum((unsigned char)src_peek(s)) || src_peek(s) == '.')
+            s->pos++;
+    } else if (c == '"') {
+        s->pos++;
+        while (!src_eof(s) && src_peek(s) != '"') {
+            if (src_peek(s) == '\\')
+                s->pos++;
+            s->pos++;
+        }
+        s->pos++;
+    } else if (c != '\'' && is_ident_start(c)) {
+        while (isalnum((unsigned char)src_peek(s)) || src_peek(s) == '_' ||
+               src_peek(s) == '.' || src_peek(s) == '?')
+            s->pos++;
+    } else {
+        goto done;
+    }
+    skip_ws(s);
+    if (src_peek(s) == '(' || src_peek(s) == '[')
+        goto done;
+    MethodType op = parse_op(s);
+    inert = op == MethodNone ||
+            (op != BMethodCallMethod && op != BMethodCallNamespaceFunction &&
+             precedence_of(op) < min_prec);
+done:
+    s->pos = saved_pos;
+    return inert;
+}
+
+// Precedence climbing over borrowed operands: plain variable reads are not
+// retained for the duration of a binary op, only when they escape as the
+// result or flow into a call. See eval_primary_ex for the borrow contract.
+Value *eval_expr_prec_ex(Src *s, Env *env, int min_prec, char *borrowed) {
+    char lhs_borrowed = 0;
+    if (borrowed)
+        *borrowed = 0;
     skip_ws(s);
-    Value *lhs = eval_primary(s, env);
+    Value *lhs = eval_primary_ex(s, env, &lhs_borrowed);
     if (!lhs)
         return vnull();
     if (IS_ERROR(lhs)) return lhs;
@@ -5887,7 +5713,12 @@ Value *eval_expr_prec(Src *s, Env *env, int min_prec) {
         int saved_pos = s->pos;
         MethodType op = parse_op(s);
         if (op == MethodNone)
-            return lhs;
+            break;
+        if ((op == BMethodCallMethod || op == BMethodCallNamespaceFunction) &&
+            lhs_borrowed) {
+            val_retain(lhs);
+            lhs_borrowed = 0;
+        }
         if (op == BMethodCallMethod) {
 method_start:;
             size_t start = s->pos;
@@ -6079,17 +5910,49 @@ namespace_fn_start:;
         }
         // handle right associativity? none needed
         int next_min = prec + 1;
-        Value *rhs = eval_expr_prec(s, env, next_min);
+        if (lhs_borrowed && !is_inert_operand(s, next_min)) {
+            val_retain(lhs);
+            lhs_borrowed = 0;
+        }
+        char rhs_borrowed = 0;
+        Value *rhs = eval_expr_prec_ex(s, env, next_min, &rhs_borrowed);
         Value *newlhs = binary_op(lhs, op, rhs);
-        val_release(lhs);
-        val_release(rhs);
+        if (!lhs_borrowed)
+            val_release(lhs);
+        if (!rhs_borrowed)
+            val_release(rhs);
         lhs = newlhs;
+        lhs_borrowed = 0;
     }
+    if (borrowed)
+        *borrowed = lhs_borrowed;
+    else if (lhs_borrowed)
+        val_retain(lhs);
     return lhs;
 }
 
+Value *eval_expr_prec(Src *s, Env *env, int min_prec) {
+    return eval_expr_prec_ex(s, env, min_prec, NULL);
+}
+
 Value *eval_expr(Src *s, Env *env) { return eval_expr_prec(s, env, 1); }
 
+// The truth of the expression ahead, for conditions. A plain variable read
+// is borrowed, is_truthy retains it itself before running an overload.
+// When err is given an error value is handed back through it instead
+int eval_truth(Src *s, Env *env, Value **err) {
+    char borrowed = 0;
+    Value *cond = eval_expr_prec_ex(s, env, 1, &borrowed);
+    if (err && IS_ERROR(cond)) {
+        *err = borrowed ? val_retain(cond) : cond;
+        return 0;
+    }
+    int truth = is_truthy(cond);
+    if (!borrowed)
+        val_release(cond);
+    return truth;
+}
+
 void clean_elif_chain(Src *s) {
     while (is_keyword_at(s, "elif")) {
         s->pos += strlen("elif");
@@ -6115,7 +5978,7 @@ void clean_elif_chain(Src *s) {
 }
 
 Value *eval_statement(Src *s, Env *env) {
-    if (is_keyword_at(s, "set")) {
+    if (is_set_statement(s)) {
         s->pos += strlen("set");
         char *id = parse_ident(s);
         if (!id)
@@ -6240,8 +6103,13 @@ Value *eval_statement(Src *s, Env *env) {
                                 parent, val_retain(last_index));
                         val_release(obj);
                         Value *result = binary_op(inplace, mt, v);
-                        ((trinary_method)parent->method_table[TMethodSetItem])(
+                        Value *err = ((trinary_method)
+                                          parent->method_table[TMethodSetItem])(
                             parent, last_index, result);
+                        if (err) {
+                            val_release(result);
+                            result = err;
+                        }
                         for (int i = 0; i < num_indices; i++)
                             val_release(indices[i]);
                         val_release(last_index);
@@ -6335,7 +6203,7 @@ Value *eval_statement(Src *s, Env *env) {
                 // val_release(parent);
                 val_release(v);
                 mila_free(id);
-                return val_retain(res);
+                return res;
             } else {
                 Value *ret = verror("Type %s does not support item assignment!",
                                     GET_TYPENAME(parent));
@@ -6572,6 +6440,23 @@ Value *eval_statement(Src *s, Env *env) {
             mila_free(id);
             return res;
         }
+        if (vstring_is_byte(a)) {
+            // a shared one byte string from indexing, the variable gets a
+            // box of its own to change
+            Value *box = vstring_len(GET_STRING_BYTES(a), 1);
+            if (env_set_raw(env, id, box)) {
+                val_release(box);
+            } else {
+                a = box;
+            }
+        }
+        if (IS_FROZEN(a)) {
+            Value *res = vtagged_error(
+                E_CONST_ERROR, "Variable `%s` cannot be synced as it's frozen!",
+                id);
+            mila_free(id);
+            return res;
+        }
         Value *val = NULL;
         if (match_char(s, '=')) {
             val = eval_expr(s, env);
@@ -6591,7 +6476,8 @@ Value *eval_statement(Src *s, Env *env) {
             a->v = (void *)GET_OPAQUE(val);
             break;
         case T_STRING:
-            a->v = (void *)GET_STRING(val);
+            ML_REF_INC(GET_MSTRING(val));
+            a->v = val->v;
             break;
         case T_FUNCTION:
             a->v = (void *)val->v;
@@ -6603,7 +6489,12 @@ Value *eval_statement(Src *s, Env *env) {
             return vtagged_error(E_FATAL, "Type %s cannot be synced!",
                                  GET_TYPENAME(val));
         }
-        mila_free(val);
+        // a string's bytes are refcounted on their own, its box is released
+        // like any value. Other payloads moved into a, only the box goes
+        if (GET_TYPE(val) == T_STRING)
+            val_release(val);
+        else if (val->refcount < ML_IMMORTAL_REFS)
+            mila_free(val);
         mila_free(id);
         return vnull();
     }
@@ -6653,10 +6544,8 @@ Value *eval_statement(Src *s, Env *env) {
     if (is_keyword_at(s, "if")) {
         s->pos += strlen("if");
         if (match_char(s, '(')) {
-            Value *cond = eval_expr(s, env);
+            int truth = eval_truth(s, env, NULL);
             match_char(s, ')');
-            int truth = is_truthy(cond);
-            val_release(cond);
             if (truth) {
                 Value *res = NULL;
                 if (match_char(s, '{')) {
@@ -6678,9 +6567,9 @@ Value *eval_statement(Src *s, Env *env) {
                 while (is_keyword_at(s, "elif")) {
                     s->pos += strlen("elif");
                     if (match_char(s, '(')) {
-                        Value *cond = eval_expr(s, env);
+                        int truth = eval_truth(s, env, NULL);
                         match_char(s, ')');
-                        if (is_truthy(cond)) {
+                        if (truth) {
                             Value *res = NULL;
                             if (match_char(s, '{')) {
                                 s->pos--;
@@ -6689,11 +6578,9 @@ Value *eval_statement(Src *s, Env *env) {
                                 res = eval_statement(s, env);
 
                             clean_elif_chain(s);
-                            val_release(cond);
                             HANDLE_CONTROL(res);
                         } else {
                             // skip elif then clause
-                            val_release(cond);
                             if (match_char(s, '{')) {
                                 s->pos--;
                                 skip_block(s);
@@ -6741,12 +6628,12 @@ Value *eval_statement(Src *s, Env *env) {
                 s->pos = cond_start_pos;
 
                 // Re-evaluate condition
-                Value *cond = eval_expr(s, env);
-                if (IS_ERROR(cond)) {
+                Value *err = NULL;
+                int truth = eval_truth(s, env, &err);
+                if (err) {
                     val_release(bod);
-                    return cond;
-                } else if (!is_truthy(cond)) {
-                    val_release(cond);
+                    return err;
+                } else if (!truth) {
                     if (GET_TYPE(bod) == T_RETURN) {
                         return bod;
                     }
@@ -6754,7 +6641,6 @@ Value *eval_statement(Src *s, Env *env) {
                     s->pos = body_end_pos;
                     return vnull();
                 }
-                val_release(cond);
                 // reset the position to the start of the body for execution
                 s->pos = body_start_pos;
                 val_release(bod);
@@ -6852,13 +6738,13 @@ Value *eval_statement(Src *s, Env *env) {
                 Value *v =
                     ((unary_method)iter_obj->method_table[UMethodStepIter])(
                         iter_state);
-                if (!v) {
+                if (!v || IS_ERROR(v)) {
                     s->pos = body_end_pos;
                     mila_free(id);
                     ((unary_method)iter_obj
                          ->method_table[UMethodStepIterClean])(iter_state);
                     val_release(iter_obj);
-                    return vnull();
+                    return v ? v : vnull();
                 }
                 // reset the position to the start of the body for execution
                 s->pos = body_start_pos;
@@ -6892,14 +6778,14 @@ Value *eval_statement(Src *s, Env *env) {
                                 ((unary_method)
                                      iter_obj->method_table[UMethodStepIter])(
                                     iter_state);
-                            if (!v) {
+                            if (!v || IS_ERROR(v)) {
                                 s->pos = body_end_pos;
                                 mila_free(id);
                                 ((unary_method)iter_obj
                                      ->method_table[UMethodStepIterClean])(
                                     iter_state);
                                 val_release(iter_obj);
-                                return vnull();
+                                return v ? v : vnull();
                             }
                             val_release(v);
                         }
@@ -6962,11 +6848,13 @@ Value *eval_statement(Src *s, Env *env) {
             Value *bod = NULL;
 
             // we execute the loop until the condition is false or a
-            // control-flow statement is hit
+            // control-flow statement is hit. value[0] is the index one past
+            // the last item, each item is released once the loop is done
+            // with it
             unsigned long max = GET_UINTEGER(value[0]);
-            size_t i = 1;
-            Value *v = value[i];
-            for (; i < max; v = value[++i]) {
+            val_release(value[0]);
+            for (size_t i = 1; i < max; ++i) {
+                Value *v = value[i];
                 // reset the position to the start of the body for execution
                 s->pos = body_start_pos;
                 Env *frame = env_new(env);
@@ -6981,7 +6869,7 @@ Value *eval_statement(Src *s, Env *env) {
                 switch (GET_TYPE(bod)) {
                 case T_BREAK: {
                     s->pos = body_end_pos;
-                    for (; value[i]; ++i)
+                    while (++i < max)
                         val_release(value[i]);
                     unsigned long level = bod->v ? GET_UINTEGER(bod) : 1;
                     val_release(bod);
@@ -6992,29 +6880,23 @@ Value *eval_statement(Src *s, Env *env) {
                 case T_CONTINUE: {
                     s->pos = body_start_pos;
                     if (bod) {
+                        // continue n skips the next n - 1 items
                         if (bod->v)
-                            i += GET_UINTEGER(bod) - 1;
+                            for (unsigned long k = 1;
+                                 k < GET_UINTEGER(bod) && i + 1 < max; k++)
+                                val_release(value[++i]);
                         val_release(bod);
                     }
                     continue;
                 }
-                case T_RETURN: {
-                    s->pos = body_end_pos;
-                    for (; value[i]; ++i)
-                        val_release(value[i]);
-                    mila_free(value);
-                    mila_free(id);
-                    val_release(value[0]);
-                    return bod;
-                }
+                case T_RETURN:
                 case T_TAGGED_ERROR:
                 case T_ERROR: {
                     s->pos = body_end_pos;
-                    for (; value[i]; ++i)
+                    while (++i < max)
                         val_release(value[i]);
                     mila_free(value);
                     mila_free(id);
-                    val_release(value[0]);
                     return bod;
                 }
                 default:;
@@ -7024,7 +6906,6 @@ Value *eval_statement(Src *s, Env *env) {
             s->pos = body_end_pos;
             mila_free(id);
             mila_free(value);
-            val_release(value[0]);
         } else {
             mila_free(id);
             Value *err = verror("Type %s does not implement UMethodToIter",
@@ -7237,38 +7118,13 @@ Value *eval_statement(Src *s, Env *env) {
             } else if (IS_ERROR(obj))
                 return obj;
 
-            KVPair *entries = NULL;
-            size_t count = 0, capacity = 16;
-            entries = (KVPair *)mila_malloc(capacity * sizeof(KVPair));
-            if (!entries)
-                return NULL;
-
-            // Collect all entries
-            for (size_t i = 0; i < ((Dict *)with_obj->v)->capacity; i++) {
-                DictEntry *entry = ((Dict *)with_obj->v)->buckets[i];
-                while (entry) {
-                    if (count >= capacity) {
-                        capacity *= 2;
-                        KVPair *tmp = (KVPair *)realloc(
-                            entries, capacity * sizeof(KVPair));
-                        if (!tmp) {
-                            mila_free(entries);
-                            return NULL;
-                        }
-                        entries = tmp;
-                    }
-                    entries[count].key = entry->key;
-                    entries[count].value = entry->value;
-                    count++;
-                    entry = entry->next;
-                }
-            }
-
-            for (size_t i = count; i > 0; i--) {
-                dict_set_raw((Dict *)obj->v, entries[i - 1].key,
-                             entries[i - 1].value);
+            // the entries are taken over as is, they must not be shared
+            // with a copy of the base
+            val_unshare(with_obj);
+            ITERATE_DICT((Dict *)with_obj->v) {
+                dict_set_entry((Dict *)obj->v, (Dict *)with_obj->v, entry,
+                               entry->value);
             }
-            mila_free(entries);
             mila_free(obj_name);
         }
         if (IS_ERROR(obj)) {
@@ -7412,6 +7268,7 @@ Value *eval_source(Src *s, Env *env) {
     while (!src_eof(s)) {
         if (src_eof(s))
             break;
+        ML_GC_SAFEPOINT();
         Value *st = eval_statement(s, env);
         if (GET_TYPE(st) == T_NULL) {
             val_release(st);
@@ -7824,6 +7681,7 @@ Env *mila_global_init(void) {
         fprintf(stderr, "mila_global_init called more than once.\n");
         abort();
     }
+    vstring_bytes_init();
     Env *g = env_new(NULL);
     env_register_builtins(g);
 #ifndef ML_NO_THREADING
@@ -7899,8 +7757,15 @@ void mila_global_deinit(Env *g) {
     env_free(g);
 #ifndef ML_NO_THREADING
     mila_threads_cleanup();
+#endif
+#ifndef ML_NO_GC
+    // tear down cycles that outlived the global scope
+    gc_collect();
+    gc_deinit();
 #endif
     env_free_builtins();
+    glob_cache_clear();
+    vstring_bytes_free();
     path_list_free(mila_search_path);
 }
 
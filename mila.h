@@ -45,6 +45,7 @@
 #include <ctype.h>
 #include <limits.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -103,7 +104,12 @@
 #define IS_FATAL(v)                                                            \
     ((GET_ERROR_TYPE(v) == E_FATAL || GET_ERROR_TYPE(v) == E_SYNTAX_ERROR ||   \
       GET_ERROR_TYPE(v) == E_THREAD_HALT))
-#define GET_STRING(val) (val ? (char *)val->v : NULL)
+// NUL terminated, a view is copied out the first time this is asked for
+#define GET_STRING(val) (val ? mstring_cstr((char *)val->v) : NULL)
+// The bytes of a string without making a view NUL terminated
+#define GET_STRING_BYTES(val) MSTRING_BYTES(GET_MSTRING(val))
+#define GET_STRING_LEN(val) (val ? GET_MSTRING(val)->len : 0)
+#define GET_MSTRING(val) MSTRING((char *)(val)->v)
 #define GET_INTEGER(val) (val ? val->v->i : 0)
 #define GET_INTEGER_REF(val) (val ? &(val->v->i) : NULL)
 #define GET_UINTEGER(val) (val ? val->v->ui : 0)
@@ -154,6 +160,8 @@ typedef enum __attribute__((packed)) {
     UMethodCopy, // Deep copy by default
     UMethodCopyShallow,
 
+    UMethodVisit, // calls a visitor on every value the instance holds
+
     MethodTotalCount
 } MethodType; // Also used by VIOO (actually exposed)
 
@@ -381,6 +389,16 @@ Value *val_retain(Value *v);
 void val_release(Value *v);
 // Free a value regardless of refcount
 void val_kill(Value *v);
+// Make a value (and everything it holds) immutable and immortal
+void val_freeze(Value *v);
+
+#ifndef ML_NO_GC
+#include "ml_gc.h"
+#else
+#define gc_track(v) ((void)0)
+#define gc_untrack(v) ((void)0)
+#define ML_GC_SAFEPOINT() ((void)0)
+#endif
 // Integer contructor
 Value *vint(long i);
 // Uint constructor
@@ -393,12 +411,26 @@ Value *vbool(int b);
 Value *vstring_dup(const char *s);
 // Take a string (assuming MiLa can free it)
 Value *vstring_take(char *s);
+// Copy len bytes, which may include NULs
+Value *vstring_len(const char *s, size_t len);
+// Take a buffer from mstring_alloc
+Value *vstring_mstring(char *s);
+// len bytes of a string from start, sharing its buffer when that's worth it
+Value *vstring_view(Value *str, size_t start, size_t len);
 // Generates a string from an fmt
 __attribute__((format(printf, 1, 2))) Value *vstring_fmt(char *fmt, ...);
 // Slice a string
 Value *vstring_slice(const char *src, size_t start, size_t len);
 // Index a string
 Value *vstring_index(const char *src, size_t index);
+// The one byte string holding c, shared and immortal once
+// mila_global_init has run, so handing it out doesn't allocate. Only
+// indexing and iterating a string give these out, anything that changes a
+// string in place has to swap a fresh one in first
+Value *vstring_byte(char c);
+int vstring_is_byte(Value *v);
+void vstring_bytes_init(void);
+void vstring_bytes_free(void);
 // Replace some path of a string (used string.patch)
 Value *vstring_replace(const char *src, const char *needle, const char *repl);
 // Opaque pointer constructor
@@ -613,6 +645,8 @@ extern char *OVERLOAD_TO_BOOL;
 typedef Value *(*trinary_method)(Value *self, Value *b, Value *c);
 typedef Value *(*binary_method)(Value *self, Value *other);
 typedef Value *(*unary_method)(Value *self);
+typedef void (*value_visitor)(Value **slot, void *ctx);
+typedef void (*visit_method)(Value *self, value_visitor fn, void *ctx);
 
 typedef struct {
     int argc;
@@ -657,14 +691,18 @@ typedef struct {
     size_t size, count;
 } Wrefs;
 
+// Refcounts are 32 bits wide, the field is padded up to the next pointer
+// anyway. ML_USE_REF_USHORT brings back the old 2 byte counter.
+#ifdef ML_USE_REF_USHORT
+typedef unsigned short MRefCount;
+#else
+typedef unsigned int MRefCount;
+#endif
+
 // Primitives are boxed, minimum size 48 bytes.
 // worst case is 100+ Bytes (especially if VIOO)
 struct Value {
-#ifndef ML_USE_REF_UINT
-    unsigned short refcount; // simple refcount (2 bytes)
-#else
-    unsigned int refcount;
-#endif
+    MRefCount refcount;        // simple refcount (4 bytes)
     Wrefs *wrefs;              // for weak references
     char owns_table;           // check if table can be freed or not (1 byte)
     ValueType type;            // 4 bytes
@@ -673,14 +711,64 @@ struct Value {
     ValueValue *v;             // around 8 bytes
 };
 
-#ifndef ML_USE_REF_UINT
-#define ML_WEAK_REF_TRIGGER (unsigned short)-1
-#define ML_MAX_REFS (unsigned short)-2
+#define ML_WEAK_REF_TRIGGER (MRefCount)-1
+#define ML_IMMORTAL_REFS (MRefCount)-2 // set by freeze()
+#define ML_MAX_REFS (MRefCount)-3
+
+#define IS_FROZEN(v) ((v)->refcount == ML_IMMORTAL_REFS)
+
+// Refcount updates stay plain increments while only the main thread runs.
+// The first thread.make() flips mila_refs_shared and from then on every
+// retain/release is an atomic read-modify-write.
+#ifndef ML_NO_THREADING
+extern volatile char mila_refs_shared;
+#define ML_REF_INC(v)                                                          \
+    (mila_refs_shared ? __atomic_add_fetch(&(v)->refcount, 1, __ATOMIC_RELAXED) \
+                      : ++(v)->refcount)
+#define ML_REF_DEC(v)                                                          \
+    (mila_refs_shared ? __atomic_sub_fetch(&(v)->refcount, 1, __ATOMIC_ACQ_REL) \
+                      : --(v)->refcount)
 #else
-#define ML_WEAK_REF_TRIGGER (unsigned int)-1
-#define ML_MAX_REFS (unsigned int)-2
+#define ML_REF_INC(v) (++(v)->refcount)
+#define ML_REF_DEC(v) (--(v)->refcount)
 #endif
 
+/*
+    A string value points at its NUL terminated bytes, with the length and
+    the last hash sitting right in front of them. So GET_STRING is still a
+    plain char * and strings may hold NULs, GET_STRING_LEN has the length.
+
+    A view is a string whose bytes are a stretch of another one (its base),
+    kept alive by the view's reference. It gets a NUL terminated copy of
+    its own only when GET_STRING asks for one. Bytes are never changed in
+    place once they belong to a value.
+*/
+typedef struct MString MString;
+
+typedef struct {
+    MString *base;     // never a view itself
+    const char *bytes; // where in base the view starts
+    char *cstr;        // a NUL terminated copy, once GET_STRING wanted it
+} MStringView;
+
+struct MString {
+    size_t len;
+    unsigned long hash;      // hash of the bytes under hash_seed
+    unsigned long hash_seed; // 0 until it was hashed
+    MStringView *view;       // NULL when the bytes follow the header
+    size_t refcount;         // its value and every view into it
+    char data[];
+};
+
+#define MSTRING(s) ((MString *)((char *)(s) - offsetof(MString, data)))
+#define MSTRING_BYTES(m) ((m)->view ? (m)->view->bytes : (m)->data)
+
+char *mstring_view_cstr(MString *m);
+
+static inline char *mstring_cstr(char *s) {
+    return s && MSTRING(s)->view ? mstring_view_cstr(MSTRING(s)) : s;
+}
+
 #define MAKE_WEAK(res) res->refcount = ML_WEAK_REF_TRIGGER;
 
 // == Parsing
@@ -713,18 +801,22 @@ char *parse_ident(Src *s);
 Value *parse_number(Src *s);
 Value *parse_string(Src *s);
 int is_keyword_at(Src *s, const char *kw);
+int is_set_statement(Src *s);
 char *dup_substr(Src *s, int a, int b);
 FunctionParameters *parse_param_list(Src *s);
 char **parse_context_list(Src *s);
 Value *eval_block(Src *s, Env *env);
 extern Value *eval_primary(Src *s, Env *env);
+Value *eval_primary_ex(Src *s, Env *env, char *borrowed);
 Value *binary_op(Value *a, MethodType op, Value *b);
 Value *binary_op_objects(Env *env, char right, Value *a, MethodType op,
                          Value *b);
 int precedence_of(MethodType op);
 MethodType parse_op(Src *s);
 Value *eval_expr_prec(Src *s, Env *env, int min_prec);
+Value *eval_expr_prec_ex(Src *s, Env *env, int min_prec, char *borrowed);
 Value *eval_expr(Src *s, Env *env);
+int eval_truth(Src *s, Env *env, Value **err);
 Value *eval_statement_fn(Src *s, Env *env);
 Value *eval_statement(Src *s, Env *env);
 double to_double(Value *v);
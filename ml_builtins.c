@@ -62,6 +62,18 @@
 
 #include "ml_platform_specific.c"
 #include "ml_primitives.c"
+#include "ml_set.c"
+#include "ml_heap.c"
+#include "ml_ordmap.c"
+#include "ml_typedarray.c"
+#include "ml_vec.c"
+#include "ml_strscan.c"
+#include "ml_strbuf.c"
+#include "ml_glob.c"
+
+#ifndef ML_NO_GC
+#include "ml_gc.c"
+#endif
 
 #ifndef ML_NO_THREADING
 #include "ml_threading.h"
@@ -196,18 +208,14 @@ Value *native_qsort(Env *env, int argc, Value **argv) {
         GET_TYPE(argv[1]) != T_FUNCTION) {
         return verror("qsort(items, func): Invalid arguments.");
     }
-    Value **list = ll_to_iter((LinkedList *)GET_OPAQUE(argv[0]));
+    list_unshare(argv[0]);
+    // sort the result list in place, it holds the items while the
+    // comparator runs
+    Value *res = ll_slice_ll((LinkedList *)GET_OPAQUE(argv[0]), 0, -1);
+    LinkedList *list = (LinkedList *)GET_OPAQUE(res);
     _mila_qsort_fn = argv[1];
-    qsort(list + 1, GET_UINTEGER(list[0]) - 1, sizeof(Value *),
+    qsort(list->items, list->size, sizeof(Value *),
           (void *)item_qsort_compare);
-    Value *res = make_list(NULL);
-    for (unsigned long i = 1; i < GET_UINTEGER(list[0]); i++) {
-        val_release(call_native_with(NULL, native_list_append, val_retain(res),
-                                     val_retain(list[i]), NULL));
-        val_release(list[i]);
-    }
-    val_release(list[0]);
-    free(list);
     return res;
 }
 
@@ -219,14 +227,14 @@ Value *native_map(Env* env, int argc, Value** argv) {
     if (GET_TYPE(argv[1]) != T_FUNCTION && GET_TYPE(argv[1]) != T_NATIVE)
         return verror("map(lst, fun): Expected second argument to be a function");
     Value* list = make_list(NULL);
-    Value** source = ll_to_iter((LinkedList*)GET_OPAQUE(argv[0]));
-    // 1 because source[0] is the iter length.
-    for (unsigned long i=1; i<GET_UINTEGER(source[0]); ++i) {
-        Value* enumerated_val = call_function_with(env, argv[1], source[i], NULL);
-        val_release(call_native_with(NULL, native_list_append, val_retain(list), enumerated_val, NULL));
-    }
-    val_release(source[0]);
-    mila_free(source);
+    list_unshare(argv[0]);
+    LinkedList* mapped = (LinkedList*)GET_OPAQUE(list);
+    ll_reserve(mapped, ((LinkedList*)GET_OPAQUE(argv[0]))->size);
+    // fun may change the list, so look it up again on every step
+    for (size_t i=0; i<((LinkedList*)GET_OPAQUE(argv[0]))->size; ++i) {
+        Value* item = ((LinkedList*)GET_OPAQUE(argv[0]))->items[i];
+        ll_append(mapped, call_function_with(env, argv[1], val_retain(item), NULL));
+    }
     return list;
 }
 
@@ -604,8 +612,8 @@ Value *native_fprint(Env *env, int argc, Value **argv) {
     if (!f) {
         return verror("fprint: file handle is closed or invalid.");
     }
-    const char *s = GET_STRING(argv[1]);
-    size_t written = fwrite(s, 1, strlen(s), f);
+    size_t written =
+        fwrite(GET_STRING_BYTES(argv[1]), 1, GET_STRING_LEN(argv[1]), f);
     return vint(written);
 }
 
@@ -645,14 +653,15 @@ Value *native_fread(Env *env, int argc, Value **argv) {
     if (n <= 0)
         return vstring_dup("");
 
-    char *buf = mila_malloc(n + 1);
+    char *buf = mstring_alloc(n);
     if (!buf)
         return vnull();
 
-    size_t read_bytes = fread(buf, 1, n, f);
-    buf[read_bytes] = '\0';
+    // whatever was read, NULs included
+    MSTRING(buf)->len = fread(buf, 1, n, f);
+    buf[MSTRING(buf)->len] = '\0';
 
-    return vstring_take(buf);
+    return vstring_mstring(buf);
 }
 
 Value *native_fread_bytes(Env *env, int argc, Value **argv) {
@@ -698,14 +707,14 @@ Value *native_fread_all(Env *env, int argc, Value **argv) {
     long n = ftell(f);
     fseek(f, 0, SEEK_SET);
 
-    char *buf = mila_malloc(n + 1);
+    char *buf = mstring_alloc(n);
     if (!buf)
         return vnull();
 
-    size_t read_bytes = fread(buf, 1, n, f);
-    buf[read_bytes] = '\0';
+    MSTRING(buf)->len = fread(buf, 1, n, f);
+    buf[MSTRING(buf)->len] = '\0';
 
-    return vstring_take(buf);
+    return vstring_mstring(buf);
 }
 
 Value *native_fread_all_bytes(Env *env, int argc, Value **argv) {
@@ -947,7 +956,6 @@ Value *native_require(Env *env, int argc, Value **argv) {
         if (GET_TYPE(res) == T_ERROR) {
             return res;
         }
-        mila_free(path);
         env_free(frame);
 #ifndef ML_NO_THREADING
         pthread_mutex_lock(&mila_cached_modules_lock);
@@ -958,6 +966,7 @@ Value *native_require(Env *env, int argc, Value **argv) {
 #ifndef ML_NO_THREADING
         pthread_mutex_unlock(&mila_cached_modules_lock);
 #endif
+        mila_free(path);
 
         return res;
     }
@@ -1043,10 +1052,15 @@ Value *native_load(Env *env, int argc, Value **argv) {
 #endif // ML_NO_DL
 
 #ifndef ML_NO_LIBM
+// A typed array or list goes through vec_map in one call
+#define VEC_MAPPABLE(val) (IS_TARRAY(val) || (val)->method_table == list_meta)
+
 Value *native_floor(Env *env, int argc, Value **argv) {
     (void)env;
     if (argc != 1)
         return verror("floor(i): Requires one arguments");
+    if (VEC_MAPPABLE(argv[0]))
+        return vec_map(VEC_FLOOR, "floor(x)", argv[0]);
     double x = GET_FLOAT(argv[0]);
     return vfloat(floor(x));
 }
@@ -1055,6 +1069,8 @@ Value *native_ceil(Env *env, int argc, Value **argv) {
     (void)env;
     if (argc != 1)
         return verror("ceil(i): Requires one arguments");
+    if (VEC_MAPPABLE(argv[0]))
+        return vec_map(VEC_CEIL, "ceil(x)", argv[0]);
     double x = GET_FLOAT(argv[0]);
     return vfloat(ceil(x));
 }
@@ -1071,6 +1087,8 @@ Value *native_sqrt(Env *env, int argc, Value **argv) {
     (void)env;
     if (argc != 1)
         return verror("sqrt(i): Requires one arguments");
+    if (VEC_MAPPABLE(argv[0]))
+        return vec_map(VEC_SQRT, "sqrt(x)", argv[0]);
     double x = GET_FLOAT(argv[0]);
     return vfloat(sqrt(x));
 }
@@ -1079,6 +1097,8 @@ Value *native_sin(Env *env, int argc, Value **argv) {
     (void)env;
     if (argc != 1)
         return verror("sin(i): Requires one arguments");
+    if (VEC_MAPPABLE(argv[0]))
+        return vec_map(VEC_SIN, "sin(x)", argv[0]);
     double x = GET_FLOAT(argv[0]);
     return vfloat(sin(x));
 }
@@ -1087,6 +1107,8 @@ Value *native_cos(Env *env, int argc, Value **argv) {
     (void)env;
     if (argc != 1)
         return verror("cos(i): Requires one arguments");
+    if (VEC_MAPPABLE(argv[0]))
+        return vec_map(VEC_COS, "cos(x)", argv[0]);
     double x = GET_FLOAT(argv[0]);
     return vfloat(cos(x));
 }
@@ -1112,10 +1134,14 @@ Value *native_pow(Env *env, int argc, Value **argv) {
     (void)env;
     if (argc != 2)
         return verror("pow(base, exp): Requires two arguments");
+    if (VEC_MAPPABLE(argv[0]) || VEC_MAPPABLE(argv[1]))
+        return vec_pow(argv[0], argv[1]);
     return vint(pow(GET_INTEGER(argv[0]), GET_INTEGER(argv[1])));
 }
 
 Value *native_fabs(Env *e, int argc, Value **argv) {
+    if (argc == 1 && VEC_MAPPABLE(argv[0]))
+        return vec_map(VEC_FABS, "fabs(x)", argv[0]);
     if (argc != 1 || GET_TYPE(argv[0]) != T_FLOAT)
         return verror("fabs(num): argument must be a float!");
     return vfloat(fabs(GET_FLOAT(argv[0])));
@@ -1155,6 +1181,14 @@ Value *env_free_builtins() {
     mila_free(list_meta);
     mila_free(file_meta);
     mila_free(range_meta);
+    mila_free(set_meta);
+    mila_free(heap_meta);
+    mila_free(ordmap_meta);
+    mila_free(ordmap_view_meta);
+    mila_free(tarray_meta);
+    mila_free(strbuf_meta);
+    mila_free(str_split_meta);
+    mila_free(glob_meta);
 
     return NULL;
 }
@@ -1192,22 +1226,28 @@ Value *native_istring(Env *e, int argc, Value **argv) {
     return verror("istring(v): Needs at least one argument!");
 }
 
+// The characters are the shared one byte strings, only the list of them
+// is allocated
 Value *istring_to_iter(Value *self) {
     char *str = (char *)self->v;
     size_t slen = strlen(str);
     Value **iter = (Value **)mila_malloc(sizeof(Value *) * (slen + 2));
-    size_t i = 1;
-    for (; i < slen + 1; ++i) {
-        iter[i] = vstring_dup((char[]){str[i - 1], 0});
-    }
-    iter[slen] = NULL;
-    iter[0] = vuint((unsigned long)slen);
+    for (size_t i = 1; i < slen + 1; ++i)
+        iter[i] = vstring_byte(str[i - 1]);
+    iter[slen + 1] = NULL;
+    // index one past the last item
+    iter[0] = vuint((unsigned long)slen + 1);
     return vopaque(iter);
 }
 
+// Items are borrowed like a list's, the one byte strings are immortal so
+// that's fine. Out of bounds is NULL like a typed array's
 Value *istring_get(Value *self, Value *index) {
-    char *str = (char *)self->v;
-    return vstring_dup((char[]){str[GET_INTEGER(index)], 0});
+    const char *str = (const char *)self->v;
+    if ((GET_TYPE(index) != T_INT && GET_TYPE(index) != T_UINT) ||
+        GET_INTEGER(index) < 0 || (size_t)GET_INTEGER(index) >= strlen(str))
+        return NULL;
+    return vstring_byte(str[GET_INTEGER(index)]);
 }
 
 Value *istring_to_str(Value *self) { return vstring_dup(GET_STRING(self)); }
@@ -1378,6 +1418,23 @@ Value *native_copy(Env *env, int argc, Value **argv) {
     return val_copy(argv[0]);
 }
 
+Value *native_freeze(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 1) {
+        return verror("freeze(value): requires 1 arg");
+    }
+    val_freeze(argv[0]);
+    return val_retain(argv[0]);
+}
+
+Value *native_is_frozen(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 1) {
+        return verror("is_frozen(value): requires 1 arg");
+    }
+    return vbool(IS_FROZEN(argv[0]));
+}
+
 Value *native_json_loads(Env *env, int argc, Value **argv) {
     if (argc != 1)
         return verror("json.loads(str): Expects one argument.");
@@ -1390,7 +1447,11 @@ Value *native_json_loads(Env *env, int argc, Value **argv) {
 Value *native_json_dumps(Env *env, int argc, Value **argv) {
     if (argc != 1)
         return verror("json.dumps(value): Expects one argument.");
-    return vstring_take(mila_to_json(argv[0]));
+    // built straight into the string value, no copy of the text at the end
+    strbuf out;
+    sb_init(&out);
+    _mila_to_json_unified(&out, argv[0], 1, 0);
+    return vstring_mstring(sb_mstring(&out));
 }
 
 Value *native_json_dumps_io(Env *env, int argc, Value **argv) {
@@ -1411,7 +1472,10 @@ Value *native_mjson_loads(Env *env, int argc, Value **argv) {
 Value *native_mjson_dumps(Env *env, int argc, Value **argv) {
     if (argc != 1)
         return verror("mjson.dumps(value): Expects one argument.");
-    return vstring_take(mila_to_mjson(argv[0]));
+    strbuf out;
+    sb_init(&out);
+    _mila_to_json_unified(&out, argv[0], 1, 1);
+    return vstring_mstring(sb_mstring(&out));
 }
 
 Value *native_mjson_dumps_io(Env *env, int argc, Value **argv) {
@@ -1438,7 +1502,7 @@ Value *native_hash_set_seed(Env *env, int argc, Value **argv) {
 Value *native_hash_get_seed(Env *env, int argc, Value **argv) {
     if (argc != 0)
         return verror("hash._get_seed(): Expects no arguments.");
-    return vuint(HASH_SEED);
+    return vuint(hash_get_seed());
 }
 
 Value *native_sys_get_pid(Env *env, int argc, Value **argv) {
@@ -1456,6 +1520,7 @@ Value *native_list_deconstruct(Env *env, int argc, Value **argv) {
         return verror("Must be list");
 
     char *pattern = GET_STRING(argv[0]);
+    list_unshare(argv[1]);
     LinkedList *list = (LinkedList *)GET_OPAQUE(argv[1]);
 
     char *pat_copy = mila_strdup(pattern);
@@ -1562,14 +1627,10 @@ Value *native_export(Env *env, int argc, Value **argv) {
         return verror("export(obj): Expected one dict argument!");
     }
     Env *to = env->parent ? env->parent : env;
+    dict_unshare(argv[0]);
     ITERATE_DICT((Dict *)GET_OPAQUE(argv[0])) {
-        if (entry->key_type == T_STRING) {
-            char *name = NULL;
-            malloc_sprintf(&name, "%.*s", strlen(entry->key + 1) - 1,
-                           entry->key + 1);
-            env_set_local(to, name, entry->value);
-            mila_free(name);
-        }
+        if (!entry->by_repr && entry->key_type == T_STRING)
+            env_set_local(to, GET_STRING(entry->key), entry->value);
     }
     return vnull();
 }
@@ -1667,6 +1728,7 @@ void env_register_builtins(Env *g) {
     val_set_method_table(dict_meta, BMethodGetItem, get_dict);
     val_set_method_table(dict_meta, TMethodSetItem, set_dict);
     val_set_method_table(dict_meta, UMethodCopy, dict_copy);
+    val_set_method_table(dict_meta, UMethodVisit, dict_visit);
 
     list_meta = val_make_table();
 
@@ -1679,6 +1741,7 @@ void env_register_builtins(Env *g) {
     val_set_method_table(list_meta, UMethodStepIter, ll_iter_next);
     val_set_method_table(list_meta, UMethodStepIterClean, ll_iter_cleanup);
     val_set_method_table(list_meta, UMethodCopy, ll_copy);
+    val_set_method_table(list_meta, UMethodVisit, list_visit);
 
     array_meta = val_make_table();
 
@@ -1690,6 +1753,7 @@ void env_register_builtins(Env *g) {
     val_set_method_table(array_meta, UMethodStepIterInit, array_iter_init);
     val_set_method_table(array_meta, UMethodStepIter, array_iter_next);
     val_set_method_table(array_meta, UMethodStepIterClean, array_iter_cleanup);
+    val_set_method_table(array_meta, UMethodVisit, array_visit);
 
     range_meta = val_make_table();
 
@@ -1700,6 +1764,89 @@ void env_register_builtins(Env *g) {
     val_set_method_table(range_meta, UMethodFree, range_free);
     val_set_method_table(range_meta, UMethodToString, range_to_str);
 
+    str_split_meta = val_make_table();
+
+    val_set_method_table(str_split_meta, UMethodStepIterInit,
+                         str_split_iter_init);
+    val_set_method_table(str_split_meta, UMethodStepIter, str_split_iter_next);
+    val_set_method_table(str_split_meta, UMethodStepIterClean,
+                         str_split_iter_cleanup);
+    val_set_method_table(str_split_meta, UMethodFree, str_split_free);
+    val_set_method_table(str_split_meta, UMethodToString, str_split_str);
+    val_set_method_table(str_split_meta, UMethodToRepr, str_split_str);
+
+    set_meta = val_make_table();
+
+    val_set_method_table(set_meta, UMethodToString, set_str);
+    val_set_method_table(set_meta, UMethodToRepr, set_repr);
+    val_set_method_table(set_meta, UMethodFree, set_free);
+    val_set_method_table(set_meta, UMethodCopy, set_copy);
+    val_set_method_table(set_meta, UMethodVisit, dict_visit);
+    val_set_method_table(set_meta, UMethodStepIterInit, set_iter_init);
+    val_set_method_table(set_meta, UMethodStepIter, set_iter_next);
+    val_set_method_table(set_meta, UMethodStepIterClean, set_iter_cleanup);
+
+    heap_meta = val_make_table();
+
+    val_set_method_table(heap_meta, UMethodToString, heap_str);
+    val_set_method_table(heap_meta, UMethodToRepr, heap_str);
+    val_set_method_table(heap_meta, UMethodFree, heap_free);
+    val_set_method_table(heap_meta, UMethodCopy, heap_copy);
+    val_set_method_table(heap_meta, UMethodVisit, heap_visit);
+
+    ordmap_meta = val_make_table();
+
+    val_set_method_table(ordmap_meta, UMethodToString, ordmap_str);
+    val_set_method_table(ordmap_meta, UMethodToRepr, ordmap_str);
+    val_set_method_table(ordmap_meta, BMethodGetItem, get_ordmap);
+    val_set_method_table(ordmap_meta, TMethodSetItem, set_ordmap);
+    val_set_method_table(ordmap_meta, UMethodFree, ordmap_free);
+    val_set_method_table(ordmap_meta, UMethodCopy, ordmap_copy);
+    val_set_method_table(ordmap_meta, UMethodVisit, ordmap_visit);
+    val_set_method_table(ordmap_meta, UMethodStepIterInit, ordmap_iter_init);
+    val_set_method_table(ordmap_meta, UMethodStepIter, ordmap_iter_next);
+    val_set_method_table(ordmap_meta, UMethodStepIterClean,
+                         ordmap_iter_cleanup);
+
+    ordmap_view_meta = val_make_table();
+
+    val_set_method_table(ordmap_view_meta, UMethodToString, ordmap_view_str);
+    val_set_method_table(ordmap_view_meta, UMethodToRepr, ordmap_view_str);
+    val_set_method_table(ordmap_view_meta, UMethodFree, ordmap_view_free);
+    val_set_method_table(ordmap_view_meta, UMethodCopy, ordmap_view_copy);
+    val_set_method_table(ordmap_view_meta, UMethodStepIterInit,
+                         ordmap_view_iter_init);
+    val_set_method_table(ordmap_view_meta, UMethodStepIter, ordmap_iter_next);
+    val_set_method_table(ordmap_view_meta, UMethodStepIterClean,
+                         ordmap_iter_cleanup);
+
+    tarray_meta = val_make_table();
+
+    val_set_method_table(tarray_meta, UMethodToString, tarray_str);
+    val_set_method_table(tarray_meta, UMethodToRepr, tarray_repr);
+    val_set_method_table(tarray_meta, BMethodGetItem, get_tarray);
+    val_set_method_table(tarray_meta, TMethodSetItem, set_tarray);
+    val_set_method_table(tarray_meta, UMethodFree, tarray_free);
+    val_set_method_table(tarray_meta, UMethodCopy, tarray_copy);
+    val_set_method_table(tarray_meta, UMethodStepIterInit, tarray_iter_init);
+    val_set_method_table(tarray_meta, UMethodStepIter, tarray_iter_next);
+    val_set_method_table(tarray_meta, UMethodStepIterClean,
+                         tarray_iter_cleanup);
+
+    strbuf_meta = val_make_table();
+
+    val_set_method_table(strbuf_meta, UMethodToString, strbuf_str);
+    val_set_method_table(strbuf_meta, UMethodToRepr, strbuf_repr);
+    val_set_method_table(strbuf_meta, UMethodFree, strbuf_free);
+    val_set_method_table(strbuf_meta, UMethodCopy, strbuf_copy);
+
+    glob_meta = val_make_table();
+
+    val_set_method_table(glob_meta, UMethodToString, glob_str);
+    val_set_method_table(glob_meta, UMethodToRepr, glob_str);
+    val_set_method_table(glob_meta, UMethodFree, glob_free);
+    val_set_method_table(glob_meta, UMethodCopy, glob_copy);
+
     istring_meta = val_make_table();
 
     val_set_method_table(istring_meta, UMethodToIter, istring_to_iter);
@@ -1719,6 +1866,14 @@ void env_register_builtins(Env *g) {
     // === Misc
     env_register_native(g, "range", native_range);
     env_register_native(g, "copy", native_copy);
+    env_register_native(g, "freeze", native_freeze);
+    env_register_native(g, "is_frozen", native_is_frozen);
+#ifndef ML_NO_GC
+    // === Cycle collector
+    env_register_native(g, "gc.collect", native_gc_collect);
+    env_register_native(g, "gc.stats", native_gc_stats);
+    env_register_native(g, "gc.set_threshold", native_gc_set_threshold);
+#endif
     env_register_native(g, "repr", native_repr);
     env_register_native(g, "repr_raw", native_repr_raw);
     env_register_native(g, "random", native_random);
@@ -1802,10 +1957,63 @@ void env_register_builtins(Env *g) {
     env_register_native(g, "array", native_new_array);
     env_register_native(g, "array.from", native_from_array);
     env_register_native(g, "array.len", native_len_array);
+    // === Typed arrays
+    env_register_native(g, "i64array", native_i64array_new);
+    env_register_native(g, "i64array.from", native_i64array_from);
+    env_register_native(g, "f64array", native_f64array_new);
+    env_register_native(g, "f64array.from", native_f64array_from);
+    env_register_native(g, "u8array", native_u8array_new);
+    env_register_native(g, "u8array.from", native_u8array_from);
+    env_register_native(g, "tarray.len", native_tarray_len);
+    env_register_native(g, "tarray.to_list", native_tarray_to_list);
+    // === Vector kernels
+    env_register_native(g, "vec.sum", native_vec_sum);
+    env_register_native(g, "vec.mean", native_vec_mean);
+    env_register_native(g, "vec.min", native_vec_min);
+    env_register_native(g, "vec.max", native_vec_max);
+    env_register_native(g, "vec.argmin", native_vec_argmin);
+    env_register_native(g, "vec.argmax", native_vec_argmax);
+    env_register_native(g, "vec.dot", native_vec_dot);
+    env_register_native(g, "vec.axpy", native_vec_axpy);
+    env_register_native(g, "vec.add", native_vec_add);
+    env_register_native(g, "vec.sub", native_vec_sub);
+    env_register_native(g, "vec.mul", native_vec_mul);
+    env_register_native(g, "vec.div", native_vec_div);
+    env_register_native(g, "vec.backend", native_vec_backend);
     // === Dicts
     env_register_native(g, "dict", native_new_dict);
     env_register_native(g, "dict.rem", native_rem_dict);
     env_register_native(g, "dict.keys", native_keys_dict);
+    // === Sets
+    env_register_native(g, "set", native_set_new);
+    env_register_native(g, "set.from", native_set_from);
+    env_register_native(g, "set.add", native_set_add);
+    env_register_native(g, "set.rem", native_set_rem);
+    env_register_native(g, "set.contains", native_set_contains);
+    env_register_native(g, "set.len", native_set_len);
+    env_register_native(g, "set.union", native_set_union);
+    env_register_native(g, "set.intersection", native_set_intersection);
+    env_register_native(g, "set.difference", native_set_difference);
+    env_register_native(g, "set.to_list", native_set_to_list);
+    // === Heaps
+    env_register_native(g, "heap", native_heap_new);
+    env_register_native(g, "heap.from", native_heap_from);
+    env_register_native(g, "heap.push", native_heap_push);
+    env_register_native(g, "heap.pop", native_heap_pop);
+    env_register_native(g, "heap.peek", native_heap_peek);
+    env_register_native(g, "heap.pushpop", native_heap_pushpop);
+    env_register_native(g, "heap.len", native_heap_len);
+    env_register_native(g, "heap.to_list", native_heap_to_list);
+    // === Ordered maps
+    env_register_native(g, "ordmap", native_ordmap_new);
+    env_register_native(g, "ordmap.rem", native_ordmap_rem);
+    env_register_native(g, "ordmap.has", native_ordmap_has);
+    env_register_native(g, "ordmap.len", native_ordmap_len);
+    env_register_native(g, "ordmap.first", native_ordmap_first);
+    env_register_native(g, "ordmap.last", native_ordmap_last);
+    env_register_native(g, "ordmap.range", native_ordmap_range);
+    env_register_native(g, "ordmap.prefix", native_ordmap_prefix);
+    env_register_native(g, "ordmap.keys", native_ordmap_keys);
     // === Casting
     env_register_native(g, "cast.int", native_cast_int);
     env_register_native(g, "cast.float", native_cast_float);
@@ -1842,6 +2050,8 @@ void env_register_builtins(Env *g) {
     env_register_native(g, "str.pop_f", native_str_pop_start);
     env_register_native(g, "str.pop_b", native_str_pop_end);
     env_register_native(g, "str.split", native_str_split);
+    env_register_native(g, "str.split_exact", native_str_split_exact);
+    env_register_native(g, "str.split_iter", native_str_split_iter);
     env_register_native(g, "str.join", native_str_join);
     env_register_native(g, "str.startswith", native_str_startsw);
     env_register_native(g, "str.endswith", native_str_endsw);
@@ -1853,10 +2063,19 @@ void env_register_builtins(Env *g) {
     env_register_native(g, "str.match_replace", native_str_match_replace);
     env_register_native(g, "str.match_find", native_str_match_find);
     env_register_native(g, "str.match_findx", native_str_match_findx);
+    env_register_native(g, "pattern.compile", native_pattern_compile);
+    env_register_native(g, "pattern.match", native_pattern_match);
     env_register_native(g, "str.toupper", native_str_toupper);
     env_register_native(g, "str.tolower", native_str_tolower);
     env_register_native(g, "str.substitute", native_str_substitute);
 
+    env_register_native(g, "strbuf", native_strbuf_new);
+    env_register_native(g, "strbuf.append", native_strbuf_append);
+    env_register_native(g, "strbuf.append_fmt", native_strbuf_append_fmt);
+    env_register_native(g, "strbuf.to_string", native_strbuf_to_string);
+    env_register_native(g, "strbuf.len", native_strbuf_len);
+    env_register_native(g, "strbuf.clear", native_strbuf_clear);
+
     env_register_native(g, "istring", native_istring);
     // === ASCII
     env_register_native(g, "ascii.from_int", native_ascii_from_int);
@@ -10,314 +10,400 @@
 #include "ml_primitives.h"
 #include "ml_string.h"
 
-unsigned long HASH_SEED = 5381;
+#include "ml_hash.c"
 
-void hash_set_seed(unsigned long seed) { HASH_SEED = seed; }
+#if defined(__SSE2__) && !defined(ML_NO_SIMD)
+#include <emmintrin.h>
 
-// Simple djb2 hash function
-static unsigned long hash_string(const char *str) {
-    unsigned long hash = HASH_SEED;
-    int c;
-    while ((c = *str++))
-        hash = ((hash << 5) + hash) + c;
-    return hash;
+// Bit i is set when ctrl[i] == tag
+static inline unsigned dict_group_match(const unsigned char *ctrl,
+                                        unsigned char tag) {
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return (unsigned)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(group, _mm_set1_epi8((char)tag)));
 }
-
-FN_UNUSED static unsigned long hash_value(Value *val) {
-    char *og = as_c_string_repr(val);
-    char *str = og;
-    unsigned long hash = HASH_SEED;
-    int c;
-    while ((c = *str++))
-        hash = ((hash << 5) + hash) + c;
-    mila_free(og);
-    return hash;
+#else
+static inline unsigned dict_group_match(const unsigned char *ctrl,
+                                        unsigned char tag) {
+    unsigned mask = 0;
+    for (int i = 0; i < DICT_GROUP; i++)
+        mask |= (unsigned)(ctrl[i] == tag) << i;
+    return mask;
 }
+#endif
 
-static DictEntry *dict_entry_create(const char *key, Value *value) {
-    DictEntry *entry = (DictEntry *)mila_malloc(sizeof(DictEntry));
-    if (!entry)
-        return NULL;
-    entry->key = mila_strdup(key);
-    entry->value = val_retain(value);
-    entry->next = NULL;
-    return entry;
+#define DICT_TAG(hash) ((unsigned char)((hash) >> (sizeof(long) * 8 - 7)))
+
+static void dict_set_ctrl(Dict *dict, size_t i, unsigned char tag) {
+    dict->ctrl[i] = tag;
+    if (i < DICT_GROUP - 1)
+        dict->ctrl[dict->capacity + i] = tag;
 }
 
-static void dict_entry_free(DictEntry *entry) {
-    if (!entry)
-        return;
-    mila_free(entry->key);
-    val_release(entry->value);
-    mila_free(entry);
+// Entries that fit before the index has to grow
+#define DICT_USABLE(capacity) ((capacity) - (capacity) / 4)
+
+static int dict_alloc_index(Dict *dict, size_t capacity) {
+    unsigned char *ctrl = mila_malloc(capacity + DICT_GROUP - 1);
+    uint32_t *index = mila_malloc(capacity * sizeof(uint32_t));
+    if (!ctrl || !index) {
+        mila_free(ctrl);
+        mila_free(index);
+        return 0;
+    }
+    memset(ctrl, DICT_EMPTY, capacity + DICT_GROUP - 1);
+    dict->ctrl = ctrl;
+    dict->index = index;
+    dict->capacity = capacity;
+    return 1;
 }
 
-Dict *dict_create() {
-    Dict *dict = (Dict *)mila_malloc(sizeof(Dict));
-    if (!dict)
-        return NULL;
-    dict->capacity = INITIAL_CAPACITY;
-    dict->size = 0;
-    dict->buckets =
-        (DictEntry **)mila_malloc(dict->capacity * sizeof(DictEntry *));
-    if (!dict->buckets) {
-        mila_free(dict);
-        return NULL;
+static int dict_key_native(Value *key) {
+    if (key->refcount == ML_WEAK_REF_TRIGGER)
+        return 0;
+    switch (key->type) {
+    case T_INT:
+    case T_UINT:
+    case T_FLOAT:
+    case T_BOOL:
+    case T_STRING:
+        return 1;
+    default:
+        return 0;
     }
-    return dict;
 }
 
-static void dict_resize(Dict *dict) {
-    size_t new_capacity = dict->capacity * 2;
-    DictEntry **new_buckets =
-        (DictEntry **)mila_malloc(new_capacity * sizeof(DictEntry *));
-    if (!new_buckets)
-        return;
+static int dict_native_eq(Value *a, Value *b) {
+    if (a->type != b->type)
+        return 0;
+    switch (a->type) {
+    case T_STRING:
+        return mstring_eq(GET_MSTRING(a), GET_MSTRING(b));
+    case T_FLOAT: {
+        double x = GET_FLOAT(a), y = GET_FLOAT(b);
+        return x == y || (x != x && y != y);
+    }
+    case T_BOOL:
+        return !GET_BOOL(a) == !GET_BOOL(b);
+    default:
+        return GET_UINTEGER(a) == GET_UINTEGER(b);
+    }
+}
 
-    for (size_t i = 0; i < dict->capacity; i++) {
-        DictEntry *entry = dict->buckets[i];
-        while (entry) {
-            DictEntry *next = entry->next;
-            unsigned long hash = hash_string(entry->key) % new_capacity;
-            entry->next = new_buckets[hash];
-            new_buckets[hash] = entry;
-            entry = next;
-        }
+/*
+    A lookup key. Either a value compared by value, a repr for every other
+    value, or a bare C string standing in for a string value.
+*/
+typedef struct {
+    Value *value;
+    const char *str;
+    unsigned long hash;
+    ValueType key_type; // for repr keys
+    char is_repr;
+} DictKey;
+
+static int dict_key_make(Dict *dict, DictKey *k, Value *key) {
+    k->value = NULL;
+    k->str = NULL;
+    k->is_repr = 0;
+    if (dict_key_native(key)) {
+        k->value = key;
+        k->hash = hash_scalar(key, dict->seed);
+        return 1;
     }
+    char *repr = as_c_string_repr(key);
+    if (!repr)
+        return 0;
+    k->str = repr;
+    k->hash = hash_string(repr, dict->seed);
+    k->key_type = key->type;
+    k->is_repr = 1;
+    return 1;
+}
 
-    mila_free(dict->buckets);
-    dict->buckets = new_buckets;
-    dict->capacity = new_capacity;
+static void dict_key_free(DictKey *k) {
+    if (k->is_repr)
+        mila_free((char *)k->str);
 }
 
-int dict_set(Dict *dict, Value *key, Value *value) {
-    if (!dict || !key)
+// Entry keys are never NULL, their bytes are compared as they are stored
+static inline int dict_key_str_eq(Value *key, const char *str) {
+    size_t len = strlen(str);
+    return GET_STRING_LEN(key) == len &&
+           memcmp(GET_STRING_BYTES(key), str, len) == 0;
+}
+
+static inline int dict_key_eq(DictEntry *entry, DictKey *k) {
+    if (entry->hash != k->hash || entry->by_repr != k->is_repr)
+        return 0;
+    if (k->is_repr)
+        return dict_key_str_eq(entry->key, k->str);
+    if (!k->value)
+        return entry->key_type == T_STRING &&
+               dict_key_str_eq(entry->key, k->str);
+    if (entry->key_type != k->value->type)
         return 0;
+    // the hash is an unsigned long, 32 bits on some targets, so even ints
+    // with equal hashes can be different keys
+    return dict_native_eq(entry->key, k->value);
+}
 
-    if ((double)dict->size / dict->capacity > LOAD_FACTOR) {
-        dict_resize(dict);
+#define DICT_NOT_FOUND ((size_t)-1)
+
+// Index slot pointing at the entry for k, or DICT_NOT_FOUND
+static size_t dict_find(Dict *dict, DictKey *k) {
+    size_t mask = dict->capacity - 1;
+    unsigned char tag = DICT_TAG(k->hash);
+    for (size_t pos = k->hash & mask;; pos = (pos + DICT_GROUP) & mask) {
+        for (unsigned m = dict_group_match(dict->ctrl + pos, tag); m;
+             m &= m - 1) {
+            size_t slot = (pos + __builtin_ctz(m)) & mask;
+            if (dict_key_eq(&dict->entries[dict->index[slot]], k))
+                return slot;
+        }
+        // a probe run never spans an empty slot
+        if (dict_group_match(dict->ctrl + pos, DICT_EMPTY))
+            return DICT_NOT_FOUND;
     }
+}
 
-    char *key_str = as_c_string_repr(key);
-
-    unsigned long index = hash_string(key_str) % dict->capacity;
-    DictEntry *entry = dict->buckets[index];
+static inline DictEntry *dict_lookup(Dict *dict, DictKey *k) {
+    size_t slot = dict_find(dict, k);
+    return slot == DICT_NOT_FOUND ? NULL : &dict->entries[dict->index[slot]];
+}
 
-    while (entry) {
-        if (strcmp(entry->key, key_str) == 0) {
-            val_release(entry->value);
-            entry->value = val_retain(value);
-            mila_free(key_str);
-            return 1; // updated existing
+// Points a free index slot of hash's probe run at entries[at]
+static void dict_place(Dict *dict, unsigned long hash, size_t at) {
+    size_t mask = dict->capacity - 1;
+    for (size_t pos = hash & mask;; pos = (pos + DICT_GROUP) & mask) {
+        unsigned m = dict_group_match(dict->ctrl + pos, DICT_EMPTY);
+        if (m) {
+            size_t slot = (pos + __builtin_ctz(m)) & mask;
+            dict->index[slot] = (uint32_t)at;
+            dict_set_ctrl(dict, slot, DICT_TAG(hash));
+            return;
         }
-        entry = entry->next;
     }
+}
 
-    DictEntry *new_entry = dict_entry_create(key_str, value);
-    new_entry->key_type = key->type;
-    if (!new_entry) {
-        mila_free(key_str);
-        return 0;
+Dict *dict_create() {
+    Dict *dict = (Dict *)mila_malloc(sizeof(Dict));
+    if (!dict)
+        return NULL;
+    dict->size = 0;
+    dict->used = 0;
+    dict->refcount = 1;
+    dict->seed = hash_get_seed();
+    dict->entries = mila_malloc(DICT_USABLE(INITIAL_CAPACITY) *
+                                sizeof(DictEntry));
+    if (!dict->entries || !dict_alloc_index(dict, INITIAL_CAPACITY)) {
+        mila_free(dict->entries);
+        mila_free(dict);
+        return NULL;
     }
-    new_entry->next = dict->buckets[index];
-    dict->buckets[index] = new_entry;
-    dict->size++;
-    mila_free(key_str);
-    return 1; // new insertion
+    return dict;
 }
 
-int dict_set_raw(Dict *dict, char *key, Value *value) {
-    if (!dict || !key)
-        return 0;
+// Called when entries is full. Squeezes out removed entries, and doubles
+// the table unless at least half of them were holes.
+static int dict_resize(Dict *dict) {
+    size_t capacity = dict->capacity;
+    if (dict->size * 2 >= DICT_USABLE(capacity))
+        capacity *= 2;
 
-    if ((double)dict->size / dict->capacity > LOAD_FACTOR) {
-        dict_resize(dict);
+    DictEntry *entries = dict->entries;
+    if (capacity != dict->capacity) {
+        entries =
+            mila_realloc(entries, DICT_USABLE(capacity) * sizeof(DictEntry));
+        if (!entries)
+            return 0;
+        dict->entries = entries;
     }
+    unsigned char *old_ctrl = dict->ctrl;
+    uint32_t *old_index = dict->index;
+    if (!dict_alloc_index(dict, capacity))
+        return 0;
+    mila_free(old_ctrl);
+    mila_free(old_index);
+
+    size_t live = 0;
+    for (size_t i = 0; i < dict->used; i++)
+        if (entries[i].key)
+            entries[live++] = entries[i];
+    dict->used = live;
+    // hashes are stored, nothing is rehashed
+    for (size_t i = 0; i < live; i++)
+        dict_place(dict, entries[i].hash, i);
+    return 1;
+}
 
-    unsigned long index = hash_string(key) % dict->capacity;
-    DictEntry *entry = dict->buckets[index];
-
-    while (entry) {
-        if (strcmp(entry->key, key) == 0) {
-            val_release(entry->value);
-            entry->value = val_retain(value);
-            return 1; // updated existing
-        }
-        entry = entry->next;
+// Sets k to value, retaining value. The entry gets a private key of its own.
+static int dict_put(Dict *dict, DictKey *k, Value *value) {
+    DictEntry *entry = dict_lookup(dict, k);
+    if (entry) {
+        Value *old = entry->value;
+        entry->value = val_retain(value);
+        val_release(old);
+        return 1; // updated existing
     }
 
-    DictEntry *new_entry = dict_entry_create(key, value);
-    if (!new_entry) {
-        mila_free(key);
+    if (dict->used >= DICT_USABLE(dict->capacity) && !dict_resize(dict))
         return 0;
-    }
-    new_entry->key_type = T_INT;
-    new_entry->next = dict->buckets[index];
-    dict->buckets[index] = new_entry;
+
+    dict->entries[dict->used] = (DictEntry){
+        .key = k->value ? val_copy(k->value) : vstring_dup(k->str),
+        .value = val_retain(value),
+        .hash = k->hash,
+        .key_type = k->value ? k->value->type : k->key_type,
+        .by_repr = k->is_repr};
+    dict_place(dict, k->hash, dict->used);
+    dict->used++;
     dict->size++;
     return 1; // new insertion
 }
 
+int dict_set(Dict *dict, Value *key, Value *value) {
+    DictKey k;
+    if (!dict || !key || !dict_key_make(dict, &k, key))
+        return 0;
+    int res = dict_put(dict, &k, value);
+    dict_key_free(&k);
+    return res;
+}
+
 Value *dict_get_str(Dict *dict, const char *key) {
     if (!dict || !key)
         return NULL;
-    char *key_str = NULL;
-    malloc_sprintf(&key_str, "\"%s\"", key);
-    unsigned long index = hash_string(key_str) % dict->capacity;
-    DictEntry *entry = dict->buckets[index];
-    while (entry) {
-        if (strcmp(entry->key, key_str) == 0) {
-            free(key_str);
-            return entry->value;
-        }
-        entry = entry->next;
-    }
-    free(key_str);
-    return NULL;
+    DictKey k = {.str = key, .hash = hash_string(key, dict->seed)};
+    DictEntry *entry = dict_lookup(dict, &k);
+    return entry ? entry->value : NULL;
 }
 
 int dict_set_str(Dict *dict, char *str_key, Value *value) {
     if (!dict || !str_key)
         return 0;
+    DictKey k = {.str = str_key,
+                 .hash = hash_string(str_key, dict->seed),
+                 .key_type = T_STRING};
+    return dict_put(dict, &k, value);
+}
 
-    if ((double)dict->size / dict->capacity > LOAD_FACTOR) {
-        dict_resize(dict);
-    }
-
-    char *key = NULL;
-    malloc_sprintf(&key, "\"%s\"", str_key);
-
-    unsigned long index = hash_string(key) % dict->capacity;
-    DictEntry *entry = dict->buckets[index];
+// Lookup key for an entry of from, its hash is reused when both dicts
+// were made with the same seed
+static DictKey dict_entry_lookup_key(Dict *dict, Dict *from, DictEntry *entry) {
+    DictKey k = {.value = entry->by_repr ? NULL : entry->key,
+                 .str = entry->by_repr ? GET_STRING(entry->key) : NULL,
+                 .hash = entry->hash,
+                 .key_type = entry->key_type,
+                 .is_repr = entry->by_repr};
+    if (from->seed != dict->seed)
+        k.hash = entry->by_repr ? hash_string(k.str, dict->seed)
+                                : hash_scalar(entry->key, dict->seed);
+    return k;
+}
 
-    while (entry) {
-        if (strcmp(entry->key, key) == 0) {
-            val_release(entry->value);
-            entry->value = val_retain(value);
-            return 1; // updated existing
-        }
-        entry = entry->next;
-    }
+// Sets the key of an entry of from
+int dict_set_entry(Dict *dict, Dict *from, DictEntry *entry, Value *value) {
+    if (!dict || !entry)
+        return 0;
+    DictKey k = dict_entry_lookup_key(dict, from, entry);
+    return dict_put(dict, &k, value);
+}
 
-    DictEntry *new_entry = dict_entry_create(key, value);
-    if (!new_entry) {
-        mila_free(key);
+// Whether dict has the key of an entry of from
+int dict_has_entry(Dict *dict, Dict *from, DictEntry *entry) {
+    if (!dict || !entry)
         return 0;
-    }
-    new_entry->key_type = T_INT;
-    new_entry->next = dict->buckets[index];
-    dict->buckets[index] = new_entry;
-    dict->size++;
-    mila_free(key);
-    return 1; // new insertion
+    DictKey k = dict_entry_lookup_key(dict, from, entry);
+    return dict_lookup(dict, &k) != NULL;
 }
 
 Value *dict_get(Dict *dict, Value *key) {
-    if (!dict || !key)
+    DictKey k;
+    if (!dict || !key || !dict_key_make(dict, &k, key))
         return NULL;
-    char *key_str = as_c_string_repr(key);
-    unsigned long index = hash_string(key_str) % dict->capacity;
-    DictEntry *entry = dict->buckets[index];
-    while (entry) {
-        if (strcmp(entry->key, key_str) == 0) {
-            mila_free(key_str);
-            return entry->value;
-        }
-        entry = entry->next;
-    }
-    mila_free(key_str);
-    return NULL;
+    DictEntry *entry = dict_lookup(dict, &k);
+    dict_key_free(&k);
+    return entry ? entry->value : NULL;
+}
+
+int dict_has(Dict *dict, Value *key) {
+    DictKey k;
+    if (!dict || !key || !dict_key_make(dict, &k, key))
+        return 0;
+    DictEntry *entry = dict_lookup(dict, &k);
+    dict_key_free(&k);
+    return entry != NULL;
 }
 
 int dict_remove(Dict *dict, Value *key) {
-    if (!dict || !key)
+    DictKey k;
+    if (!dict || !key || !dict_key_make(dict, &k, key))
+        return 0;
+    size_t hole = dict_find(dict, &k);
+    dict_key_free(&k);
+    if (hole == DICT_NOT_FOUND)
         return 0;
 
-    char *key_str = as_c_string_repr(key);
-    unsigned long index = hash_string(key_str) % dict->capacity;
-    DictEntry *entry = dict->buckets[index];
-    DictEntry *prev = NULL;
-
-    while (entry) {
-        if (strcmp(entry->key, key_str) == 0) {
-            if (prev)
-                prev->next = entry->next;
-            else
-                dict->buckets[index] = entry->next;
-            dict_entry_free(entry);
-            dict->size--;
-            mila_free(key_str);
-            return 1;
+    DictEntry *entry = &dict->entries[dict->index[hole]];
+    size_t mask = dict->capacity - 1;
+    // pull later members of the probe run back into the hole, as long as
+    // that doesn't move them in front of their home slot
+    for (size_t j = (hole + 1) & mask; dict->ctrl[j] != DICT_EMPTY;
+         j = (j + 1) & mask) {
+        size_t home = dict->entries[dict->index[j]].hash & mask;
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            dict->index[hole] = dict->index[j];
+            dict_set_ctrl(dict, hole, dict->ctrl[j]);
+            hole = j;
         }
-        prev = entry;
-        entry = entry->next;
     }
-    mila_free(key_str);
-    return 0;
+    dict_set_ctrl(dict, hole, DICT_EMPTY);
+    dict->size--;
+
+    // the entry stays behind as a hole until the next resize, so the
+    // others keep their order
+    Value *old_key = entry->key, *old_value = entry->value;
+    entry->key = NULL;
+    entry->value = NULL;
+    val_release(old_key);
+    val_release(old_value);
+    return 1;
 }
 
 void dict_free(Dict *dict) {
     if (!dict)
         return;
-    for (size_t i = 0; i < dict->capacity; i++) {
-        DictEntry *entry = dict->buckets[i];
-        while (entry) {
-            DictEntry *next = entry->next;
-            dict_entry_free(entry);
-            entry = next;
-        }
+    ITERATE_DICT(dict) {
+        val_release(entry->key);
+        val_release(entry->value);
     }
-    mila_free(dict->buckets);
+    mila_free(dict->ctrl);
+    mila_free(dict->index);
+    mila_free(dict->entries);
     mila_free(dict);
 }
 
 Value *dict_str(Value *self) {
     Dict *dict = (Dict *)self->v;
 
-    if (!dict || !dict->buckets)
+    if (!dict || !dict->size)
         return vstring_dup("[@]");
 
     char *buffer = NULL;
     malloc_sprintf(&buffer, "[@ ");
-
-    KVPair *entries = NULL;
-    size_t count = 0, capacity = 16;
-    entries = (KVPair *)mila_malloc(capacity * sizeof(KVPair));
-    if (!entries)
-        return NULL;
-
-    // Collect all entries
-    for (size_t i = 0; i < dict->capacity; i++) {
-        DictEntry *entry = dict->buckets[i];
-        while (entry) {
-            if (count >= capacity) {
-                capacity *= 2;
-                KVPair *tmp =
-                    (KVPair *)realloc(entries, capacity * sizeof(KVPair));
-                if (!tmp) {
-                    mila_free(entries);
-                    return NULL;
-                }
-                entries = tmp;
-            }
-            entries[count].key = entry->key;
-            entries[count].value = entry->value;
-            count++;
-            entry = entry->next;
-        }
-    }
-
-    for (size_t i = count; i > 0; i--) {
-        char *val_str = as_c_string_repr(entries[i - 1].value);
-        if (i > 1)
-            malloc_sprintf(&buffer, "%s = %s, ", entries[i - 1].key, val_str);
-        else
-            malloc_sprintf(&buffer, "%s = %s", entries[i - 1].key, val_str);
+    int first = 1;
+    ITERATE_DICT(dict) {
+        char *key_str = entry->by_repr ? NULL : as_c_string_repr(entry->key);
+        char *val_str = as_c_string_repr(entry->value);
+        malloc_sprintf(&buffer, "%s%s = %s", first ? "" : ", ",
+                       entry->by_repr ? GET_STRING(entry->key) : key_str,
+                       val_str);
+        mila_free(key_str);
         mila_free(val_str);
+        first = 0;
     }
-
     malloc_sprintf(&buffer, "]");
-    mila_free(entries);
     return vstring_take(buffer);
 }
 
@@ -328,28 +414,56 @@ Value *dict_repr(Value *self) {
     return dict_str(self);
 }
 
+// Entry wise copy, containers inside come out as shared copies themselves
+Dict *dict_clone(Dict *original) {
+    Dict *copy = (Dict *)mila_malloc(sizeof(Dict));
+    if (!copy)
+        return NULL;
+    copy->entries =
+        mila_malloc(DICT_USABLE(original->capacity) * sizeof(DictEntry));
+    if (!copy->entries || !dict_alloc_index(copy, original->capacity)) {
+        mila_free(copy->entries);
+        mila_free(copy);
+        return NULL;
+    }
+    copy->size = 0;
+    copy->used = 0;
+    copy->refcount = 1;
+    copy->seed = original->seed;
+
+    // same layout, holes included, so the index can be taken over as is
+    memcpy(copy->ctrl, original->ctrl, original->capacity + DICT_GROUP - 1);
+    memcpy(copy->index, original->index,
+           original->capacity * sizeof(uint32_t));
+    for (size_t i = 0; i < original->used; i++) {
+        DictEntry *entry = &original->entries[i];
+        DictEntry *dst = &copy->entries[i];
+        *dst = *entry;
+        if (entry->key) {
+            dst->value = entry->value ? val_copy(entry->value) : NULL;
+            val_retain(dst->key);
+            copy->size++;
+        }
+        copy->used++;
+    }
+    return copy;
+}
+
 Value *dict_copy(Value *self) {
     if (!self || !self->v)
         return NULL;
 
     Dict *original = (Dict *)self->v;
-    Dict *copy = dict_create();
-    if (!copy)
-        return NULL;
-
-    // Deep copy all entries
-    for (size_t i = 0; i < original->capacity; i++) {
-        DictEntry *entry = original->buckets[i];
-        while (entry) {
-            Value *copied_value = val_copy(entry->value);
-            if (!copied_value) {
-                dict_free(copy);
-                return NULL;
-            }
-            dict_set_raw(copy, entry->key, copied_value);
-            val_release(copied_value);
-            entry = entry->next;
-        }
+    Dict *copy;
+    if (val_copy_shares(self)) {
+        ML_REF_INC(original);
+        copy = original;
+    } else {
+        val_copy_depth++;
+        copy = dict_clone(original);
+        val_copy_depth--;
+        if (!copy)
+            return NULL;
     }
 
     Value *result = val_new_raw(T_OPAQUE);
@@ -359,44 +473,35 @@ Value *dict_copy(Value *self) {
     return result;
 }
 
+// Gives self storage of its own before it is changed or its items leak out.
+void dict_unshare(Value *self) {
+    Dict *dict = (Dict *)self->v;
+    if (dict->refcount <= 1)
+        return;
+    Dict *own = dict_clone(dict);
+    if (!own)
+        return;
+    self->v = (void *)own;
+    if (ML_REF_DEC(dict) == 0)
+        dict_free(dict);
+}
+
+// A new reference to a value equal to the entry's key
+Value *dict_entry_key(DictEntry *entry) {
+    return entry->by_repr ? eval_str(GET_STRING(entry->key), NULL)
+                          : val_copy(entry->key);
+}
+
 Value **dict_keys(Dict *dict) {
-    if (!dict || !dict->buckets)
+    if (!dict)
         return NULL;
 
-    Value **entries = NULL;
-    size_t count = 0, capacity = 16;
-    entries = (Value **)mila_malloc(capacity * sizeof(char *));
+    Value **entries = (Value **)mila_malloc((dict->size + 1) * sizeof(Value *));
     if (!entries)
         return NULL;
 
-    // Collect all entries
-    for (size_t i = 0; i < dict->capacity; i++) {
-        DictEntry *entry = dict->buckets[i];
-        while (entry) {
-            if (count >= capacity) {
-                capacity *= 2;
-                Value **tmp =
-                    (Value **)realloc(entries, capacity * sizeof(Value *));
-                if (!tmp) {
-                    mila_free(entries);
-                    return NULL;
-                }
-                entries = tmp;
-            }
-            entries[count++] = eval_str(entry->key, NULL);
-            entry = entry->next;
-        }
-    }
-
-    if (count >= capacity) {
-        capacity *= 2;
-        Value **tmp = (Value **)realloc(entries, capacity * sizeof(Value *));
-        if (!tmp) {
-            mila_free(entries);
-            return NULL;
-        }
-        entries = tmp;
-    }
+    size_t count = 0;
+    ITERATE_DICT(dict) { entries[count++] = dict_entry_key(entry); }
     entries[count] = NULL;
     return entries;
 }
@@ -0,0 +1,281 @@
+// This project is licensed under the GNU Affero General Public License
+#pragma once
+
+/*
+    Trial deletion cycle collector.
+    Every container that can hold other values is tracked in a pointer set.
+    A pass subtracts the references containers hold on each other from their
+    refcounts, whatever is left over is referenced from outside (variables,
+    the C stack, untracked values). Anything not reachable from those is
+    part of a dead cycle and gets torn down.
+*/
+
+#include "mila.h"
+#include "ml_gc.h"
+
+GCStats mila_gc_stats = {.threshold = ML_GC_DEFAULT_THRESHOLD};
+
+#define GC_TOMBSTONE ((Value *)1)
+#define GC_LIVE(slot) ((slot)->value && (slot)->value != GC_TOMBSTONE)
+
+typedef struct {
+    Value *value;
+    long refs;      // trial refcount, only meaningful during a pass
+    char reachable; // set during a pass
+} GCSlot;
+
+// open addressing, capacity is a power of two
+static struct {
+    GCSlot *slots;
+    size_t capacity;
+    size_t used; // live slots and tombstones
+} gc_table = {0};
+
+typedef struct {
+    Value **items;
+    size_t size, count;
+} GCWork;
+
+static char gc_running = 0;
+
+#ifndef ML_NO_THREADING
+static pthread_mutex_t gc_lock = PTHREAD_MUTEX_INITIALIZER;
+#define GC_LOCK()                                                              \
+    do {                                                                       \
+        if (mila_refs_shared)                                                  \
+            pthread_mutex_lock(&gc_lock);                                      \
+    } while (0)
+#define GC_UNLOCK()                                                            \
+    do {                                                                       \
+        if (mila_refs_shared)                                                  \
+            pthread_mutex_unlock(&gc_lock);                                    \
+    } while (0)
+#else
+#define GC_LOCK()                                                              \
+    do {                                                                       \
+    } while (0)
+#define GC_UNLOCK()                                                            \
+    do {                                                                       \
+    } while (0)
+#endif
+
+static size_t gc_hash(Value *v) {
+    return (size_t)(((uintptr_t)v >> 4) * 11400714819323198485ull);
+}
+
+static GCSlot *gc_find(Value *v) {
+    if (!gc_table.capacity)
+        return NULL;
+    size_t mask = gc_table.capacity - 1;
+    for (size_t i = gc_hash(v) & mask;; i = (i + 1) & mask) {
+        if (gc_table.slots[i].value == v)
+            return &gc_table.slots[i];
+        if (!gc_table.slots[i].value)
+            return NULL;
+    }
+}
+
+static void gc_insert(Value *v) {
+    size_t mask = gc_table.capacity - 1;
+    size_t i = gc_hash(v) & mask;
+    while (GC_LIVE(&gc_table.slots[i]))
+        i = (i + 1) & mask;
+    if (!gc_table.slots[i].value)
+        gc_table.used++;
+    gc_table.slots[i].value = v;
+}
+
+static void gc_resize(void) {
+    GCSlot *old = gc_table.slots;
+    size_t old_capacity = gc_table.capacity;
+    size_t capacity = 64;
+    // keep the table at most ~35% full right after a resize
+    while (capacity * 7 < (mila_gc_stats.tracked + 1) * 20)
+        capacity *= 2;
+    gc_table.slots = mila_malloc(sizeof(GCSlot) * capacity);
+    gc_table.capacity = capacity;
+    gc_table.used = 0;
+    for (size_t i = 0; i < old_capacity; i++)
+        if (GC_LIVE(&old[i]))
+            gc_insert(old[i].value);
+    mila_free(old);
+}
+
+void gc_track(Value *v) {
+    GC_LOCK();
+    if (!gc_find(v)) {
+        if ((gc_table.used + 1) * 10 > gc_table.capacity * 7)
+            gc_resize();
+        gc_insert(v);
+        mila_gc_stats.tracked++;
+        mila_gc_stats.pending++;
+    }
+    GC_UNLOCK();
+}
+
+void gc_untrack(Value *v) {
+    GC_LOCK();
+    GCSlot *slot = gc_find(v);
+    if (slot) {
+        slot->value = GC_TOMBSTONE;
+        mila_gc_stats.tracked--;
+    }
+    GC_UNLOCK();
+}
+
+static void gc_push(GCWork *work, Value *v) {
+    if (work->count >= work->size) {
+        work->size = work->size ? work->size * 2 : 64;
+        work->items = mila_realloc(work->items, sizeof(Value *) * work->size);
+    }
+    work->items[work->count++] = v;
+}
+
+// Lists, dicts and arrays expose their items through UMethodVisit,
+// functions hold values through their closure. Only references that are
+// counted get visited, a closure's contextual vars point at values
+// without retaining them.
+static void gc_visit(Value *v, value_visitor fn, void *ctx) {
+    // copies sharing storage would each report the same slots, leave
+    // those items to count as referenced from the outside
+    if (val_is_shared(v))
+        return;
+    visit_method visit = (visit_method)GET_METHOD(v, UMethodVisit);
+    if (visit) {
+        visit(v, fn, ctx);
+        return;
+    }
+    if (v->type == T_FUNCTION && GET_FUNCTION(v)->closure) {
+        Env *closure = GET_FUNCTION(v)->closure;
+        for (Var *var = closure->vars; var; var = var->next)
+            fn(&var->value, ctx);
+    }
+}
+
+static void gc_subtract(Value **slot, void *ctx) {
+    (void)ctx;
+    GCSlot *s = *slot ? gc_find(*slot) : NULL;
+    if (s)
+        s->refs--;
+}
+
+static void gc_mark(Value **slot, void *ctx) {
+    GCSlot *s = *slot ? gc_find(*slot) : NULL;
+    if (s && !s->reachable) {
+        s->reachable = 1;
+        gc_push((GCWork *)ctx, s->value);
+    }
+}
+
+static void gc_clear(Value **slot, void *ctx) {
+    (void)ctx;
+    Value *child = *slot;
+    *slot = NULL;
+    val_release(child);
+}
+
+// Returns the number of containers freed.
+size_t gc_collect(void) {
+    mila_gc_stats.pending = 0;
+#ifndef ML_NO_THREADING
+    // other threads may be between a load and a retain, their
+    // references are invisible to us
+    if (mila_refs_shared)
+        return 0;
+#endif
+    if (gc_running || !gc_table.capacity)
+        return 0;
+    gc_running = 1;
+
+    for (size_t i = 0; i < gc_table.capacity; i++) {
+        GCSlot *s = &gc_table.slots[i];
+        if (GC_LIVE(s)) {
+            s->refs = s->value->refcount;
+            s->reachable = 0;
+        }
+    }
+    for (size_t i = 0; i < gc_table.capacity; i++)
+        if (GC_LIVE(&gc_table.slots[i]))
+            gc_visit(gc_table.slots[i].value, gc_subtract, NULL);
+
+    // whatever still has references left is held from the outside,
+    // so is everything it holds
+    GCWork work = {0};
+    for (size_t i = 0; i < gc_table.capacity; i++) {
+        GCSlot *s = &gc_table.slots[i];
+        if (GC_LIVE(s) && s->refs > 0 && !s->reachable) {
+            s->reachable = 1;
+            gc_push(&work, s->value);
+        }
+    }
+    while (work.count)
+        gc_visit(work.items[--work.count], gc_mark, &work);
+
+    GCWork garbage = {0};
+    for (size_t i = 0; i < gc_table.capacity; i++)
+        if (GC_LIVE(&gc_table.slots[i]) && !gc_table.slots[i].reachable)
+            gc_push(&garbage, gc_table.slots[i].value);
+
+    // pin everything first so tearing down one container never frees
+    // another one we still have to clear
+    for (size_t i = 0; i < garbage.count; i++)
+        val_retain(garbage.items[i]);
+    for (size_t i = 0; i < garbage.count; i++)
+        gc_visit(garbage.items[i], gc_clear, NULL);
+    for (size_t i = 0; i < garbage.count; i++)
+        val_release(garbage.items[i]);
+
+    size_t collected = garbage.count;
+    mila_free(work.items);
+    mila_free(garbage.items);
+    mila_gc_stats.collections++;
+    mila_gc_stats.collected += collected;
+    mila_gc_stats.pending = 0;
+    gc_running = 0;
+    return collected;
+}
+
+void gc_deinit(void) {
+    mila_free(gc_table.slots);
+    gc_table.slots = NULL;
+    gc_table.capacity = 0;
+    gc_table.used = 0;
+    mila_gc_stats.tracked = 0;
+}
+
+Value *native_gc_collect(Env *env, int argc, Value **argv) {
+    (void)env;
+    (void)argv;
+    if (argc != 0)
+        return verror("gc.collect(): Expected no arguments");
+    return vint((long)gc_collect());
+}
+
+static void gc_stat_set(Dict *d, char *name, size_t n) {
+    Value *v = vint((long)n);
+    dict_set_str(d, name, v);
+    val_release(v);
+}
+
+Value *native_gc_stats(Env *env, int argc, Value **argv) {
+    (void)env;
+    (void)argv;
+    if (argc != 0)
+        return verror("gc.stats(): Expected no arguments");
+    Value *res = call_native_with(NULL, native_new_dict, NULL);
+    Dict *d = (Dict *)GET_OPAQUE(res);
+    gc_stat_set(d, "collections", mila_gc_stats.collections);
+    gc_stat_set(d, "collected", mila_gc_stats.collected);
+    gc_stat_set(d, "tracked", mila_gc_stats.tracked);
+    gc_stat_set(d, "pending", mila_gc_stats.pending);
+    gc_stat_set(d, "threshold", mila_gc_stats.threshold);
+    return res;
+}
+
+Value *native_gc_set_threshold(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 1 || GET_TYPE(argv[0]) != T_INT || GET_INTEGER(argv[0]) < 0)
+        return verror("gc.set_threshold(n): Expected a non negative int");
+    mila_gc_stats.threshold = (size_t)GET_INTEGER(argv[0]);
+    return vnull();
+}
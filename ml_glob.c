@@ -0,0 +1,692 @@
+// This project is licensed under the GNU Affero General Public License
+#pragma once
+
+#include <string.h>
+
+#include "mila.h"
+#include "ml_glob.h"
+#include "ml_primitives.h"
+#include "ml_string.h"
+#include "ml_strscan.h"
+
+#define IS_GLOB(val)                                                           \
+    (GET_TYPE(val) == T_OPAQUE && (val)->method_table == glob_meta &&          \
+     (val)->v)
+
+// Strings up to 64 times this many bytes are searched without allocating
+#define GLOB_STARTS_INLINE 4
+
+static struct {
+    MGlob *g;
+    unsigned long used;
+} glob_cache[GLOB_CACHE_SIZE];
+static unsigned long glob_cache_clock = 0;
+
+#ifndef ML_NO_THREADING
+// Guards the cache and the refcounts of what's in it
+static pthread_mutex_t glob_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void glob_lock(void) {
+#ifndef ML_NO_THREADING
+    pthread_mutex_lock(&glob_cache_lock);
+#endif
+}
+
+static void glob_unlock(void) {
+#ifndef ML_NO_THREADING
+    pthread_mutex_unlock(&glob_cache_lock);
+#endif
+}
+
+static const char *glob_find_close(const char *p, char close) {
+    while (*p) {
+        if (*p == '\\' && *(p + 1)) {
+            p += 2;
+            continue;
+        }
+        if (*p == close)
+            return p;
+        p++;
+    }
+    return NULL;
+}
+
+static void glob_set_add(uint64_t *set, unsigned char c) {
+    set[c >> 6] |= (uint64_t)1 << (c & 63);
+}
+
+// Reads a set like `a-z\]_` between start and end. Ranges compare bytes as
+// char, as they always have
+static void glob_set_parse(uint64_t *set, const char *start,
+                           const char *end) {
+    const char *p = start;
+    while (p < end) {
+        char lo, hi;
+        if (*p == '\\' && p + 1 < end) {
+            lo = *(p + 1);
+            p += 2;
+        } else {
+            lo = *p++;
+        }
+        hi = lo;
+        if (p < end && *p == '-' && p + 1 < end) {
+            p++;
+            if (*p == '\\' && p + 1 < end) {
+                hi = *(p + 1);
+                p += 2;
+            } else {
+                hi = *p++;
+            }
+        }
+        for (int c = lo; c <= hi; c++)
+            if (c)
+                glob_set_add(set, (unsigned char)c);
+    }
+}
+
+static inline int glob_op_has(const GlobOp *op, unsigned char c) {
+    if (op->kind == GLOB_BYTE)
+        return op->byte == c;
+    return (op->set[c >> 6] >> (c & 63)) & 1;
+}
+
+/*
+    Adds the ops after each * in x, a * can be skipped. Two * in a row
+    only happen as the tail of a {} and a *, `**` compiles to one, so two
+    shifts reach everything.
+*/
+static inline uint64_t glob_bits_closure(uint64_t x, uint64_t star) {
+    uint64_t y = (x & star) << 1;
+    return x | y | ((y & star) << 1);
+}
+
+// Adds each * that's followed by an op in x
+static inline uint64_t glob_bits_back(uint64_t x, uint64_t star) {
+    uint64_t y = (x >> 1) & star;
+    return x | y | ((y >> 1) & star);
+}
+
+static GlobOp *glob_emit(MGlob *g, GlobOpKind kind) {
+    GlobOp *op = &g->ops[g->nops++];
+    memset(op, 0, sizeof(GlobOp));
+    op->kind = kind;
+    return op;
+}
+
+static const GlobOp glob_any = {
+    GLOB_SET, 0, {~(uint64_t)1, ~(uint64_t)0, ~(uint64_t)0, ~(uint64_t)0}};
+
+// A ? or a *, they take any byte
+static void glob_emit_any(MGlob *g, GlobOpKind kind) {
+    g->literal = 0;
+    // `**` is `*`
+    if (kind == GLOB_STAR && g->nops &&
+        g->ops[g->nops - 1].kind == GLOB_STAR &&
+        memcmp(g->ops[g->nops - 1].set, glob_any.set, sizeof(glob_any.set)) ==
+            0)
+        return;
+    memcpy(glob_emit(g, kind)->set, glob_any.set, sizeof(glob_any.set));
+}
+
+static void glob_emit_byte(MGlob *g, char c) {
+    glob_emit(g, GLOB_BYTE)->byte = (unsigned char)c;
+    g->lit[g->lit_len++] = c;
+}
+
+MGlob *glob_compile(const char *pattern) {
+    size_t len = strlen(pattern);
+    MGlob *g = (MGlob *)mila_malloc(sizeof(MGlob));
+    memset(g, 0, sizeof(MGlob));
+    g->src = (char *)mila_malloc(len + 1);
+    memcpy(g->src, pattern, len + 1);
+    g->src_len = len;
+    g->refcount = 1;
+    g->literal = 1;
+    // every op but a {} takes a byte of the pattern, {} takes at least 2
+    g->ops = (GlobOp *)mila_malloc((len + 1) * sizeof(GlobOp));
+    g->lit = (char *)mila_malloc(len + 1);
+
+    const char *p = pattern;
+    while (*p && !g->never) {
+        switch (*p) {
+        case '\\':
+            if (!*(p + 1)) {
+                g->never = 1;
+                break;
+            }
+            glob_emit_byte(g, *(p + 1));
+            p += 2;
+            break;
+        case '?':
+            glob_emit_any(g, GLOB_SET);
+            p++;
+            break;
+        case '*':
+            glob_emit_any(g, GLOB_STAR);
+            p++;
+            break;
+        case '[':
+        case '{': {
+            const char *close = glob_find_close(p + 1, *p == '[' ? ']' : '}');
+            if (!close) {
+                glob_emit_byte(g, *p++);
+                break;
+            }
+            GlobOp *op = glob_emit(g, GLOB_SET);
+            glob_set_parse(op->set, p + 1, close);
+            // {set} is one byte out of set and then any more of them
+            if (*p == '{')
+                memcpy(glob_emit(g, GLOB_STAR)->set, op->set, sizeof(op->set));
+            g->literal = 0;
+            p = close + 1;
+            break;
+        }
+        default:
+            glob_emit_byte(g, *p++);
+        }
+    }
+    glob_emit(g, GLOB_END);
+    g->nops--;
+    g->lit[g->lit_len] = '\0';
+    g->first = g->ops[0].kind == GLOB_BYTE ? g->ops[0].byte : -1;
+
+    if (g->nops < 64 && !g->literal && !g->never) {
+        g->acc = (uint64_t *)mila_malloc(256 * sizeof(uint64_t));
+        for (int c = 0; c < 256; c++) {
+            uint64_t bits = 0;
+            for (size_t i = 0; i < g->nops; i++)
+                if (glob_op_has(&g->ops[i], (unsigned char)c))
+                    bits |= (uint64_t)1 << i;
+            g->acc[c] = bits;
+        }
+        for (size_t i = 0; i < g->nops; i++)
+            if (g->ops[i].kind == GLOB_STAR)
+                g->star |= (uint64_t)1 << i;
+        g->init = glob_bits_closure(1, g->star);
+        g->lead_any = g->ops[0].kind == GLOB_STAR &&
+                      memcmp(g->ops[0].set, glob_any.set,
+                             sizeof(glob_any.set)) == 0;
+    }
+    return g;
+}
+
+static void glob_destroy(MGlob *g) {
+    mila_free(g->src);
+    mila_free(g->ops);
+    mila_free(g->lit);
+    if (g->acc)
+        mila_free(g->acc);
+    mila_free(g);
+}
+
+// Drops a reference, the cache lock must be held
+static void glob_release_locked(MGlob *g) {
+    if (--g->refcount == 0)
+        glob_destroy(g);
+}
+
+MGlob *glob_retain(MGlob *g) {
+    glob_lock();
+    g->refcount++;
+    glob_unlock();
+    return g;
+}
+
+void glob_release(MGlob *g) {
+    if (!g)
+        return;
+    glob_lock();
+    glob_release_locked(g);
+    glob_unlock();
+}
+
+// The compiled pattern, from the cache when it has been seen lately
+MGlob *glob_get(const char *pattern) {
+    size_t len = strlen(pattern);
+    unsigned long hash = hash_bytes(pattern, len, 0);
+
+    glob_lock();
+    for (size_t i = 0; i < GLOB_CACHE_SIZE; i++) {
+        MGlob *g = glob_cache[i].g;
+        if (g && g->hash == hash && g->src_len == len &&
+            memcmp(g->src, pattern, len) == 0) {
+            glob_cache[i].used = ++glob_cache_clock;
+            g->refcount++;
+            glob_unlock();
+            return g;
+        }
+    }
+    glob_unlock();
+
+    MGlob *g = glob_compile(pattern);
+    g->hash = hash;
+
+    glob_lock();
+    size_t victim = 0;
+    for (size_t i = 0; i < GLOB_CACHE_SIZE; i++) {
+        if (!glob_cache[i].g) {
+            victim = i;
+            break;
+        }
+        if (glob_cache[i].used < glob_cache[victim].used)
+            victim = i;
+    }
+    if (glob_cache[victim].g)
+        glob_release_locked(glob_cache[victim].g);
+    glob_cache[victim].g = g;
+    glob_cache[victim].used = ++glob_cache_clock;
+    g->refcount++;
+    glob_unlock();
+    return g;
+}
+
+void glob_cache_clear(void) {
+    glob_lock();
+    for (size_t i = 0; i < GLOB_CACHE_SIZE; i++) {
+        if (glob_cache[i].g)
+            glob_release_locked(glob_cache[i].g);
+        glob_cache[i].g = NULL;
+    }
+    glob_unlock();
+}
+
+typedef struct {
+    size_t pc;
+    size_t start;
+} GlobThread;
+
+typedef struct {
+    GlobThread *t;
+    size_t n;
+} GlobList;
+
+/*
+    For patterns with more ops than bits in a word. The positions in the
+    pattern that are still alive, in the order backtracking would have
+    tried them. A position is only kept the first time it is reached in a
+    step, what reaches it later can't do better.
+*/
+typedef struct {
+    MGlob *g;
+    int greedy;
+    GlobList cur, next;
+    size_t *mark; // step a position was last added in
+    size_t gen;
+    GlobThread *threads;
+} GlobVM;
+
+static void glob_vm_init(GlobVM *vm, MGlob *g, int greedy) {
+    size_t states = g->nops + 1;
+    vm->g = g;
+    vm->greedy = greedy;
+    vm->gen = 0;
+    vm->threads = (GlobThread *)mila_malloc(
+        states * (2 * sizeof(GlobThread) + sizeof(size_t)));
+    vm->cur.t = vm->threads;
+    vm->next.t = vm->cur.t + states;
+    vm->mark = (size_t *)(vm->next.t + states);
+    memset(vm->mark, 0, states * sizeof(size_t));
+}
+
+static void glob_vm_free(GlobVM *vm) { mila_free(vm->threads); }
+
+// Adds pc and what it reaches without taking a byte, a * can be skipped
+static void glob_vm_add(GlobVM *vm, GlobList *l, size_t pc, size_t start) {
+    while (vm->mark[pc] != vm->gen) {
+        vm->mark[pc] = vm->gen;
+        if (vm->g->ops[pc].kind != GLOB_STAR) {
+            l->t[l->n++] = (GlobThread){pc, start};
+            return;
+        }
+        if (!vm->greedy) {
+            // skipping comes first, `**` is one op so this doesn't nest
+            glob_vm_add(vm, l, pc + 1, start);
+            l->t[l->n++] = (GlobThread){pc, start};
+            return;
+        }
+        l->t[l->n++] = (GlobThread){pc, start};
+        pc++;
+    }
+}
+
+// Leftmost match of the pattern anywhere in s
+static int glob_vm_find(GlobVM *vm, const char *s, size_t n, size_t *start,
+                        size_t *end) {
+    MGlob *g = vm->g;
+    int found = 0;
+    vm->cur.n = 0;
+    vm->gen++;
+    for (size_t pos = 0;; pos++) {
+        if (!found) {
+            if (vm->cur.n == 0 && g->first >= 0) {
+                const char *hit =
+                    pos < n ? memchr(s + pos, g->first, n - pos) : NULL;
+                if (!hit)
+                    break;
+                pos = (size_t)(hit - s);
+            }
+            // a later start is tried after everything before it
+            glob_vm_add(vm, &vm->cur, 0, pos);
+        }
+        if (vm->cur.n == 0)
+            break;
+
+        vm->gen++;
+        vm->next.n = 0;
+        for (size_t i = 0; i < vm->cur.n; i++) {
+            GlobThread t = vm->cur.t[i];
+            const GlobOp *op = &g->ops[t.pc];
+            if (op->kind == GLOB_END) {
+                // what comes after this one would have been tried after it
+                found = 1;
+                *start = t.start;
+                *end = pos;
+                break;
+            }
+            if (pos < n && glob_op_has(op, (unsigned char)s[pos]))
+                glob_vm_add(vm, &vm->next,
+                            op->kind == GLOB_STAR ? t.pc : t.pc + 1, t.start);
+        }
+        GlobList tmp = vm->cur;
+        vm->cur = vm->next;
+        vm->next = tmp;
+        if (pos >= n)
+            break;
+    }
+    return found;
+}
+
+static inline uint64_t glob_bits_step(const MGlob *g, uint64_t cur,
+                                      unsigned char c) {
+    uint64_t t = cur & g->acc[c];
+    return glob_bits_closure(((t & ~g->star) << 1) | (t & g->star), g->star);
+}
+
+int glob_match(MGlob *g, const char *s, size_t n) {
+    if (g->never)
+        return 0;
+    if (g->literal)
+        return n == g->lit_len && memcmp(s, g->lit, n) == 0;
+
+    if (g->acc) {
+        uint64_t cur = g->init;
+        for (size_t pos = 0; pos < n && cur; pos++)
+            cur = glob_bits_step(g, cur, (unsigned char)s[pos]);
+        return (cur >> g->nops) & 1;
+    }
+
+    GlobVM vm;
+    glob_vm_init(&vm, g, 0);
+    vm.gen++;
+    vm.cur.n = 0;
+    glob_vm_add(&vm, &vm.cur, 0, 0);
+    for (size_t pos = 0; pos < n && vm.cur.n; pos++) {
+        unsigned char c = (unsigned char)s[pos];
+        vm.gen++;
+        vm.next.n = 0;
+        for (size_t i = 0; i < vm.cur.n; i++) {
+            GlobThread t = vm.cur.t[i];
+            const GlobOp *op = &g->ops[t.pc];
+            if (op->kind != GLOB_END && glob_op_has(op, c))
+                glob_vm_add(&vm, &vm.next,
+                            op->kind == GLOB_STAR ? t.pc : t.pc + 1, 0);
+        }
+        GlobList tmp = vm.cur;
+        vm.cur = vm.next;
+        vm.next = tmp;
+    }
+    int res = vm.mark[g->nops] == vm.gen;
+    glob_vm_free(&vm);
+    return res;
+}
+
+/*
+    One search through a string, for as many matches as the caller wants.
+    With the bit sets a pass from the back marks every byte a match can
+    start at, then each match is a scan forward from the next marked byte.
+    For the ops that take a variable number of bytes taking as few (or as
+    many) as they can first is the same as the match ending as soon (or as
+    late) as it can, so that scan finds the end backtracking would have.
+*/
+typedef struct {
+    MGlob *g;
+    const char *s;
+    size_t n;
+    int greedy;
+    uint64_t *starts; // bit p is set when a match can start at s + p
+    uint64_t inline_starts[GLOB_STARTS_INLINE];
+    GlobVM vm; // for patterns too long for the bit sets
+} GlobSearch;
+
+static void glob_search_init(GlobSearch *gs, MGlob *g, const char *s,
+                             size_t n, int greedy) {
+    gs->g = g;
+    gs->s = s;
+    gs->n = n;
+    gs->greedy = greedy;
+    gs->starts = NULL;
+    if (g->never || g->literal)
+        return;
+    if (!g->acc) {
+        glob_vm_init(&gs->vm, g, greedy);
+        return;
+    }
+    if (g->lead_any)
+        return;
+
+    size_t words = n / 64 + 1;
+    gs->starts = words <= GLOB_STARTS_INLINE
+                     ? gs->inline_starts
+                     : (uint64_t *)mila_malloc(words * sizeof(uint64_t));
+    memset(gs->starts, 0, words * sizeof(uint64_t));
+
+    // ops that can match what's left of the string from here on
+    uint64_t end = (uint64_t)1 << g->nops;
+    uint64_t live = glob_bits_back(end, g->star);
+    size_t pos = n;
+    while (1) {
+        if (live & 1)
+            gs->starts[pos / 64] |= (uint64_t)1 << (pos % 64);
+        if (pos-- == 0)
+            break;
+        uint64_t t = ((live >> 1) & ~g->star) | (live & g->star);
+        live = glob_bits_back((t & g->acc[(unsigned char)s[pos]]) | end,
+                              g->star);
+    }
+}
+
+static void glob_search_free(GlobSearch *gs) {
+    if (gs->g->never || gs->g->literal)
+        return;
+    if (!gs->g->acc)
+        glob_vm_free(&gs->vm);
+    else if (gs->starts && gs->starts != gs->inline_starts)
+        mila_free(gs->starts);
+}
+
+// The leftmost match at or after from
+static int glob_search_next(GlobSearch *gs, size_t from, size_t *start,
+                            size_t *len) {
+    MGlob *g = gs->g;
+    const char *s = gs->s;
+    size_t n = gs->n;
+    if (g->never)
+        return 0;
+    if (g->literal) {
+        size_t at = str_kernels()->find(s + from, n - from, g->lit, g->lit_len);
+        if (at == STR_NPOS)
+            return 0;
+        *start = from + at;
+        *len = g->lit_len;
+        return 1;
+    }
+    if (!g->acc) {
+        size_t end;
+        if (!glob_vm_find(&gs->vm, s + from, n - from, start, &end))
+            return 0;
+        *len = end - *start;
+        *start += from;
+        return 1;
+    }
+
+    // a pattern starting with * matches from anywhere if it matches at all
+    size_t pos = from;
+    if (!g->lead_any) {
+        size_t w = from / 64;
+        uint64_t bits = gs->starts[w] & (~(uint64_t)0 << (from % 64));
+        while (!bits) {
+            if (++w > n / 64)
+                return 0;
+            bits = gs->starts[w];
+        }
+        pos = w * 64 + (size_t)__builtin_ctzll(bits);
+    }
+
+    uint64_t cur = g->init, end = (uint64_t)1 << g->nops;
+    size_t last = cur & end ? pos : STR_NPOS;
+    if (last == STR_NPOS || gs->greedy) {
+        for (size_t i = pos; i < n && cur; i++) {
+            cur = glob_bits_step(g, cur, (unsigned char)s[i]);
+            if (cur & end) {
+                last = i + 1;
+                if (!gs->greedy)
+                    break;
+            }
+        }
+    }
+    if (last == STR_NPOS)
+        return 0;
+    *start = pos;
+    *len = last - pos;
+    return 1;
+}
+
+// Leftmost match in s, greedy picks how * and {} take their bytes
+int glob_find(MGlob *g, const char *s, size_t n, int greedy, size_t *start,
+              size_t *len) {
+    GlobSearch gs;
+    glob_search_init(&gs, g, s, n, greedy);
+    int res = glob_search_next(&gs, 0, start, len);
+    glob_search_free(&gs);
+    return res;
+}
+
+// Appends replacement with every $ that isn't after an odd number of
+// backslashes turned into the match, the backslashes are kept
+static void glob_append_dollar(strbuf *out, const char *replacement,
+                               const char *m, size_t m_len) {
+    const char *p = replacement;
+    const char *dollar;
+    while ((dollar = strchr(p, '$'))) {
+        sb_append(out, p, (size_t)(dollar - p));
+        size_t bs = 0;
+        for (const char *j = dollar; j > replacement && *(j - 1) == '\\'; j--)
+            bs++;
+        if (bs % 2 == 0)
+            sb_append(out, m, m_len);
+        else
+            sb_append(out, "$", 1);
+        p = dollar + 1;
+    }
+    sb_append_str(out, p);
+}
+
+/*
+    Replaces up to count matches (-1 for all of them), the caller frees the
+    result. With dollar set a $ in replacement stands for the match. After
+    an empty match the byte after it is kept and the search goes on past
+    it.
+*/
+char *glob_replace(MGlob *g, const char *s, const char *replacement,
+                   int count, int greedy, int dollar) {
+    strbuf out;
+    sb_init(&out);
+    size_t n = strlen(s), rep_len = strlen(replacement);
+    GlobSearch gs;
+    glob_search_init(&gs, g, s, n, greedy);
+    size_t cursor = 0;
+    int done = 0;
+
+    while (count == -1 || done < count) {
+        size_t m_start, m_len;
+        if (!glob_search_next(&gs, cursor, &m_start, &m_len))
+            break;
+        size_t m_end = m_start + m_len;
+
+        sb_append(&out, s + cursor, m_start - cursor);
+        if (dollar)
+            glob_append_dollar(&out, replacement, s + m_start, m_len);
+        else
+            sb_append(&out, replacement, rep_len);
+
+        done++;
+        if (m_len == 0) {
+            if (m_end == n) {
+                cursor = m_end;
+                break;
+            }
+            sb_append(&out, s + m_end, 1);
+            cursor = m_end + 1;
+        } else {
+            cursor = m_end;
+        }
+        if (cursor == n)
+            break;
+    }
+
+    glob_search_free(&gs);
+    sb_append(&out, s + cursor, n - cursor);
+    return sb_cstr(&out);
+}
+
+// A new reference to the pattern a string or compiled pattern stands for,
+// NULL for anything else
+MGlob *glob_from_value(Value *v) {
+    if (GET_TYPE(v) == T_STRING)
+        return glob_get(GET_STRING(v));
+    if (IS_GLOB(v))
+        return glob_retain((MGlob *)v->v);
+    return NULL;
+}
+
+Value *glob_value(MGlob *g) {
+    Value *res = vopaque_extra(g, NULL, MILA_LPREFIX "pattern");
+    val_set_table(res, glob_meta);
+    return res;
+}
+
+Value *glob_str(Value *self) {
+    return vstring_fmt("pattern(%s)", ((MGlob *)self->v)->src);
+}
+
+Value *glob_free(Value *self) {
+    glob_release((MGlob *)self->v);
+    return NULL;
+}
+
+// Compiled patterns don't change, copies share one
+Value *glob_copy(Value *self) {
+    return glob_value(glob_retain((MGlob *)self->v));
+}
+
+Value *native_pattern_compile(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 1 || GET_TYPE(argv[0]) != T_STRING)
+        return verror("pattern.compile(pattern): pattern must be a string");
+    return glob_value(glob_get(GET_STRING(argv[0])));
+}
+
+Value *native_pattern_match(Env *env, int argc, Value **argv) {
+    (void)env;
+    MGlob *g = argc == 2 ? glob_from_value(argv[0]) : NULL;
+    if (!g || GET_TYPE(argv[1]) != T_STRING) {
+        glob_release(g);
+        return verror("pattern.match(pattern, str): Expected a pattern and "
+                      "a string");
+    }
+    const char *s = GET_STRING(argv[1]);
+    int res = glob_match(g, s, strlen(s));
+    glob_release(g);
+    return vbool(res);
+}
@@ -0,0 +1,241 @@
+// This project is licensed under the GNU Affero General Public License
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "mila.h"
+#include "ml_dict.h"
+#include "ml_hash.h"
+
+// 0 until the first hash needs a seed
+unsigned long HASH_SEED = 0;
+
+// Mixes all bits of x into the high and the low end. Where unsigned long
+// is 32 bits (_WIN32, wasm) the result is truncated and different ints can
+// collide, lookups always compare the keys themselves
+static inline unsigned long hash_mix(unsigned long x) {
+    uint64_t h = x;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return (unsigned long)h;
+}
+
+static unsigned long hash_random_seed(void) {
+    uint64_t seed = 0;
+    FILE *f = fopen("/dev/urandom", "rb");
+    if (f) {
+        if (fread(&seed, sizeof(seed), 1, f) != 1)
+            seed = 0;
+        fclose(f);
+    }
+    // without urandom whatever differs between runs has to do
+    seed ^= (uint64_t)time(NULL) ^ ((uint64_t)get_process_id() << 32) ^
+            (uint64_t)(uintptr_t)&seed ^ (uint64_t)clock();
+    seed = hash_mix((unsigned long)seed);
+    return seed ? (unsigned long)seed : 5381;
+}
+
+unsigned long hash_get_seed(void) {
+    if (!HASH_SEED)
+        HASH_SEED = hash_random_seed();
+    return HASH_SEED;
+}
+
+// Dicts keep the seed they were made with, this only changes new ones
+void hash_set_seed(unsigned long seed) { HASH_SEED = seed; }
+
+// wyhash, reading the input a word at a time
+
+#define HASH_P0 0xa0761d6478bd642fULL
+#define HASH_P1 0xe7037ed1a0b428dbULL
+#define HASH_P2 0x8ebc6af09c88c6e3ULL
+#define HASH_P3 0x589965cc75374cc3ULL
+
+// 64x64 -> 128 bit multiply, low and high half folded together
+static inline uint64_t hash_mum(uint64_t a, uint64_t b) {
+#ifdef __SIZEOF_INT128__
+    __uint128_t r = (__uint128_t)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+    uint64_t ha = a >> 32, hb = b >> 32, la = (uint32_t)a, lb = (uint32_t)b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+    return lo ^ hi;
+#endif
+}
+
+static inline uint64_t hash_read8(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline uint64_t hash_read4(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static unsigned long hash_bytes(const void *data, size_t len,
+                                unsigned long seed) {
+    const unsigned char *p = (const unsigned char *)data;
+    uint64_t s = (uint64_t)seed, a, b;
+    s ^= hash_mum(s ^ HASH_P0, HASH_P1);
+    if (len <= 16) {
+        if (len >= 4) {
+            size_t mid = (len >> 3) << 2;
+            a = (hash_read4(p) << 32) | hash_read4(p + mid);
+            b = (hash_read4(p + len - 4) << 32) | hash_read4(p + len - 4 - mid);
+        } else if (len > 0) {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) |
+                p[len - 1];
+            b = 0;
+        } else
+            a = b = 0;
+    } else {
+        size_t i = len;
+        if (i > 48) {
+            uint64_t s1 = s, s2 = s;
+            do {
+                s = hash_mum(hash_read8(p) ^ HASH_P1, hash_read8(p + 8) ^ s);
+                s1 = hash_mum(hash_read8(p + 16) ^ HASH_P2,
+                              hash_read8(p + 24) ^ s1);
+                s2 = hash_mum(hash_read8(p + 32) ^ HASH_P3,
+                              hash_read8(p + 40) ^ s2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            s ^= s1 ^ s2;
+        }
+        while (i > 16) {
+            s = hash_mum(hash_read8(p) ^ HASH_P1, hash_read8(p + 8) ^ s);
+            p += 16;
+            i -= 16;
+        }
+        a = hash_read8(p + i - 16);
+        b = hash_read8(p + i - 8);
+    }
+    return (unsigned long)hash_mum(HASH_P1 ^ len,
+                                   hash_mum(a ^ HASH_P1, b ^ s));
+}
+
+static unsigned long hash_string(const char *str, unsigned long seed) {
+    return hash_bytes(str, strlen(str), seed);
+}
+
+// A string value's hash is kept in its header next to the seed it was
+// made with. Only filled in while no threads run, so the pair can't tear
+static unsigned long hash_mstring(MString *s, unsigned long seed) {
+    if (seed && s->hash_seed == seed)
+        return s->hash;
+    unsigned long h = hash_bytes(MSTRING_BYTES(s), s->len, seed);
+#ifndef ML_NO_THREADING
+    if (mila_refs_shared)
+        return h;
+#endif
+    s->hash = h;
+    s->hash_seed = seed;
+    return h;
+}
+
+// Ints, uints, floats, bools and strings, hashed by value
+static unsigned long hash_scalar(Value *val, unsigned long seed) {
+    switch (val->type) {
+    case T_STRING:
+        return hash_mstring(GET_MSTRING(val), seed);
+    case T_FLOAT: {
+        double f = GET_FLOAT(val);
+        uint64_t bits = 0;
+        if (f == 0.0)
+            f = 0.0; // -0.0 and 0.0 hash the same
+        if (f == f)  // so does every NaN
+            memcpy(&bits, &f, sizeof(bits));
+        return hash_mix((unsigned long)bits ^ seed ^ T_FLOAT);
+    }
+    case T_BOOL:
+        return hash_mix((GET_BOOL(val) ? 1 : 0) ^ seed ^ T_BOOL);
+    default: // T_INT and T_UINT share the bits
+        return hash_mix(GET_UINTEGER(val) ^ seed);
+    }
+}
+
+// Containers deeper than this hash as a constant, which also ends cycles
+#define HASH_MAX_DEPTH 32
+
+typedef struct {
+    uint64_t hash;
+    int depth;
+} HashWalk;
+
+static unsigned long hash_value_at(Value *val, int depth);
+
+static void hash_visit(Value **slot, void *ctx) {
+    HashWalk *walk = (HashWalk *)ctx;
+    walk->hash = hash_mum(walk->hash ^ hash_value_at(*slot, walk->depth),
+                          HASH_P2);
+}
+
+static unsigned long hash_value_at(Value *val, int depth) {
+    unsigned long seed = hash_get_seed();
+    if (!val)
+        return hash_mix(seed ^ T_NULL);
+    if (val->refcount == ML_WEAK_REF_TRIGGER)
+        return hash_mix((unsigned long)(uintptr_t)val->v ^ seed);
+    switch (val->type) {
+    case T_INT:
+    case T_UINT:
+    case T_FLOAT:
+    case T_BOOL:
+    case T_STRING:
+        return hash_scalar(val, seed);
+    case T_NULL:
+    case T_NONE:
+        return hash_mix(seed ^ val->type);
+    case T_ERROR:
+        return hash_string(GET_ERROR_MESSAGE(val), seed ^ T_ERROR);
+    default:
+        break;
+    }
+    if (depth >= HASH_MAX_DEPTH)
+        return hash_mix(seed ^ depth);
+
+    uint64_t type = hash_string(GET_TYPENAME(val), seed);
+    if (val->type_name && (strcmp(val->type_name, MILA_LPREFIX "dict") == 0 ||
+                           strcmp(val->type_name, MILA_LPREFIX "set") == 0)) {
+        // the same pairs hash the same whatever order they were set in,
+        // sets have a NULL for every value
+        uint64_t h = type;
+        ITERATE_DICT((Dict *)val->v) {
+            h += hash_mum(hash_value_at(entry->key, depth + 1) ^ HASH_P1,
+                          hash_value_at(entry->value, depth + 1) ^ HASH_P2);
+        }
+        return hash_mix((unsigned long)h);
+    }
+    visit_method visit = (visit_method)GET_METHOD(val, UMethodVisit);
+    if (visit) {
+        HashWalk walk = {.hash = type, .depth = depth + 1};
+        visit(val, hash_visit, &walk);
+        return hash_mix((unsigned long)walk.hash);
+    }
+    if (GET_METHOD(val, UMethodToRepr) || GET_METHOD(val, UMethodToString)) {
+        char *repr = as_c_string_repr(val);
+        unsigned long h = hash_string(repr, seed);
+        mila_free(repr);
+        return h;
+    }
+    // functions, natives and plain opaques are only equal to themselves
+    return hash_mix((unsigned long)(uintptr_t)val->v ^ (unsigned long)type);
+}
+
+// Structural hash, no repr is built for lists, dicts and scalars
+FN_UNUSED static unsigned long hash_value(Value *val) {
+    return hash_value_at(val, 0);
+}
@@ -0,0 +1,371 @@
+// This project is licensed under the GNU Affero General Public License
+#pragma once
+
+#include <string.h>
+
+#include "mila.h"
+#include "ml_heap.h"
+#include "ml_primitives.h"
+
+#define IS_HEAP(val)                                                           \
+    (GET_TYPE(val) == T_OPAQUE && (val)->method_table == heap_meta &&          \
+     (val)->v)
+
+#define HEAP_NODE_KEY(node) ((node)->key ? (node)->key : (node)->item)
+
+// Whether a goes above b
+static inline int heap_before(Heap *heap, HeapNode *a, HeapNode *b) {
+    int cmp = val_order_cmp(HEAP_NODE_KEY(a), HEAP_NODE_KEY(b));
+    return heap->max ? cmp > 0 : cmp < 0;
+}
+
+static void heap_sift_up(Heap *heap, size_t i) {
+    HeapNode node = heap->nodes[i];
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!heap_before(heap, &node, &heap->nodes[parent]))
+            break;
+        heap->nodes[i] = heap->nodes[parent];
+        i = parent;
+    }
+    heap->nodes[i] = node;
+}
+
+static void heap_sift_down(Heap *heap, size_t i) {
+    HeapNode node = heap->nodes[i];
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= heap->size)
+            break;
+        if (child + 1 < heap->size &&
+            heap_before(heap, &heap->nodes[child + 1], &heap->nodes[child]))
+            child++;
+        if (!heap_before(heap, &heap->nodes[child], &node))
+            break;
+        heap->nodes[i] = heap->nodes[child];
+        i = child;
+    }
+    heap->nodes[i] = node;
+}
+
+static int heap_reserve(Heap *heap, size_t capacity) {
+    if (capacity <= heap->capacity)
+        return 1;
+    size_t grown = heap->capacity ? heap->capacity * 2 : 8;
+    if (grown < capacity)
+        grown = capacity;
+    HeapNode *nodes =
+        (HeapNode *)realloc(heap->nodes, grown * sizeof(HeapNode));
+    if (!nodes)
+        return 0;
+    heap->nodes = nodes;
+    heap->capacity = grown;
+    return 1;
+}
+
+Heap *heap_create(Value *key_fn, int max) {
+    Heap *heap = (Heap *)mila_malloc(sizeof(Heap));
+    if (!heap)
+        return NULL;
+    heap->nodes = NULL;
+    heap->size = heap->capacity = 0;
+    heap->key_fn = key_fn ? val_retain(key_fn) : NULL;
+    heap->max = max;
+    heap->refcount = 1;
+    return heap;
+}
+
+Heap *heap_clone(Heap *heap) {
+    Heap *copy = heap_create(heap->key_fn, heap->max);
+    if (!copy || !heap_reserve(copy, heap->size)) {
+        heap_destroy(copy);
+        return NULL;
+    }
+    for (size_t i = 0; i < heap->size; i++) {
+        HeapNode *node = &heap->nodes[i];
+        copy->nodes[i] = (HeapNode){
+            .item = val_copy(node->item),
+            .key = node->key ? val_copy(node->key) : NULL};
+    }
+    copy->size = heap->size;
+    return copy;
+}
+
+void heap_destroy(Heap *heap) {
+    if (!heap)
+        return;
+    for (size_t i = 0; i < heap->size; i++) {
+        val_release(heap->nodes[i].item);
+        val_release(heap->nodes[i].key);
+    }
+    val_release(heap->key_fn);
+    free(heap->nodes);
+    mila_free(heap);
+}
+
+// Gives self storage of its own before it is changed or its items leak out
+void heap_unshare(Value *self) {
+    Heap *heap = (Heap *)self->v;
+    if (heap->refcount <= 1)
+        return;
+    Heap *own = heap_clone(heap);
+    if (!own)
+        return;
+    self->v = (void *)own;
+    if (ML_REF_DEC(heap) == 0)
+        heap_destroy(heap);
+}
+
+Value *heap_new(Heap *heap) {
+    Value *res = vopaque_extra(heap, NULL, MILA_LPREFIX "heap");
+    val_set_table(res, heap_meta);
+    return res;
+}
+
+Value *heap_str(Value *self) {
+    Heap *heap = (Heap *)self->v;
+    return vstring_fmt("heap(<%zu items, %s>)", heap->size,
+                       heap->max ? "max" : "min");
+}
+
+Value *heap_free(Value *self) {
+    Heap *heap = (Heap *)self->v;
+    if (ML_REF_DEC(heap) == 0)
+        heap_destroy(heap);
+    return NULL;
+}
+
+Value *heap_copy(Value *self) {
+    Heap *heap = (Heap *)self->v;
+    if (val_copy_shares(self))
+        ML_REF_INC(heap);
+    else {
+        val_copy_depth++;
+        heap = heap_clone(heap);
+        val_copy_depth--;
+        if (!heap)
+            return verror("copy(heap): Couldn't copy the heap");
+    }
+    return heap_new(heap);
+}
+
+void heap_visit(Value *self, value_visitor fn, void *ctx) {
+    Heap *heap = (Heap *)self->v;
+    for (size_t i = 0; i < heap->size; i++) {
+        fn(&heap->nodes[i].item, ctx);
+        if (heap->nodes[i].key)
+            fn(&heap->nodes[i].key, ctx);
+    }
+    if (heap->key_fn)
+        fn(&heap->key_fn, ctx);
+}
+
+// The node for an item, with the key function already applied. Lists that
+// are their own key are copied so changing them later can't reorder the heap
+static Value *heap_make_node(Env *env, Heap *heap, Value *item,
+                             HeapNode *node, const char *who) {
+    Value *key = NULL;
+    if (heap->key_fn) {
+        key = call_function_with(env, heap->key_fn, val_retain(item), NULL);
+        if (!key)
+            return verror("%s: The key function returned nothing", who);
+        if (IS_ERROR(key))
+            return key;
+    } else if (item->method_table == list_meta)
+        key = val_copy(item);
+    Value *ordered_by = key ? key : item;
+    if (!val_orderable(ordered_by)) {
+        Value *err = verror("%s: Can't order %s keys, only numbers, strings "
+                            "and lists of those",
+                            who, GET_TYPENAME(ordered_by));
+        val_release(key);
+        return err;
+    }
+    *node = (HeapNode){.item = val_retain(item), .key = key};
+    return NULL;
+}
+
+static Value *heap_push_node(Heap *heap, HeapNode *node) {
+    if (!heap_reserve(heap, heap->size + 1)) {
+        val_release(node->item);
+        val_release(node->key);
+        return verror("heap.push(h, ...items): Out of memory");
+    }
+    heap->nodes[heap->size++] = *node;
+    heap_sift_up(heap, heap->size - 1);
+    return NULL;
+}
+
+// Takes the top node out, the caller owns its item and key
+static HeapNode heap_pop_node(Heap *heap) {
+    HeapNode top = heap->nodes[0];
+    heap->nodes[0] = heap->nodes[--heap->size];
+    if (heap->size > 0)
+        heap_sift_down(heap, 0);
+    return top;
+}
+
+static Value *heap_parse_options(int argc, Value **argv, Value **key_fn,
+                                 int *max, const char *who) {
+    *key_fn = NULL;
+    *max = 0;
+    if (argc > 0 && GET_TYPE(argv[0]) != T_NULL) {
+        if (GET_TYPE(argv[0]) != T_FUNCTION && GET_TYPE(argv[0]) != T_NATIVE)
+            return verror("%s: key must be a function or null", who);
+        *key_fn = argv[0];
+    }
+    if (argc > 1)
+        *max = is_truthy(argv[1]);
+    return NULL;
+}
+
+Value *native_heap_new(Env *env, int argc, Value **argv) {
+    (void)env;
+    Value *key_fn;
+    int max;
+    if (argc > 2)
+        return verror("heap(key, max): Expected at most two arguments");
+    Value *err = heap_parse_options(argc, argv, &key_fn, &max, "heap(key, max)");
+    if (err)
+        return err;
+    Heap *heap = heap_create(key_fn, max);
+    if (!heap)
+        return verror("heap(key, max): Couldn't make a heap");
+    return heap_new(heap);
+}
+
+// Builds the heap bottom up, O(n) instead of n pushes
+Value *native_heap_from(Env *env, int argc, Value **argv) {
+    Value *key_fn;
+    int max;
+    if (argc < 1 || argc > 3 || argv[0]->method_table != list_meta)
+        return verror("heap.from(items, key, max): Expected a list");
+    Value *err = heap_parse_options(argc - 1, argv + 1, &key_fn, &max,
+                                    "heap.from(items, key, max)");
+    if (err)
+        return err;
+    LinkedList *items = (LinkedList *)argv[0]->v;
+    Heap *heap = heap_create(key_fn, max);
+    if (!heap || !heap_reserve(heap, items->size)) {
+        heap_destroy(heap);
+        return verror("heap.from(items, key, max): Couldn't make a heap");
+    }
+    for (size_t i = 0; i < items->size; i++) {
+        err = heap_make_node(env, heap, items->items[i],
+                             &heap->nodes[heap->size],
+                             "heap.from(items, key, max)");
+        if (err) {
+            heap_destroy(heap);
+            return err;
+        }
+        heap->size++;
+    }
+    for (size_t i = heap->size / 2; i-- > 0;)
+        heap_sift_down(heap, i);
+    return heap_new(heap);
+}
+
+Value *native_heap_push(Env *env, int argc, Value **argv) {
+    if (argc < 1 || !IS_HEAP(argv[0]))
+        return verror("heap.push(h, ...items): Expected a heap");
+    if (IS_FROZEN(argv[0]))
+        return vtagged_error(E_CONST_ERROR,
+                             "heap.push(h, ...items): heap is frozen");
+    heap_unshare(argv[0]);
+    Heap *heap = (Heap *)argv[0]->v;
+    for (int i = 1; i < argc; i++) {
+        HeapNode node;
+        Value *err = heap_make_node(env, heap, argv[i], &node,
+                                    "heap.push(h, ...items)");
+        if (!err)
+            err = heap_push_node(heap, &node);
+        if (err)
+            return err;
+    }
+    return vnull();
+}
+
+Value *native_heap_pop(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 1 || !IS_HEAP(argv[0]))
+        return verror("heap.pop(h): Expected a heap");
+    if (IS_FROZEN(argv[0]))
+        return vtagged_error(E_CONST_ERROR, "heap.pop(h): heap is frozen");
+    heap_unshare(argv[0]);
+    Heap *heap = (Heap *)argv[0]->v;
+    if (heap->size == 0)
+        return vnull();
+    HeapNode top = heap_pop_node(heap);
+    val_release(top.key);
+    return top.item;
+}
+
+Value *native_heap_peek(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 1 || !IS_HEAP(argv[0]))
+        return verror("heap.peek(h): Expected a heap");
+    Heap *heap = (Heap *)argv[0]->v;
+    if (heap->size == 0)
+        return vnull();
+    if (val_is_mutable(heap->nodes[0].item) && HEAP_SHARED(argv[0])) {
+        heap_unshare(argv[0]);
+        heap = (Heap *)argv[0]->v;
+    }
+    return val_retain(heap->nodes[0].item);
+}
+
+// Push then pop in one sift, keeps a heap of the k best items at size k
+Value *native_heap_pushpop(Env *env, int argc, Value **argv) {
+    if (argc != 2 || !IS_HEAP(argv[0]))
+        return verror("heap.pushpop(h, item): Expected a heap and an item");
+    if (IS_FROZEN(argv[0]))
+        return vtagged_error(E_CONST_ERROR,
+                             "heap.pushpop(h, item): heap is frozen");
+    Heap *heap = (Heap *)argv[0]->v;
+    HeapNode node;
+    Value *err =
+        heap_make_node(env, heap, argv[1], &node, "heap.pushpop(h, item)");
+    if (err)
+        return err;
+    // the item would come straight back out, the heap stays as it is
+    if (heap->size == 0 || !heap_before(heap, &heap->nodes[0], &node)) {
+        val_release(node.key);
+        return node.item;
+    }
+    heap_unshare(argv[0]);
+    heap = (Heap *)argv[0]->v;
+    HeapNode top = heap->nodes[0];
+    heap->nodes[0] = node;
+    heap_sift_down(heap, 0);
+    val_release(top.key);
+    return top.item;
+}
+
+Value *native_heap_len(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 1 || !IS_HEAP(argv[0]))
+        return verror("heap.len(h): Expected a heap");
+    return vint((long)((Heap *)argv[0]->v)->size);
+}
+
+// The items in the order they would be popped, the heap is left as it is
+Value *native_heap_to_list(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 1 || !IS_HEAP(argv[0]))
+        return verror("heap.to_list(h): Expected a heap");
+    Heap *heap = (Heap *)argv[0]->v;
+    // pops on a copy of the node array only move pointers around
+    Heap order = *heap;
+    order.nodes = (HeapNode *)mila_malloc(heap->size * sizeof(HeapNode) + 1);
+    if (!order.nodes)
+        return verror("heap.to_list(h): Out of memory");
+    memcpy(order.nodes, heap->nodes, heap->size * sizeof(HeapNode));
+    LinkedList *list = ll_create();
+    ll_reserve(list, heap->size);
+    while (order.size > 0)
+        ll_append(list, val_copy(heap_pop_node(&order).item));
+    mila_free(order.nodes);
+    Value *res = vopaque_extra(list, NULL, MILA_LPREFIX "list");
+    val_set_table(res, list_meta);
+    return res;
+}
@@ -6,6 +6,7 @@
 #include "ml_ll.c"
 #include "ml_primitives.h"
 #include "ml_string.c"
+#include "ml_typedarray.h"
 #include <ctype.h>
 
 Value *native_list_append(Env *, int, Value **);
@@ -13,59 +14,66 @@ Value *parse_dict_unified(Src *json, int parse_fn);
 
 // turn \xXX to \uXXXX for JSON valid escapes
 // because why should JSON respect hex escapes?
-void ascii_to_unicode(char **buffer, const char *input) {
+void ascii_to_unicode(strbuf *out, const char *input, size_t len) {
     const uint8_t *text = (const uint8_t *)input;
 
-    for (size_t i = 0; i < strlen(input); ++i) {
+    for (size_t i = 0; i < len; ++i) {
         uint8_t byte = text[i];
 
         if (byte < 0x80) {
             switch (byte) {
             case '\b':
-                malloc_sprintf(buffer, "\\b");
+                sb_append(out, "\\b", 2);
                 break;
             case '\f':
-                malloc_sprintf(buffer, "\\f");
+                sb_append(out, "\\f", 2);
                 break;
             case '\n':
-                malloc_sprintf(buffer, "\\n");
+                sb_append(out, "\\n", 2);
                 break;
             case '\r':
-                malloc_sprintf(buffer, "\\r");
+                sb_append(out, "\\r", 2);
                 break;
             case '\t':
-                malloc_sprintf(buffer, "\\t");
+                sb_append(out, "\\t", 2);
                 break;
             case '"':
-                malloc_sprintf(buffer, "\\\"");
+                sb_append(out, "\\\"", 2);
                 break;
             case '\\':
-                malloc_sprintf(buffer, "\\\\");
+                sb_append(out, "\\\\", 2);
                 break;
             default:
-                if (isprint(byte))
-                    malloc_sprintf(buffer, "%c", byte);
-                else
-                    malloc_sprintf(buffer, "\\u%04X", byte);
+                if (isprint(byte)) {
+                    // copy the whole run of plain characters at once
+                    size_t run = i + 1;
+                    while (run < len && text[run] < 0x80 &&
+                           isprint(text[run]) && text[run] != '"' &&
+                           text[run] != '\\')
+                        run++;
+                    sb_append(out, input + i, run - i);
+                    i = run - 1;
+                } else
+                    sb_appendf(out, "\\u%04X", byte);
             }
-        } else if ((byte & 0xE0) == 0xC0 && i + 1 < strlen(input)) {
+        } else if ((byte & 0xE0) == 0xC0 && i + 1 < len) {
             uint32_t codepoint = ((byte & 0x1F) << 6) | (text[1 + i] & 0x3F);
-            malloc_sprintf(buffer, "\\u%04X", codepoint);
+            sb_appendf(out, "\\u%04X", codepoint);
             i++;
-        } else if ((byte & 0xF0) == 0xE0 && i + 2 < strlen(input)) {
+        } else if ((byte & 0xF0) == 0xE0 && i + 2 < len) {
             uint32_t codepoint = ((byte & 0x0F) << 12) |
                                  ((text[1 + i] & 0x3F) << 6) |
                                  (text[2 + i] & 0x3F);
-            malloc_sprintf(buffer, "\\u%04X", codepoint);
+            sb_appendf(out, "\\u%04X", codepoint);
             i += 2;
-        } else if ((byte & 0xF8) == 0xF0 && i + 3 < strlen(input)) {
+        } else if ((byte & 0xF8) == 0xF0 && i + 3 < len) {
             uint32_t codepoint =
                 ((byte & 0x07) << 18) | ((text[1 + i] & 0x3F) << 12) |
                 ((text[2 + i] & 0x3F) << 6) | (text[3 + i] & 0x3F);
-            malloc_sprintf(buffer, "\\u%04X", codepoint);
+            sb_appendf(out, "\\u%04X", codepoint);
             i += 3;
         } else {
-            malloc_sprintf(buffer, "\\u%04X", byte);
+            sb_appendf(out, "\\u%04X", byte);
         }
     }
 }
@@ -293,97 +301,121 @@ Value *parse_json(Src *s) { return parse_expr_unified(s, 0); }
 
 Value *parse_mjson(Src *s) { return parse_expr_unified(s, 1); }
 
-// Serialize unified include_fn flag
-// TODO: swap result from string to a string builder to avoid contineous alloc
-char *_mila_to_json_unified(Value *v, int level, int include_fn) {
-    char *result = NULL;
-
+// Serialize unified include_fn flag, appends to out
+void _mila_to_json_unified(strbuf *out, Value *v, int level, int include_fn) {
     if (!v) {
-        malloc_sprintf(&result, "null");
-        return result;
+        sb_append(out, "null", 4);
+        return;
     }
 
     switch (GET_TYPE(v)) {
     case T_NULL:
-        malloc_sprintf(&result, "null");
+        sb_append(out, "null", 4);
         break;
     case T_BOOL:
-        malloc_sprintf(&result, GET_BOOL(v) ? "true" : "false");
+        sb_append_str(out, GET_BOOL(v) ? "true" : "false");
         break;
     case T_INT:
     case T_UINT:
-        malloc_sprintf(&result, "%ld", GET_INTEGER(v));
+        sb_appendf(out, "%ld", GET_INTEGER(v));
         break;
     case T_FLOAT: {
         double d = GET_FLOAT(v);
-        malloc_sprintf(&result, d == (long long)d ? "%.1f" : "%.17g", d);
+        sb_appendf(out, d == (long long)d ? "%.1f" : "%.17g", d);
         break;
     }
     case T_STRING: {
-        malloc_sprintf(&result, "\"");
-        ascii_to_unicode(&result, GET_STRING(v));
-        malloc_sprintf(&result, "\"");
+        sb_append(out, "\"", 1);
+        ascii_to_unicode(out, GET_STRING_BYTES(v), GET_STRING_LEN(v));
+        sb_append(out, "\"", 1);
         break;
     }
     case T_OPAQUE:
     case T_OWNED_OPAQUE: {
         if (v->type_name && strcmp(v->type_name, MILA_LPREFIX "list") == 0) {
             LinkedList *list = (LinkedList *)GET_OPAQUE(v);
-            malloc_sprintf(&result, "[\n");
+            sb_append(out, "[\n", 2);
             for (size_t i = 0; i < list->size; ++i) {
-                char *item_json = _mila_to_json_unified(ll_get(list, i),
-                                                        level + 1, include_fn);
-                malloc_sprintf(&result, "%*s%s%s", level * 2, "", item_json,
-                               i < list->size - 1 ? ",\n" : "");
-                mila_free(item_json);
+                sb_appendf(out, "%*s", level * 2, "");
+                _mila_to_json_unified(out, list->items[i], level + 1,
+                                      include_fn);
+                if (i < list->size - 1)
+                    sb_append(out, ",\n", 2);
             }
-            malloc_sprintf(&result, "\n%*s]", (level - 1) * 2, "");
+            sb_appendf(out, "\n%*s]", (level - 1) * 2, "");
         } else if (v->type_name &&
                    strcmp(v->type_name, MILA_LPREFIX "dict") == 0) {
             Dict *dict = (Dict *)GET_OPAQUE(v);
-            malloc_sprintf(&result, "{\n");
+            sb_append(out, "{\n", 2);
             int first = 1;
-            for (size_t i = 0; i < dict->capacity; ++i) {
-                for (DictEntry *entry = dict->buckets[i]; entry;
-                     entry = entry->next) {
-                    if (!first)
-                        malloc_sprintf(&result, ",\n");
-                    first = 0;
-                    char *val_json = _mila_to_json_unified(
-                        entry->value, level + 1, include_fn);
-                    malloc_sprintf(&result, "%*s%s: %s", level * 2, "",
-                                   entry->key, val_json);
-                    mila_free(val_json);
-                }
+            ITERATE_DICT(dict) {
+                if (!first)
+                    sb_append(out, ",\n", 2);
+                first = 0;
+                sb_appendf(out, "%*s", level * 2, "");
+                if (entry->by_repr)
+                    sb_append_str(out, GET_STRING(entry->key));
+                else
+                    _mila_to_json_unified(out, entry->key, level + 1,
+                                          include_fn);
+                sb_append(out, ": ", 2);
+                _mila_to_json_unified(out, entry->value, level + 1,
+                                      include_fn);
             }
-            malloc_sprintf(&result, "\n%*s}", (level - 1) * 2, "");
+            sb_appendf(out, "\n%*s}", (level - 1) * 2, "");
+        } else if (v->type_name &&
+                   strcmp(v->type_name, MILA_LPREFIX "set") == 0) {
+            // sets go out as a list of their members
+            Dict *members = (Dict *)GET_OPAQUE(v);
+            sb_append(out, "[\n", 2);
+            int first = 1;
+            ITERATE_DICT(members) {
+                if (!first)
+                    sb_append(out, ",\n", 2);
+                first = 0;
+                sb_appendf(out, "%*s", level * 2, "");
+                // members that aren't scalars are kept as the value
+                _mila_to_json_unified(out,
+                                      entry->value ? entry->value : entry->key,
+                                      level + 1, include_fn);
+            }
+            sb_appendf(out, "\n%*s]", (level - 1) * 2, "");
+        } else if (v->method_table == tarray_meta && v->v) {
+            TypedArray *arr = (TypedArray *)GET_OPAQUE(v);
+            char elem[32];
+            sb_append(out, "[", 1);
+            for (size_t i = 0; i < arr->len; ++i) {
+                int n = tarray_format_elem(elem, sizeof(elem), arr, i);
+                if (i)
+                    sb_append(out, ", ", 2);
+                sb_append(out, elem, (size_t)n);
+            }
+            sb_append(out, "]", 1);
         } else {
-            malloc_sprintf(&result, "null");
+            sb_append(out, "null", 4);
         }
         break;
     }
     case T_FUNCTION: {
         if (include_fn) {
             FunctionV *fn = GET_FUNCTION(v);
-            char *args = mila_strdup("");
+            sb_append(out, "fn(", 3);
             for (int i = 0; fn->params[i]; ++i) {
-                malloc_sprintf(&args, "%s%s%s", args, fn->params[i],
-                               fn->defaults[i] ? fn->defaults[i] : "");
+                sb_append_str(out, fn->params[i]);
+                if (fn->defaults[i])
+                    sb_append_str(out, fn->defaults[i]);
                 if (fn->params[i + 1])
-                    malloc_sprintf(&args, "%s,", args);
+                    sb_append(out, ",", 1);
             }
-            malloc_sprintf(&result, "fn(%s) %s", args, fn->body_src);
-            free(args);
+            sb_appendf(out, ") %s", fn->body_src);
         } else {
-            malloc_sprintf(&result, "null");
+            sb_append(out, "null", 4);
         }
         break;
     }
     default:
-        malloc_sprintf(&result, "null");
+        sb_append(out, "null", 4);
     }
-
-    return result;
 }
 
 // File write unified
@@ -410,10 +442,13 @@ long _io_mila_to_json_unified(FILE *file, Value *v, int level, int include_fn) {
         break;
     }
     case T_STRING: {
-        char *escaped = NULL;
-        ascii_to_unicode(&escaped, GET_STRING(v));
-        result += fprintf(file, "\"%s\"", escaped);
-        mila_free(escaped);
+        strbuf escaped;
+        sb_init(&escaped);
+        ascii_to_unicode(&escaped, GET_STRING_BYTES(v), GET_STRING_LEN(v));
+        result += fprintf(file, "\"");
+        result += (long)fwrite(escaped.buf, 1, escaped.len, file);
+        result += fprintf(file, "\"");
+        sb_free(&escaped);
         break;
     }
     case T_OPAQUE:
@@ -423,7 +458,7 @@ long _io_mila_to_json_unified(FILE *file, Value *v, int level, int include_fn) {
             result += fprintf(file, "[\n");
             for (size_t i = 0; i < list->size; ++i) {
                 result += fprintf(file, "%*s", level * 2, "");
-                result += _io_mila_to_json_unified(file, ll_get(list, i),
+                result += _io_mila_to_json_unified(file, list->items[i],
                                                    level + 1, include_fn);
                 if (i < list->size - 1)
                     result += fprintf(file, ",\n");
@@ -434,19 +469,45 @@ long _io_mila_to_json_unified(FILE *file, Value *v, int level, int include_fn) {
             Dict *dict = (Dict *)GET_OPAQUE(v);
             result += fprintf(file, "{\n");
             int first = 1;
-            for (size_t i = 0; i < dict->capacity; ++i) {
-                for (DictEntry *entry = dict->buckets[i]; entry;
-                     entry = entry->next) {
-                    if (!first)
-                        result += fprintf(file, ",\n");
-                    first = 0;
-                    result +=
-                        fprintf(file, "%*s%s: ", level * 2, "", entry->key);
-                    result += _io_mila_to_json_unified(file, entry->value,
+            ITERATE_DICT(dict) {
+                if (!first)
+                    result += fprintf(file, ",\n");
+                first = 0;
+                result += fprintf(file, "%*s", level * 2, "");
+                if (entry->by_repr)
+                    result += fprintf(file, "%s", GET_STRING(entry->key));
+                else
+                    result += _io_mila_to_json_unified(file, entry->key,
                                                        level + 1, include_fn);
-                }
+                result += fprintf(file, ": ");
+                result += _io_mila_to_json_unified(file, entry->value,
+                                                   level + 1, include_fn);
             }
             result += fprintf(file, "\n%*s}", (level - 1) * 2, "");
+        } else if (v->type_name &&
+                   strcmp(v->type_name, MILA_LPREFIX "set") == 0) {
+            Dict *members = (Dict *)GET_OPAQUE(v);
+            result += fprintf(file, "[\n");
+            int first = 1;
+            ITERATE_DICT(members) {
+                if (!first)
+                    result += fprintf(file, ",\n");
+                first = 0;
+                result += fprintf(file, "%*s", level * 2, "");
+                result += _io_mila_to_json_unified(
+                    file, entry->value ? entry->value : entry->key, level + 1,
+                    include_fn);
+            }
+            result += fprintf(file, "\n%*s]", (level - 1) * 2, "");
+        } else if (v->method_table == tarray_meta && v->v) {
+            TypedArray *arr = (TypedArray *)GET_OPAQUE(v);
+            char elem[32];
+            result += fprintf(file, "[");
+            for (size_t i = 0; i < arr->len; ++i) {
+                tarray_format_elem(elem, sizeof(elem), arr, i);
+                result += fprintf(file, "%s%s", i ? ", " : "", elem);
+            }
+            result += fprintf(file, "]");
         } else {
             result += fprintf(file, "null");
         }
@@ -475,9 +536,19 @@ long _io_mila_to_json_unified(FILE *file, Value *v, int level, int include_fn) {
     return result;
 }
 
-char *mila_to_json(Value *v) { return _mila_to_json_unified(v, 1, 0); }
+char *mila_to_json(Value *v) {
+    strbuf out;
+    sb_init(&out);
+    _mila_to_json_unified(&out, v, 1, 0);
+    return sb_cstr(&out);
+}
 
-char *mila_to_mjson(Value *v) { return _mila_to_json_unified(v, 1, 1); }
+char *mila_to_mjson(Value *v) {
+    strbuf out;
+    sb_init(&out);
+    _mila_to_json_unified(&out, v, 1, 1);
+    return sb_cstr(&out);
+}
 
 long mila_to_json_io(FILE *file, Value *v) {
     return _io_mila_to_json_unified(file, v, 1, 0);
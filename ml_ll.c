@@ -7,57 +7,57 @@
 #include <stddef.h>
 #include <stdlib.h>
 
-typedef struct LLNode {
-    Value *value;
-    struct LLNode *next;
-} LLNode;
-
+// Kept the LinkedList name for the C API, items are a contiguous vector
 typedef struct LinkedList {
-    LLNode *head;
-    LLNode *tail;
+    Value **items;
     size_t size;
+    size_t capacity;
+    size_t version; // bumped whenever items shift, checked by iterators
+    MRefCount refcount; // list values sharing this storage, see list_unshare
 } LinkedList;
 
+#define LL_MIN_CAPACITY 8
+
 LinkedList *ll_create() {
     LinkedList *list = malloc(sizeof(LinkedList));
     if (!list)
         return NULL;
-    list->head = NULL;
-    list->tail = NULL;
+    list->items = NULL;
     list->size = 0;
+    list->capacity = 0;
+    list->version = 0;
+    list->refcount = 1;
     return list;
 }
 
 void ll_free(LinkedList *list) {
     if (!list)
         return;
-    LLNode *node = list->head;
-    while (node) {
-        val_release(node->value);
-        LLNode *next = node->next;
-        free(node);
-        node = next;
-    }
+    for (size_t i = 0; i < list->size; i++)
+        val_release(list->items[i]);
+    free(list->items);
     free(list);
 }
 
+// Makes room for at least capacity items, returns 0 when out of memory
+int ll_reserve(LinkedList *list, size_t capacity) {
+    if (capacity <= list->capacity)
+        return 1;
+    size_t new_capacity = list->capacity ? list->capacity : LL_MIN_CAPACITY;
+    while (new_capacity < capacity)
+        new_capacity *= 2;
+    Value **items = realloc(list->items, new_capacity * sizeof(Value *));
+    if (!items)
+        return 0;
+    list->items = items;
+    list->capacity = new_capacity;
+    return 1;
+}
+
 void ll_append(LinkedList *list, Value *val) {
-    if (!list)
+    if (!list || !ll_reserve(list, list->size + 1))
         return;
-    LLNode *node = malloc(sizeof(LLNode));
-    if (!node)
-        return;
-    node->value = val;
-    node->next = NULL;
-
-    if (!list->head) {
-        list->head = node;
-        list->tail = node;
-    } else {
-        list->tail->next = node;
-        list->tail = node;
-    }
-    list->size++;
+    list->items[list->size++] = val;
 }
 
 void ll_insert(LinkedList *list, size_t index, Value *val) {
@@ -69,44 +69,26 @@ void ll_insert(LinkedList *list, size_t index, Value *val) {
         return;
     }
 
-    LLNode *node = malloc(sizeof(LLNode));
-    if (!node)
+    if (!ll_reserve(list, list->size + 1))
         return;
-    node->value = val;
-
-    if (index == 0) {
-        node->next = list->head;
-        list->head = node;
-        if (!list->tail)
-            list->tail = node;
-    } else {
-        LLNode *cur = list->head;
-        for (size_t i = 0; i < index - 1; i++)
-            cur = cur->next;
-        node->next = cur->next;
-        cur->next = node;
-    }
-
+    memmove(list->items + index + 1, list->items + index,
+            (list->size - index) * sizeof(Value *));
+    list->items[index] = val;
     list->size++;
+    list->version++;
 }
 
 Value *ll_get(LinkedList *list, size_t index) {
     if (!list || index >= list->size)
         return NULL;
-    LLNode *cur = list->head;
-    for (size_t i = 0; i < index; i++)
-        cur = cur->next;
-    return cur->value;
+    return list->items[index];
 }
 
 void ll_set(LinkedList *list, size_t index, Value *val) {
     if (!list || index >= list->size)
         return;
-    LLNode *cur = list->head;
-    for (size_t i = 0; i < index; i++)
-        cur = cur->next;
-    val_release(cur->value); // free previous tenant
-    cur->value = val;
+    val_release(list->items[index]); // free previous tenant
+    list->items[index] = val;
 }
 
 Value *ll_pop(LinkedList *list, long index) {
@@ -118,24 +100,11 @@ Value *ll_pop(LinkedList *list, long index) {
     if (t_index >= list->size)
         return verror("ll_pop: index out of bounds.");
 
-    LLNode *cur = list->head;
-    LLNode *prev = NULL;
-    for (size_t i = 0; i < t_index; i++) {
-        prev = cur;
-        cur = cur->next;
-    }
-
-    if (prev)
-        prev->next = cur->next;
-    else
-        list->head = cur->next;
-
-    if (cur == list->tail)
-        list->tail = prev;
-
-    Value *val = cur->value;
-    free(cur);
+    Value *val = list->items[t_index];
+    memmove(list->items + t_index, list->items + t_index + 1,
+            (list->size - t_index - 1) * sizeof(Value *));
     list->size--;
+    list->version++;
     return val;
 }
 
@@ -145,82 +114,106 @@ Value **ll_to_iter(LinkedList *list) {
     Value **arr = malloc((list->size + 2) * sizeof(Value *));
     if (!arr)
         return NULL;
-    LLNode *cur = list->head;
-    size_t i = 1;
-    while (cur) {
-        arr[i++] = val_retain(cur->value);
-        cur = cur->next;
-    }
-    arr[i] = NULL;
-    arr[0] = vuint(i);
+    if (list->size)
+        memcpy(arr + 1, list->items, list->size * sizeof(Value *));
+    for (size_t i = 1; i <= list->size; i++)
+        val_retain(arr[i]);
+    arr[list->size + 1] = NULL;
+    arr[0] = vuint(list->size + 1);
     return arr;
 }
 
 Value *ll_slice_ll(LinkedList *list, unsigned long start, long len) {
-    Value **l = ll_to_iter(list);
-    unsigned long size = GET_INTEGER(l[0]);
-    start++; // account for [len, ...] that ll_to_iter returns
-    for (unsigned long i = 1; i < start; ++i)
-        val_release(l[i]);
     Value *values = make_list(NULL);
-    if (len != -1) {
-        for (unsigned long i = start; i < size && i < start + len; ++i) {
-            val_release(call_native_with(NULL, native_list_append,
-                                         val_retain(values), l[i], NULL));
-        }
-        for (unsigned long i = start + len; i < size; ++i) {
-            val_release(l[i]);
-        }
-    } else {
-        for (unsigned long i = start; i < size; ++i) {
-            val_release(call_native_with(NULL, native_list_append,
-                                         val_retain(values), l[i], NULL));
-        }
-    }
-    val_release(l[0]);
-    mila_free(l);
+    if (start >= list->size)
+        return values;
+    size_t count = list->size - start;
+    if (len != -1 && (unsigned long)len < count)
+        count = len;
+    LinkedList *out = (LinkedList *)GET_OPAQUE(values);
+    if (!count || !ll_reserve(out, count))
+        return values;
+    memcpy(out->items, list->items + start, count * sizeof(Value *));
+    for (size_t i = 0; i < count; i++)
+        val_retain(out->items[i]);
+    out->size = count;
     return values;
 }
 
+// Follows the value rather than its storage, so the loop sees items the
+// body appends and survives the list being unshared under it.
+// Inserting or popping under the cursor would skip or repeat items,
+// that is reported as an error instead.
 typedef struct {
-    LLNode *current;
+    Value *list;
+    LinkedList *storage;
+    size_t version;
+    size_t index;
 } LLIterState;
 
 LLIterState *ll_iter_init(Value *self) {
     LLIterState *state = (LLIterState *)mila_malloc(sizeof(LLIterState));
-    state->current = ((LinkedList *)GET_OPAQUE(self))->head;
+    list_unshare(self); // the loop body gets the items themselves
+    state->list = val_retain(self);
+    state->storage = (LinkedList *)GET_OPAQUE(self);
+    state->version = state->storage->version;
+    state->index = 0;
     return state;
 }
 
 Value *ll_iter_next(LLIterState *state) {
-    if (!state->current)
+    LinkedList *list = (LinkedList *)GET_OPAQUE(state->list);
+    if (list != state->storage) {
+        // unsharing copies the items in order, the cursor stays valid
+        state->storage = list;
+        state->version = list->version;
+    } else if (list->version != state->version)
+        return vtagged_error(E_RUNTIME,
+                             "foreach: list items were inserted or popped "
+                             "while iterating");
+    if (state->index >= list->size)
         return NULL;
-    Value *val = state->current->value;
-    state->current = state->current->next;
-    return val_retain(val);
+    return val_retain(list->items[state->index++]);
 }
 
-void ll_iter_cleanup(LLIterState *state) { free(state); }
-
-Value *ll_copy(Value *self) {
-    if (!self || !GET_OPAQUE(self))
-        return NULL;
+void ll_iter_cleanup(LLIterState *state) {
+    val_release(state->list);
+    free(state);
+}
 
-    LinkedList *original = (LinkedList *)GET_OPAQUE(self);
+// Element wise copy, containers inside come out as shared copies themselves
+LinkedList *ll_clone(LinkedList *original) {
     LinkedList *copy = ll_create();
-    if (!copy)
+    if (!copy || !ll_reserve(copy, original->size)) {
+        ll_free(copy);
         return NULL;
-
-    // Deep copy all nodes
-    LLNode *cur = original->head;
-    while (cur) {
-        Value *copied_value = val_copy(cur->value);
+    }
+    for (size_t i = 0; i < original->size; i++) {
+        Value *copied_value = val_copy(original->items[i]);
         if (!copied_value) {
             ll_free(copy);
             return NULL;
         }
-        ll_append(copy, copied_value);
-        cur = cur->next;
+        copy->items[copy->size++] = copied_value;
+    }
+    return copy;
+}
+
+Value *ll_copy(Value *self) {
+    if (!self || !GET_OPAQUE(self))
+        return NULL;
+
+    LinkedList *original = (LinkedList *)GET_OPAQUE(self);
+    LinkedList *copy;
+    if (val_copy_shares(self)) {
+        ML_REF_INC(original);
+        copy = original;
+    } else {
+        val_copy_depth++;
+        copy = ll_clone(original);
+        val_copy_depth--;
+        if (!copy)
+            return NULL;
     }
 
     Value *result = val_new_raw(T_OPAQUE);
@@ -228,4 +221,17 @@ Value *ll_copy(Value *self) {
     result->v = (void *)copy;
     val_set_table(result, list_meta);
     return result;
-}
\ No newline at end of file
+}
+
+// Gives self storage of its own before it is changed or its items leak out.
+void list_unshare(Value *self) {
+    LinkedList *list = (LinkedList *)self->v;
+    if (list->refcount <= 1)
+        return;
+    LinkedList *own = ll_clone(list);
+    if (!own)
+        return;
+    self->v = (void *)own;
+    if (ML_REF_DEC(list) == 0)
+        ll_free(list);
+}
@@ -0,0 +1,711 @@
+// This project is licensed under the GNU Affero General Public License
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+
+#include "mila.h"
+#include "ml_ordmap.h"
+#include "ml_primitives.h"
+
+#define IS_ORDMAP(val)                                                         \
+    (GET_TYPE(val) == T_OPAQUE && (val)->method_table == ordmap_meta &&        \
+     (val)->v)
+
+static OrdMapNode *ordmap_node_new(int leaf) {
+    OrdMapNode *node = (OrdMapNode *)mila_malloc(
+        sizeof(OrdMapNode) +
+        (leaf ? 0 : (ORDMAP_MAX_KEYS + 1) * sizeof(OrdMapNode *)));
+    if (!node)
+        return NULL;
+    node->count = 0;
+    node->leaf = leaf;
+    return node;
+}
+
+static void ordmap_node_free(OrdMapNode *node) {
+    for (int i = 0; i < node->count; i++) {
+        val_release(node->keys[i]);
+        val_release(node->values[i]);
+    }
+    if (!node->leaf)
+        for (int i = 0; i <= node->count; i++)
+            ordmap_node_free(node->children[i]);
+    mila_free(node);
+}
+
+static OrdMapNode *ordmap_node_clone(OrdMapNode *node) {
+    OrdMapNode *copy = ordmap_node_new(node->leaf);
+    if (!copy)
+        return NULL;
+    for (int i = 0; i < node->count; i++) {
+        copy->keys[i] = val_copy(node->keys[i]);
+        copy->values[i] = val_copy(node->values[i]);
+    }
+    copy->count = node->count;
+    if (!node->leaf) {
+        for (int i = 0; i <= node->count; i++) {
+            copy->children[i] = ordmap_node_clone(node->children[i]);
+            if (!copy->children[i]) {
+                // undo what was copied so far
+                for (int j = 0; j < node->count; j++) {
+                    val_release(copy->keys[j]);
+                    val_release(copy->values[j]);
+                }
+                while (i-- > 0)
+                    ordmap_node_free(copy->children[i]);
+                mila_free(copy);
+                return NULL;
+            }
+        }
+    }
+    return copy;
+}
+
+// First index whose key isn't below key, *found when it is equal
+static int ordmap_node_find(OrdMapNode *node, Value *key, int *found) {
+    int lo = 0, hi = node->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (val_order_cmp(node->keys[mid], key) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    *found = lo < node->count && val_order_cmp(node->keys[lo], key) == 0;
+    return lo;
+}
+
+OrdMap *ordmap_create(void) {
+    OrdMap *map = (OrdMap *)mila_malloc(sizeof(OrdMap));
+    if (!map)
+        return NULL;
+    map->root = ordmap_node_new(1);
+    if (!map->root) {
+        mila_free(map);
+        return NULL;
+    }
+    map->size = 0;
+    map->refcount = 1;
+    return map;
+}
+
+OrdMap *ordmap_clone(OrdMap *map) {
+    OrdMap *copy = (OrdMap *)mila_malloc(sizeof(OrdMap));
+    if (!copy)
+        return NULL;
+    copy->root = ordmap_node_clone(map->root);
+    if (!copy->root) {
+        mila_free(copy);
+        return NULL;
+    }
+    copy->size = map->size;
+    copy->refcount = 1;
+    return copy;
+}
+
+void ordmap_destroy(OrdMap *map) {
+    if (!map)
+        return;
+    ordmap_node_free(map->root);
+    mila_free(map);
+}
+
+static Value **ordmap_slot(OrdMap *map, Value *key) {
+    OrdMapNode *node = map->root;
+    for (;;) {
+        int found, i = ordmap_node_find(node, key, &found);
+        if (found)
+            return &node->values[i];
+        if (node->leaf)
+            return NULL;
+        node = node->children[i];
+    }
+}
+
+Value *ordmap_get(OrdMap *map, Value *key) {
+    Value **slot = ordmap_slot(map, key);
+    return slot ? *slot : NULL;
+}
+
+// Splits the full child i of parent, its middle key moves up into parent
+static int ordmap_split_child(OrdMapNode *parent, int i) {
+    const int t = ORDMAP_MIN_DEGREE;
+    OrdMapNode *full = parent->children[i];
+    OrdMapNode *right = ordmap_node_new(full->leaf);
+    if (!right)
+        return 0;
+    memcpy(right->keys, full->keys + t, (t - 1) * sizeof(Value *));
+    memcpy(right->values, full->values + t, (t - 1) * sizeof(Value *));
+    if (!full->leaf)
+        memcpy(right->children, full->children + t, t * sizeof(OrdMapNode *));
+    right->count = t - 1;
+    full->count = t - 1;
+
+    int after = parent->count - i;
+    memmove(parent->children + i + 2, parent->children + i + 1,
+            after * sizeof(OrdMapNode *));
+    memmove(parent->keys + i + 1, parent->keys + i, after * sizeof(Value *));
+    memmove(parent->values + i + 1, parent->values + i,
+            after * sizeof(Value *));
+    parent->keys[i] = full->keys[t - 1];
+    parent->values[i] = full->values[t - 1];
+    parent->children[i + 1] = right;
+    parent->count++;
+    return 1;
+}
+
+// Full nodes are split on the way down, so the leaf always has room
+int ordmap_set(OrdMap *map, Value *key, Value *value) {
+    Value **slot = ordmap_slot(map, key);
+    if (slot) {
+        Value *old = *slot;
+        *slot = val_retain(value);
+        val_release(old);
+        return 1;
+    }
+    if (map->root->count == ORDMAP_MAX_KEYS) {
+        OrdMapNode *root = ordmap_node_new(0);
+        if (!root)
+            return 0;
+        root->children[0] = map->root;
+        if (!ordmap_split_child(root, 0)) {
+            mila_free(root);
+            return 0;
+        }
+        map->root = root;
+    }
+    OrdMapNode *node = map->root;
+    for (;;) {
+        int found, i = ordmap_node_find(node, key, &found);
+        if (node->leaf) {
+            memmove(node->keys + i + 1, node->keys + i,
+                    (node->count - i) * sizeof(Value *));
+            memmove(node->values + i + 1, node->values + i,
+                    (node->count - i) * sizeof(Value *));
+            node->keys[i] = val_copy(key);
+            node->values[i] = val_retain(value);
+            node->count++;
+            map->size++;
+            return 1;
+        }
+        if (node->children[i]->count == ORDMAP_MAX_KEYS) {
+            if (!ordmap_split_child(node, i))
+                return 0;
+            if (val_order_cmp(key, node->keys[i]) > 0)
+                i++;
+        }
+        node = node->children[i];
+    }
+}
+
+// Child i and i + 1 and the key between them become child i
+static void ordmap_merge(OrdMapNode *node, int i) {
+    OrdMapNode *left = node->children[i], *right = node->children[i + 1];
+    left->keys[left->count] = node->keys[i];
+    left->values[left->count] = node->values[i];
+    memcpy(left->keys + left->count + 1, right->keys,
+           right->count * sizeof(Value *));
+    memcpy(left->values + left->count + 1, right->values,
+           right->count * sizeof(Value *));
+    if (!left->leaf)
+        memcpy(left->children + left->count + 1, right->children,
+               (right->count + 1) * sizeof(OrdMapNode *));
+    left->count += right->count + 1;
+
+    int after = node->count - i - 1;
+    memmove(node->keys + i, node->keys + i + 1, after * sizeof(Value *));
+    memmove(node->values + i, node->values + i + 1, after * sizeof(Value *));
+    memmove(node->children + i + 1, node->children + i + 2,
+            after * sizeof(OrdMapNode *));
+    node->count--;
+    mila_free(right);
+}
+
+// Moves a key from the left sibling through node into child i
+static void ordmap_borrow_left(OrdMapNode *node, int i) {
+    OrdMapNode *child = node->children[i], *sib = node->children[i - 1];
+    memmove(child->keys + 1, child->keys, child->count * sizeof(Value *));
+    memmove(child->values + 1, child->values, child->count * sizeof(Value *));
+    if (!child->leaf) {
+        memmove(child->children + 1, child->children,
+                (child->count + 1) * sizeof(OrdMapNode *));
+        child->children[0] = sib->children[sib->count];
+    }
+    child->keys[0] = node->keys[i - 1];
+    child->values[0] = node->values[i - 1];
+    node->keys[i - 1] = sib->keys[sib->count - 1];
+    node->values[i - 1] = sib->values[sib->count - 1];
+    sib->count--;
+    child->count++;
+}
+
+// Moves a key from the right sibling through node into child i
+static void ordmap_borrow_right(OrdMapNode *node, int i) {
+    OrdMapNode *child = node->children[i], *sib = node->children[i + 1];
+    child->keys[child->count] = node->keys[i];
+    child->values[child->count] = node->values[i];
+    if (!child->leaf)
+        child->children[child->count + 1] = sib->children[0];
+    node->keys[i] = sib->keys[0];
+    node->values[i] = sib->values[0];
+    memmove(sib->keys, sib->keys + 1, (sib->count - 1) * sizeof(Value *));
+    memmove(sib->values, sib->values + 1, (sib->count - 1) * sizeof(Value *));
+    if (!sib->leaf)
+        memmove(sib->children, sib->children + 1,
+                sib->count * sizeof(OrdMapNode *));
+    sib->count--;
+    child->count++;
+}
+
+// Gives child i a key to spare before going down into it, returns the
+// index of the child to go down into
+static int ordmap_fill(OrdMapNode *node, int i) {
+    const int t = ORDMAP_MIN_DEGREE;
+    if (node->children[i]->count >= t)
+        return i;
+    if (i > 0 && node->children[i - 1]->count >= t)
+        ordmap_borrow_left(node, i);
+    else if (i < node->count && node->children[i + 1]->count >= t)
+        ordmap_borrow_right(node, i);
+    else if (i < node->count)
+        ordmap_merge(node, i);
+    else
+        ordmap_merge(node, --i);
+    return i;
+}
+
+// Takes key out of the subtree in one pass down, every node entered has
+// a key to spare. The caller gets the stored key and value
+static int ordmap_node_remove(OrdMapNode *node, Value *key, Value **out_key,
+                              Value **out_value) {
+    const int t = ORDMAP_MIN_DEGREE;
+    for (;;) {
+        int found, i = ordmap_node_find(node, key, &found);
+        if (node->leaf) {
+            if (!found)
+                return 0;
+            *out_key = node->keys[i];
+            *out_value = node->values[i];
+            int after = node->count - i - 1;
+            memmove(node->keys + i, node->keys + i + 1,
+                    after * sizeof(Value *));
+            memmove(node->values + i, node->values + i + 1,
+                    after * sizeof(Value *));
+            node->count--;
+            return 1;
+        }
+        if (found) {
+            // the neighbouring key from a leaf takes its place
+            if (node->children[i]->count >= t) {
+                OrdMapNode *pred = node->children[i];
+                while (!pred->leaf)
+                    pred = pred->children[pred->count];
+                *out_key = node->keys[i];
+                *out_value = node->values[i];
+                return ordmap_node_remove(node->children[i],
+                                          pred->keys[pred->count - 1],
+                                          &node->keys[i], &node->values[i]);
+            }
+            if (node->children[i + 1]->count >= t) {
+                OrdMapNode *succ = node->children[i + 1];
+                while (!succ->leaf)
+                    succ = succ->children[0];
+                *out_key = node->keys[i];
+                *out_value = node->values[i];
+                return ordmap_node_remove(node->children[i + 1],
+                                          succ->keys[0], &node->keys[i],
+                                          &node->values[i]);
+            }
+            ordmap_merge(node, i);
+            node = node->children[i];
+            continue;
+        }
+        node = node->children[ordmap_fill(node, i)];
+    }
+}
+
+int ordmap_remove(OrdMap *map, Value *key) {
+    Value *old_key = NULL, *old_value = NULL;
+    int removed = ordmap_node_remove(map->root, key, &old_key, &old_value);
+    // merges on the way down can empty the root even when key wasn't there
+    if (map->root->count == 0 && !map->root->leaf) {
+        OrdMapNode *root = map->root;
+        map->root = root->children[0];
+        mila_free(root);
+    }
+    if (!removed)
+        return 0;
+    val_release(old_key);
+    val_release(old_value);
+    map->size--;
+    return 1;
+}
+
+// Cursors
+
+static void ordmap_cursor_settle(OrdMapCursor *cursor) {
+    while (cursor->depth > 0 && cursor->index[cursor->depth - 1] >=
+                                    cursor->path[cursor->depth - 1]->count)
+        cursor->depth--;
+}
+
+static void ordmap_cursor_leftmost(OrdMapCursor *cursor, OrdMapNode *node) {
+    for (;;) {
+        cursor->path[cursor->depth] = node;
+        cursor->index[cursor->depth] = 0;
+        cursor->depth++;
+        if (node->leaf)
+            break;
+        node = node->children[0];
+    }
+}
+
+// Puts the cursor on the first key that isn't below lo
+static void ordmap_cursor_seek(OrdMapCursor *cursor, OrdMap *map, Value *lo) {
+    cursor->depth = 0;
+    if (!lo)
+        ordmap_cursor_leftmost(cursor, map->root);
+    else {
+        OrdMapNode *node = map->root;
+        for (;;) {
+            int found, i = ordmap_node_find(node, lo, &found);
+            cursor->path[cursor->depth] = node;
+            cursor->index[cursor->depth] = i;
+            cursor->depth++;
+            if (found || node->leaf)
+                break;
+            node = node->children[i];
+        }
+    }
+    ordmap_cursor_settle(cursor);
+}
+
+static int ordmap_cursor_next(OrdMapCursor *cursor, Value **key,
+                              Value **value) {
+    if (cursor->depth == 0)
+        return 0;
+    OrdMapNode *node = cursor->path[cursor->depth - 1];
+    int i = cursor->index[cursor->depth - 1]++;
+    *key = node->keys[i];
+    *value = node->values[i];
+    if (!node->leaf)
+        ordmap_cursor_leftmost(cursor, node->children[i + 1]);
+    ordmap_cursor_settle(cursor);
+    return 1;
+}
+
+static Value *ordmap_pair(Value *key, Value *value) {
+    LinkedList *pair = ll_create();
+    ll_append(pair, val_copy(key));
+    ll_append(pair, val_retain(value));
+    Value *res = vopaque_extra(pair, NULL, MILA_LPREFIX "list");
+    val_set_table(res, list_meta);
+    return res;
+}
+
+// The value
+
+void ordmap_unshare(Value *self) {
+    OrdMap *map = (OrdMap *)self->v;
+    if (map->refcount <= 1)
+        return;
+    OrdMap *own = ordmap_clone(map);
+    if (!own)
+        return;
+    self->v = (void *)own;
+    if (ML_REF_DEC(map) == 0)
+        ordmap_destroy(map);
+}
+
+Value *ordmap_new(OrdMap *map) {
+    Value *res = vopaque_extra(map, NULL, MILA_LPREFIX "ordmap");
+    val_set_table(res, ordmap_meta);
+    return res;
+}
+
+Value *ordmap_str(Value *self) {
+    OrdMap *map = (OrdMap *)self->v;
+    if (map->size > MAX_ITEMS_DISPLAYED)
+        return vstring_fmt("ordmap(<%zu items>)", map->size);
+    char *buffer = NULL;
+    malloc_sprintf(&buffer, "ordmap(");
+    OrdMapCursor cursor;
+    Value *key, *value;
+    ordmap_cursor_seek(&cursor, map, NULL);
+    for (int first = 1; ordmap_cursor_next(&cursor, &key, &value); first = 0) {
+        char *key_str = as_c_string_repr(key);
+        char *value_str = as_c_string_repr(value);
+        malloc_sprintf(&buffer, "%s%s = %s", first ? "" : ", ", key_str,
+                       value_str);
+        mila_free(key_str);
+        mila_free(value_str);
+    }
+    malloc_sprintf(&buffer, ")");
+    return vstring_take(buffer);
+}
+
+Value *ordmap_free(Value *self) {
+    OrdMap *map = (OrdMap *)self->v;
+    if (ML_REF_DEC(map) == 0)
+        ordmap_destroy(map);
+    return NULL;
+}
+
+Value *ordmap_copy(Value *self) {
+    OrdMap *map = (OrdMap *)self->v;
+    if (val_copy_shares(self))
+        ML_REF_INC(map);
+    else {
+        val_copy_depth++;
+        map = ordmap_clone(map);
+        val_copy_depth--;
+        if (!map)
+            return verror("copy(ordmap): Couldn't copy the ordmap");
+    }
+    return ordmap_new(map);
+}
+
+Value *get_ordmap(Value *self, Value *key) {
+    if (!val_orderable(key))
+        return NULL;
+    Value *v = ordmap_get((OrdMap *)self->v, key);
+    if (val_is_mutable(v) && ORDMAP_SHARED(self)) {
+        ordmap_unshare(self);
+        v = ordmap_get((OrdMap *)self->v, key);
+    }
+    return v;
+}
+
+Value *set_ordmap(Value *self, Value *key, Value *value) {
+    if (IS_FROZEN(self))
+        return vtagged_error(E_CONST_ERROR, "Cannot set item of frozen ordmap");
+    if (!val_orderable(key))
+        return verror("ordmap: Can't order %s keys, only numbers, strings and "
+                      "lists of those",
+                      GET_TYPENAME(key));
+    ordmap_unshare(self);
+    if (!ordmap_set((OrdMap *)self->v, key, value))
+        return verror("ordmap: Out of memory");
+    return NULL;
+}
+
+static void ordmap_node_visit(OrdMapNode *node, value_visitor fn, void *ctx) {
+    for (int i = 0; i < node->count; i++)
+        fn(&node->values[i], ctx);
+    if (!node->leaf)
+        for (int i = 0; i <= node->count; i++)
+            ordmap_node_visit(node->children[i], fn, ctx);
+}
+
+void ordmap_visit(Value *self, value_visitor fn, void *ctx) {
+    ordmap_node_visit(((OrdMap *)self->v)->root, fn, ctx);
+}
+
+// Iteration, foreach hands out [key, value] pairs in key order
+
+static OrdMapIterState *ordmap_iter_start(OrdMap *map, Value *lo, Value *hi,
+                                          const char *prefix) {
+    OrdMapIterState *state =
+        (OrdMapIterState *)mila_malloc(sizeof(OrdMapIterState));
+    state->map = map;
+    ML_REF_INC(map);
+    state->hi = hi ? val_retain(hi) : NULL;
+    state->prefix = prefix ? mila_strdup(prefix) : NULL;
+    state->prefix_len = prefix ? strlen(prefix) : 0;
+    ordmap_cursor_seek(&state->cursor, map, lo);
+    return state;
+}
+
+// Compares the stored bytes, keys may hold NULs and views aren't flattened
+static int ordmap_key_has_prefix(Value *key, const char *prefix, size_t len) {
+    return GET_TYPE(key) == T_STRING && GET_STRING_LEN(key) >= len &&
+           memcmp(GET_STRING_BYTES(key), prefix, len) == 0;
+}
+
+OrdMapIterState *ordmap_iter_init(Value *self) {
+    ordmap_unshare(self); // the loop body gets the values themselves
+    return ordmap_iter_start((OrdMap *)self->v, NULL, NULL, NULL);
+}
+
+Value *ordmap_iter_next(OrdMapIterState *state) {
+    Value *key, *value;
+    if (!ordmap_cursor_next(&state->cursor, &key, &value))
+        return NULL;
+    // keys come out sorted, the first one past the end ends the loop
+    if ((state->hi && val_order_cmp(key, state->hi) >= 0) ||
+        (state->prefix &&
+         !ordmap_key_has_prefix(key, state->prefix, state->prefix_len))) {
+        state->cursor.depth = 0;
+        return NULL;
+    }
+    return ordmap_pair(key, value);
+}
+
+void ordmap_iter_cleanup(OrdMapIterState *state) {
+    if (ML_REF_DEC(state->map) == 0)
+        ordmap_destroy(state->map);
+    val_release(state->hi);
+    mila_free((char *)state->prefix);
+    free(state);
+}
+
+// Views
+
+static Value *ordmap_view_new(OrdMap *map, Value *lo, Value *hi,
+                              const char *prefix) {
+    OrdMapView *view = (OrdMapView *)mila_malloc(sizeof(OrdMapView));
+    view->map = map;
+    ML_REF_INC(map);
+    view->lo = lo ? val_copy(lo) : NULL;
+    view->hi = hi ? val_copy(hi) : NULL;
+    view->prefix = prefix ? mila_strdup(prefix) : NULL;
+    Value *res = vopaque_extra(view, NULL, MILA_LPREFIX "ordmap_view");
+    val_set_table(res, ordmap_view_meta);
+    return res;
+}
+
+Value *ordmap_view_str(Value *self) {
+    OrdMapView *view = (OrdMapView *)self->v;
+    if (view->prefix)
+        return vstring_fmt("ordmap.prefix(\"%s\")", view->prefix);
+    char *lo = view->lo ? as_c_string_repr(view->lo) : NULL;
+    char *hi = view->hi ? as_c_string_repr(view->hi) : NULL;
+    Value *res = vstring_fmt("ordmap.range(%s, %s)", lo ? lo : "null",
+                             hi ? hi : "null");
+    mila_free(lo);
+    mila_free(hi);
+    return res;
+}
+
+Value *ordmap_view_free(Value *self) {
+    OrdMapView *view = (OrdMapView *)self->v;
+    if (ML_REF_DEC(view->map) == 0)
+        ordmap_destroy(view->map);
+    val_release(view->lo);
+    val_release(view->hi);
+    mila_free(view->prefix);
+    mila_free(view);
+    return NULL;
+}
+
+Value *ordmap_view_copy(Value *self) {
+    OrdMapView *view = (OrdMapView *)self->v;
+    return ordmap_view_new(view->map, view->lo, view->hi, view->prefix);
+}
+
+OrdMapIterState *ordmap_view_iter_init(Value *self) {
+    OrdMapView *view = (OrdMapView *)self->v;
+    return ordmap_iter_start(view->map, view->lo, view->hi, view->prefix);
+}
+
+// Natives
+
+Value *native_ordmap_new(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc % 2 != 0)
+        return verror("ordmap(key1, val1, ...): Expected key value pairs");
+    for (int i = 0; i < argc; i += 2)
+        if (!val_orderable(argv[i]))
+            return verror("ordmap(key1, val1, ...): Can't order %s keys",
+                          GET_TYPENAME(argv[i]));
+    OrdMap *map = ordmap_create();
+    if (!map)
+        return verror("ordmap(key1, val1, ...): Couldn't make an ordmap");
+    for (int i = 0; i < argc; i += 2)
+        ordmap_set(map, argv[i], argv[i + 1]);
+    return ordmap_new(map);
+}
+
+Value *native_ordmap_rem(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 2 || !IS_ORDMAP(argv[0]))
+        return verror("ordmap.rem(m, key): Expected an ordmap and a key");
+    if (IS_FROZEN(argv[0]))
+        return vtagged_error(E_CONST_ERROR,
+                             "ordmap.rem(m, key): ordmap is frozen");
+    if (!val_orderable(argv[1]))
+        return vbool(0);
+    ordmap_unshare(argv[0]);
+    return vbool(ordmap_remove((OrdMap *)argv[0]->v, argv[1]));
+}
+
+Value *native_ordmap_has(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 2 || !IS_ORDMAP(argv[0]))
+        return verror("ordmap.has(m, key): Expected an ordmap and a key");
+    return vbool(val_orderable(argv[1]) &&
+                 ordmap_slot((OrdMap *)argv[0]->v, argv[1]) != NULL);
+}
+
+Value *native_ordmap_len(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 1 || !IS_ORDMAP(argv[0]))
+        return verror("ordmap.len(m): Expected an ordmap");
+    return vint((long)((OrdMap *)argv[0]->v)->size);
+}
+
+Value *native_ordmap_first(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 1 || !IS_ORDMAP(argv[0]))
+        return verror("ordmap.first(m): Expected an ordmap");
+    OrdMapNode *node = ((OrdMap *)argv[0]->v)->root;
+    if (node->count == 0)
+        return vnull();
+    while (!node->leaf)
+        node = node->children[0];
+    return ordmap_pair(node->keys[0], node->values[0]);
+}
+
+Value *native_ordmap_last(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 1 || !IS_ORDMAP(argv[0]))
+        return verror("ordmap.last(m): Expected an ordmap");
+    OrdMapNode *node = ((OrdMap *)argv[0]->v)->root;
+    if (node->count == 0)
+        return vnull();
+    while (!node->leaf)
+        node = node->children[node->count];
+    return ordmap_pair(node->keys[node->count - 1],
+                       node->values[node->count - 1]);
+}
+
+Value *native_ordmap_range(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 3 || !IS_ORDMAP(argv[0]))
+        return verror("ordmap.range(m, lo, hi): Expected an ordmap and bounds");
+    for (int i = 1; i < 3; i++)
+        if (GET_TYPE(argv[i]) != T_NULL && !val_orderable(argv[i]))
+            return verror("ordmap.range(m, lo, hi): Can't order %s bounds",
+                          GET_TYPENAME(argv[i]));
+    return ordmap_view_new((OrdMap *)argv[0]->v,
+                           GET_TYPE(argv[1]) == T_NULL ? NULL : argv[1],
+                           GET_TYPE(argv[2]) == T_NULL ? NULL : argv[2], NULL);
+}
+
+Value *native_ordmap_prefix(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 2 || !IS_ORDMAP(argv[0]) || GET_TYPE(argv[1]) != T_STRING)
+        return verror("ordmap.prefix(m, prefix): Expected an ordmap and a "
+                      "string");
+    // every key starting with prefix sorts right at or after it
+    return ordmap_view_new((OrdMap *)argv[0]->v, argv[1], NULL,
+                           GET_STRING(argv[1]));
+}
+
+Value *native_ordmap_keys(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 1 || !IS_ORDMAP(argv[0]))
+        return verror("ordmap.keys(m): Expected an ordmap");
+    OrdMap *map = (OrdMap *)argv[0]->v;
+    LinkedList *list = ll_create();
+    ll_reserve(list, map->size);
+    OrdMapCursor cursor;
+    Value *key, *value;
+    ordmap_cursor_seek(&cursor, map, NULL);
+    while (ordmap_cursor_next(&cursor, &key, &value))
+        ll_append(list, val_copy(key));
+    Value *res = vopaque_extra(list, NULL, MILA_LPREFIX "list");
+    val_set_table(res, list_meta);
+    return res;
+}
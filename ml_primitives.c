@@ -8,8 +8,13 @@
 
 #include "mila.h"
 #include "ml_dict.h"
+#include "ml_glob.h"
+#include "ml_heap.h"
+#include "ml_ordmap.h"
+#include "ml_typedarray.h"
 #include "ml_ll.c"
 #include "ml_string.h"
+#include "ml_strscan.h"
 #include <string.h>
 
 // Define meta tables
@@ -20,6 +25,189 @@ MethodTable *list_meta = NULL;
 MethodTable *array_meta = NULL;
 MethodTable *range_meta = NULL;
 MethodTable *istring_meta = NULL;
+MethodTable *set_meta = NULL;
+MethodTable *heap_meta = NULL;
+MethodTable *ordmap_meta = NULL;
+MethodTable *ordmap_view_meta = NULL;
+MethodTable *tarray_meta = NULL;
+MethodTable *strbuf_meta = NULL;
+MethodTable *str_split_meta = NULL;
+MethodTable *glob_meta = NULL;
+
+// copy() shares list and dict storage until one side needs its own,
+// see list_unshare and dict_unshare
+#define LIST_SHARED(val) (((LinkedList *)(val)->v)->refcount > 1)
+#define DICT_SHARED(val) (((Dict *)(val)->v)->refcount > 1)
+
+#define IS_CONTAINER(v) ((v) && GET_METHOD(v, UMethodVisit))
+
+// An item handed out of shared storage could be changed in place, which
+// would show through every copy: containers, and strings str.pop_f and
+// str.pop_b rewrite
+int val_is_mutable(Value *v) {
+    if (!v || IS_FROZEN(v))
+        return 0;
+    return IS_CONTAINER(v) || GET_TYPE(v) == T_STRING;
+}
+
+int val_is_shared(Value *v) {
+    if (v->method_table == list_meta)
+        return LIST_SHARED(v);
+    if (v->method_table == dict_meta || v->method_table == set_meta)
+        return DICT_SHARED(v);
+    if (v->method_table == heap_meta)
+        return HEAP_SHARED(v);
+    if (v->method_table == ordmap_meta)
+        return ORDMAP_SHARED(v);
+    if (v->method_table == tarray_meta)
+        return TARRAY_SHARED(v);
+    return 0;
+}
+
+// Past this many nested clones copy() shares storage anyway, which is
+// what ends a copy of a cycle. Aliases deeper than it aren't looked for
+#define VAL_COPY_MAX_DEPTH 32
+
+_Thread_local int val_copy_depth = 0;
+
+typedef struct {
+    int depth;
+    int aliased;
+} AliasWalk;
+
+static void val_alias_visit(Value **slot, void *ctx) {
+    AliasWalk *walk = (AliasWalk *)ctx;
+    Value *v = *slot;
+    // frozen values never change, sharing them is always fine
+    if (walk->aliased || !val_is_mutable(v))
+        return;
+    if (v->refcount > 1 || v->wrefs) {
+        walk->aliased = 1;
+        return;
+    }
+    if (!IS_CONTAINER(v) || walk->depth >= VAL_COPY_MAX_DEPTH)
+        return;
+    walk->depth++;
+    ((visit_method)GET_METHOD(v, UMethodVisit))(v, val_alias_visit, ctx);
+    walk->depth--;
+}
+
+int val_copy_shares(Value *self) {
+    if (self->wrefs || self->refcount == ML_WEAK_REF_TRIGGER)
+        return 0;
+    if (val_copy_depth >= VAL_COPY_MAX_DEPTH)
+        return 1;
+    AliasWalk walk = {0, 0};
+    ((visit_method)GET_METHOD(self, UMethodVisit))(self, val_alias_visit,
+                                                     &walk);
+    return !walk.aliased;
+}
+
+void val_unshare(Value *v) {
+    if (v->method_table == list_meta)
+        list_unshare(v);
+    else if (v->method_table == dict_meta || v->method_table == set_meta)
+        dict_unshare(v);
+    else if (v->method_table == heap_meta)
+        heap_unshare(v);
+    else if (v->method_table == ordmap_meta)
+        ordmap_unshare(v);
+    else if (v->method_table == tarray_meta)
+        tarray_unshare(v);
+}
+
+// Numbers, strings and lists of those have an order, heaps and ordmaps
+// compare their keys with it. Lists nested deeper than this don't
+#define VAL_ORDER_MAX_DEPTH 32
+
+static int val_orderable_at(Value *v, int depth) {
+    switch (GET_TYPE(v)) {
+    case T_INT:
+    case T_UINT:
+    case T_FLOAT:
+    case T_BOOL:
+    case T_STRING:
+        return 1;
+    default:
+        break;
+    }
+    if (v->method_table != list_meta || depth >= VAL_ORDER_MAX_DEPTH)
+        return 0;
+    LinkedList *list = (LinkedList *)v->v;
+    for (size_t i = 0; i < list->size; i++)
+        if (!val_orderable_at(list->items[i], depth + 1))
+            return 0;
+    return 1;
+}
+
+int val_orderable(Value *v) { return val_orderable_at(v, 0); }
+
+// numbers < strings < lists
+static int val_order_rank(Value *v) {
+    switch (GET_TYPE(v)) {
+    case T_STRING:
+        return 1;
+    case T_OPAQUE:
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+static int val_order_num_cmp(Value *a, Value *b) {
+    ValueType ta = GET_TYPE(a), tb = GET_TYPE(b);
+    if (ta == T_INT && tb == T_INT) {
+        long x = GET_INTEGER(a), y = GET_INTEGER(b);
+        return (x > y) - (x < y);
+    }
+    if (ta == T_UINT && tb == T_UINT) {
+        unsigned long x = GET_UINTEGER(a), y = GET_UINTEGER(b);
+        return (x > y) - (x < y);
+    }
+    double x = ta == T_BOOL ? GET_BOOL(a) : to_double(a);
+    double y = tb == T_BOOL ? GET_BOOL(b) : to_double(b);
+    return (x > y) - (x < y);
+}
+
+// Both sides have to be val_orderable
+int val_order_cmp(Value *a, Value *b) {
+    int ra = val_order_rank(a), rb = val_order_rank(b);
+    if (ra != rb)
+        return ra - rb;
+    if (ra == 0)
+        return val_order_num_cmp(a, b);
+    if (ra == 1) {
+        size_t na = GET_STRING_LEN(a), nb = GET_STRING_LEN(b);
+        int cmp = memcmp(GET_STRING_BYTES(a), GET_STRING_BYTES(b),
+                         na < nb ? na : nb);
+        return cmp ? cmp : (na > nb) - (na < nb);
+    }
+    LinkedList *la = (LinkedList *)a->v, *lb = (LinkedList *)b->v;
+    for (size_t i = 0; i < la->size && i < lb->size; i++) {
+        int cmp = val_order_cmp(la->items[i], lb->items[i]);
+        if (cmp)
+            return cmp;
+    }
+    return (la->size > lb->size) - (la->size < lb->size);
+}
+
+static Value *list_item_out(Value *self, size_t index) {
+    Value *v = ll_get((LinkedList *)self->v, index);
+    if (val_is_mutable(v) && LIST_SHARED(self)) {
+        list_unshare(self);
+        v = ll_get((LinkedList *)self->v, index);
+    }
+    return v;
+}
+
+static Value *dict_item_out(Value *self, Value *key) {
+    Value *v = dict_get((Dict *)self->v, key);
+    if (val_is_mutable(v) && DICT_SHARED(self)) {
+        dict_unshare(self);
+        v = dict_get((Dict *)self->v, key);
+    }
+    return v;
+}
 
 Value *list_repr(Value *self) {
     LinkedList *lst = (LinkedList *)self->v;
@@ -27,40 +215,44 @@ Value *list_repr(Value *self) {
         return vstring_fmt("list(%zu items)", lst->size);
     Value **iter = ll_to_iter(lst);
 
-    char *buffer = mila_strdup("[");
+    strbuf out;
+    sb_init(&out);
+    sb_append(&out, "[", 1);
     for (size_t i = 1; iter[i]; i++) {
         char *repr = as_c_string_repr(iter[i]);
+        if (repr)
+            sb_append_str(&out, repr);
         if (i - 1 < lst->size - 1)
-            malloc_sprintf(&buffer, "%s, ", repr);
-        else
-            malloc_sprintf(&buffer, "%s", repr);
+            sb_append(&out, ", ", 2);
         val_release(iter[i]);
         mila_free(repr);
     }
-    malloc_sprintf(&buffer, "]");
+    sb_append(&out, "]", 1);
     val_release(iter[0]);
     mila_free(iter);
-    return vstring_take(buffer);
+    return vstring_mstring(sb_mstring(&out));
 }
 
 Value *list_str(Value *self) {
     LinkedList *lst = (LinkedList *)self->v;
     Value **iter = ll_to_iter(lst);
 
-    char *buffer = mila_strdup("[");
+    strbuf out;
+    sb_init(&out);
+    sb_append(&out, "[", 1);
     for (size_t i = 1; iter[i]; i++) {
         char *repr = as_c_string_repr(iter[i]);
+        if (repr)
+            sb_append_str(&out, repr);
         if (i - 1 < lst->size - 1)
-            malloc_sprintf(&buffer, "%s, ", repr);
-        else
-            malloc_sprintf(&buffer, "%s", repr);
+            sb_append(&out, ", ", 2);
         val_release(iter[i]);
         mila_free(repr);
     }
-    malloc_sprintf(&buffer, "]");
+    sb_append(&out, "]", 1);
     val_release(iter[0]);
     mila_free(iter);
-    return vstring_take(buffer);
+    return vstring_mstring(sb_mstring(&out));
 }
 
 Value *native_list_new(Env *e, int argc, Value **argv) {
@@ -77,8 +269,8 @@ Value *native_list_new(Env *e, int argc, Value **argv) {
 Value *native_list_index(Env *e, int argc, Value **argv) {
     long cur = 0;
     LinkedList *l = (LinkedList *)GET_OPAQUE(argv[0]);
-    for (LLNode *v = l->head; v; v = v->next) {
-        Value *cond = binary_op(v->value, BMethodEq, argv[1]);
+    for (size_t i = 0; i < l->size; i++) {
+        Value *cond = binary_op(l->items[i], BMethodEq, argv[1]);
         if (is_truthy(cond)) {
             val_release(cond);
             return vint(cur);
@@ -92,6 +284,10 @@ Value *native_list_index(Env *e, int argc, Value **argv) {
 Value *native_list_set(Env *e, int argc, Value **argv) {
     (void)e;
     (void)argc;
+    if (IS_FROZEN(argv[0]))
+        return vtagged_error(E_CONST_ERROR,
+                             "list.set(l, index, value): list is frozen");
+    list_unshare(argv[0]);
     ll_set(GET_OPAQUE(argv[0]), GET_INTEGER(argv[1]), val_retain(argv[2]));
     return NULL;
 }
@@ -99,16 +295,19 @@ Value *native_list_set(Env *e, int argc, Value **argv) {
 Value *native_list_get(Env *e, int argc, Value **argv) {
     (void)e;
     (void)argc;
-    return ll_get(GET_OPAQUE(argv[0]), GET_INTEGER(argv[1]));
+    return list_item_out(argv[0], GET_INTEGER(argv[1]));
 }
 
 Value *set_list(Value *self, Value *index, Value *value) {
+    if (IS_FROZEN(self))
+        return vtagged_error(E_CONST_ERROR, "Cannot set item of frozen list");
+    list_unshare(self);
     ll_set((LinkedList *)self->v, index->v->i, val_retain(value));
     return NULL;
 }
 
 Value *get_list(Value *self, Value *index) {
-    return ll_get((LinkedList *)self->v, index->v->i);
+    return list_item_out(self, index->v->i);
 }
 
 Value *native_list_len(Env *e, int argc, Value **argv) {
@@ -120,6 +319,11 @@ Value *native_list_len(Env *e, int argc, Value **argv) {
 }
 
 Value *native_list_pop(Env *e, int argc, Value **argv) {
+    if (argc >= 1 && IS_FROZEN(argv[0]))
+        return vtagged_error(E_CONST_ERROR,
+                             "list.pop(l, index?): list is frozen");
+    if (argc >= 1)
+        list_unshare(argv[0]);
     if (argc == 1)
         return ll_pop((LinkedList *)argv[0]->v, -1);
     else if (argc == 2)
@@ -129,13 +333,25 @@ Value *native_list_pop(Env *e, int argc, Value **argv) {
 }
 
 Value *list_free(Value *self) {
-    ll_free((LinkedList *)self->v);
+    LinkedList *list = (LinkedList *)self->v;
+    if (ML_REF_DEC(list) == 0)
+        ll_free(list);
     self->type = T_NULL;
     self->v = NULL;
     return NULL;
 }
 
+void list_visit(Value *self, value_visitor fn, void *ctx) {
+    LinkedList *list = (LinkedList *)self->v;
+    for (size_t i = 0; i < list->size; i++)
+        fn(&list->items[i], ctx);
+}
+
 Value *native_list_append(Env *env, int argc, Value **argv) {
+    if (IS_FROZEN(argv[0]))
+        return vtagged_error(E_CONST_ERROR,
+                             "list.append(l, value): list is frozen");
+    list_unshare(argv[0]);
     ll_append(GET_OPAQUE(argv[0]), val_retain(argv[1]));
     return vnull();
 }
@@ -166,6 +382,7 @@ Value *native_list_slice(Env *env, int argc, Value **argv) {
                       "mila:list, num, num (list, start, len)");
     }
 
+    list_unshare(argv[0]);
     return ll_slice_ll((LinkedList *)GET_OPAQUE(argv[0]), to_uint(argv[1]),
                        to_uint(argv[2]));
 }
@@ -215,6 +432,10 @@ Value *native_set_dict(Env *env, int argc, Value **argv) {
     if (argc != 3) {
         return verror("invalid number of arguments given or incorrect types.");
     }
+    if (IS_FROZEN(argv[0]))
+        return vtagged_error(E_CONST_ERROR,
+                             "dict.set(d, key, value): dict is frozen");
+    dict_unshare(argv[0]);
 
     dict_set((Dict *)argv[0]->v, argv[1], val_retain(argv[2]));
     return vnull();
@@ -226,18 +447,20 @@ Value *native_get_dict(Env *env, int argc, Value **argv) {
         return verror("invalid number of arguments given or incorrect types.");
     }
 
-    Value *v = dict_get((Dict *)argv[0]->v, argv[1]);
+    Value *v = dict_item_out(argv[0], argv[1]);
     return v ? v : vnull();
 }
 
 Value *set_dict(Value *self, Value *name, Value *val) {
+    if (IS_FROZEN(self))
+        return vtagged_error(E_CONST_ERROR, "Cannot set item of frozen dict");
+    dict_unshare(self);
     dict_set((Dict *)self->v, name, val);
     return NULL;
 }
 
 Value *get_dict(Value *self, Value *name) {
-    Value *v = dict_get((Dict *)self->v, name);
-    return v;
+    return dict_item_out(self, name);
 }
 
 Value *native_rem_dict(Env *env, int argc, Value **argv) {
@@ -245,16 +468,25 @@ Value *native_rem_dict(Env *env, int argc, Value **argv) {
     if (argc != 2) {
         return verror("invalid number of arguments given or incorrect types.");
     }
+    if (IS_FROZEN(argv[0]))
+        return vtagged_error(E_CONST_ERROR, "dict.rem(d, key): dict is frozen");
+    dict_unshare(argv[0]);
 
     dict_remove((Dict *)argv[0]->v, argv[1]);
     return vnull();
 }
 
 Value *free_dict(Value *self) {
-    dict_free((Dict *)self->v);
+    Dict *dict = (Dict *)self->v;
+    if (ML_REF_DEC(dict) == 0)
+        dict_free(dict);
     return NULL;
 }
 
+void dict_visit(Value *self, value_visitor fn, void *ctx) {
+    ITERATE_DICT((Dict *)self->v) { fn(&entry->value, ctx); }
+}
+
 Value *array_to_str(Value *self) {
     char *buffer = NULL;
     if (!self || self->type != T_OPAQUE) {
@@ -356,12 +588,11 @@ long range_len(long start, long stop, long step) {
 
 Value *range_to_iter(Value *self) {
     Range *data = (Range *)(self->v);
-    Value **v = (Value **)mila_malloc(
-        sizeof(Value *) * (range_len(data->start, data->end, data->step) + 1) +
-        1);
+    long len = range_len(data->start, data->end, data->step);
+    Value **v = (Value **)mila_malloc(sizeof(Value *) * (len + 2));
     long index = 1;
-    for (long i = data->start; i < data->end; i += data->step) {
-        v[index++] = vint(i);
+    for (long i = 0; i < len; i++) {
+        v[index++] = vint(data->start + i * data->step);
     }
     v[index] = NULL;
     v[0] = vuint(index);
@@ -375,28 +606,40 @@ Value *range_to_str(Value *self) {
 }
 
 typedef struct {
-    long start, end, step, current;
+    long start, step, current, len;
+    Value *box; // last int handed out, reused once the loop lets go of it
 } RangeState;
 
 RangeState *range_iter_init(Value *self) {
     Range *data = (Range *)GET_OPAQUE(self);
     RangeState *state = (RangeState *)malloc(sizeof(RangeState));
     state->start = data->start;
-    state->end = data->end;
     state->step = data->step;
     state->current = 0;
+    state->len = range_len(data->start, data->end, data->step);
+    state->box = NULL;
     return state;
 }
 
 Value *range_iter_next(RangeState *self) {
-    long result = self->start + (self->step * self->current);
-    if (result >= self->end)
+    if (self->current >= self->len)
         return NULL;
+    long result = self->start + (self->step * self->current);
     self->current++;
-    return vint(result);
+    // nobody but us holds the previous int, so write the next one into it
+    if (self->box && self->box->refcount == 1 && !self->box->wrefs) {
+        self->box->v->i = result;
+        return val_retain(self->box);
+    }
+    val_release(self->box);
+    self->box = vint(result);
+    return val_retain(self->box);
 }
 
-void range_iter_free(RangeState *self) { free(self); }
+void range_iter_free(RangeState *self) {
+    val_release(self->box);
+    free(self);
+}
 
 Value *range_free(Value *self) {
     mila_free(self->v);
@@ -513,6 +756,9 @@ Value *native_set_array(Env *env, int argc, Value **argv) {
             "array.set(array, index, value): index %d out of bounds (size %d)",
             idx, arr->size);
     }
+    if (IS_FROZEN(arrv))
+        return vtagged_error(E_CONST_ERROR,
+                             "array.set(array, index, value): array is frozen");
 
     Value *old = arr->array[idx];
     if (old)
@@ -609,6 +855,8 @@ Value *set_array(Value *self, Value *index, Value *val) {
     if (!arr) {
         return verror("array.set(array, index, value): null array data");
     }
+    if (IS_FROZEN(arrv))
+        return vtagged_error(E_CONST_ERROR, "Cannot set item of frozen array");
 
     if (index->type != T_INT) {
         return verror("array.set(array, index, value): index must be int");
@@ -647,18 +895,31 @@ Value *free_array(Value *self) {
     return NULL;
 }
 
+void array_visit(Value *self, value_visitor fn, void *ctx) {
+    Array *arr = (Array *)self->v;
+    for (int i = 0; i < arr->size; i++)
+        if (arr->array[i])
+            fn(&arr->array[i], ctx);
+}
+
 Value *native_str_pop_start(Env *env, int argc, Value **argv) {
     (void)env;
     (void)argc;
     if (!match_types(argv, T_STRING, T_ARG_END))
         return vnull();
-    char *raw_string = GET_STRING(argv[0]);
+    if (IS_FROZEN(argv[0]))
+        return vtagged_error(E_CONST_ERROR,
+                             "str.pop_f(str): Cannot pop a frozen string");
+    const char *raw_string = GET_STRING_BYTES(argv[0]);
+    size_t len = GET_STRING_LEN(argv[0]);
+    if (!len)
+        return vnull();
     char ch = *raw_string; // get first char
 
-    char *copy = mila_strdup(raw_string + 1);
+    char *rest = mstring_view(GET_MSTRING(argv[0]), raw_string + 1, len - 1);
 
-    mila_free(argv[0]->v);
-    argv[0]->v = (void *)copy;
+    mstring_release((char *)argv[0]->v);
+    argv[0]->v = (void *)rest;
 
     return vstring_dup((char[]){ch, 0});
 }
@@ -668,15 +929,19 @@ Value *native_str_pop_end(Env *env, int argc, Value **argv) {
     (void)argc;
     if (!match_types(argv, T_STRING, T_ARG_END))
         return vnull();
-    char *raw_string = GET_STRING(argv[0]);
-    char ch = *(raw_string + strlen(raw_string) - 1); // get last char
+    if (IS_FROZEN(argv[0]))
+        return vtagged_error(E_CONST_ERROR,
+                             "str.pop_b(str): Cannot pop a frozen string");
+    const char *raw_string = GET_STRING_BYTES(argv[0]);
+    size_t len = GET_STRING_LEN(argv[0]);
+    if (!len)
+        return vnull();
+    char ch = raw_string[len - 1]; // get last char
 
-    uint64_t size = strlen(raw_string) - 1;
-    char *copy = (char *)mila_malloc(sizeof(char) * size);
-    memcpy(copy, raw_string, size);
+    char *rest = mstring_view(GET_MSTRING(argv[0]), raw_string, len - 1);
 
-    mila_free(argv[0]->v);
-    argv[0]->v = (void *)copy;
+    mstring_release((char *)argv[0]->v);
+    argv[0]->v = (void *)rest;
 
     return vstring_dup((char[]){ch, 0});
 }
@@ -705,13 +970,10 @@ Value *native_str_slice(Env *env, int argc, Value **argv) {
           match_types(argv, T_STRING, T_INT, T_INT, T_ARG_END)))
         return verror(
             "str.slice(str, index, len): Expected atleast 2 arguments.");
-    if (argc == 3) {
-        return vstring_slice(GET_STRING(argv[0]), argv[1]->v->i, argv[2]->v->i);
-    } else {
-        return vstring_slice(
-            GET_STRING(argv[0]), GET_INTEGER(argv[1]),
-            strlen(GET_STRING(argv[0]) + GET_INTEGER(argv[1])));
-    }
+    if (GET_INTEGER(argv[1]) < 0 || (argc == 3 && GET_INTEGER(argv[2]) < 0))
+        return verror("str.slice(str, index, len): Negative index or length.");
+    return vstring_view(argv[0], (size_t)GET_INTEGER(argv[1]),
+                        argc == 3 ? (size_t)GET_INTEGER(argv[2]) : SIZE_MAX);
 }
 
 Value *native_str_copy(Env *env, int argc, Value **argv) {
@@ -752,33 +1014,49 @@ Value *native_str_patch(Env *env, int argc, Value **argv) {
                            GET_STRING(argv[2]));
 }
 
+// The pattern argument can be a string or a pattern.compile'd one
 Value *native_str_match_replace(Env *env, int argc, Value **argv) {
     (void)env;
-    (void)argc;
-    if (!match_types(argv, T_STRING, T_STRING, T_STRING, T_ARG_END))
+    if (argc != 3 || GET_TYPE(argv[0]) != T_STRING ||
+        GET_TYPE(argv[2]) != T_STRING)
         return vnull();
-    return vstring_take(replace_match(GET_STRING(argv[1]), GET_STRING(argv[0]),
-                                      GET_STRING(argv[2]), -1));
+    MGlob *g = glob_from_value(argv[1]);
+    if (!g)
+        return vnull();
+    Value *res = vstring_take(glob_replace(g, GET_STRING(argv[0]),
+                                           GET_STRING(argv[2]), -1, 1, 1));
+    glob_release(g);
+    return res;
+}
+
+// Leftmost longest match of pattern in str, -1 when there is none
+static long str_match_find(Value *str, MGlob *g, size_t *len) {
+    const char *s = mstring_cstr((char *)str->v);
+    size_t start;
+    int found = glob_find(g, s, strlen(s), 1, &start, len);
+    glob_release(g);
+    return found ? (long)start : -1;
 }
 
 Value *native_str_match_find(Env *env, int argc, Value **argv) {
     (void)env;
-    (void)argc;
-    if (!match_types(argv, T_STRING, T_STRING, T_ARG_END))
+    MGlob *g;
+    if (argc != 2 || GET_TYPE(argv[0]) != T_STRING ||
+        !(g = glob_from_value(argv[1])))
         return vnull();
-    return vint(
-        find_match_index(GET_STRING(argv[1]), GET_STRING(argv[0]), NULL));
+    size_t len;
+    return vint(str_match_find(argv[0], g, &len));
 }
 
 Value *native_str_match_findx(Env *env, int argc, Value **argv) {
     (void)env;
-    (void)argc;
-    if (!match_types(argv, T_STRING, T_STRING, T_ARG_END))
+    MGlob *g;
+    if (argc != 2 || GET_TYPE(argv[0]) != T_STRING ||
+        !(g = glob_from_value(argv[1])))
         return vnull();
     size_t len = 0;
-    return make_list(
-        vint(find_match_index(GET_STRING(argv[1]), GET_STRING(argv[0]), &len)),
-        vint(len), NULL);
+    long at = str_match_find(argv[0], g, &len);
+    return make_list(vint(at), vint((long)len), NULL);
 }
 
 Value *native_str_len(Env *env, int argc, Value **argv) {
@@ -786,7 +1064,14 @@ Value *native_str_len(Env *env, int argc, Value **argv) {
     (void)argc;
     if (!match_types(argv, T_STRING, T_ARG_END))
         return vnull();
-    return vint(strlen(GET_STRING(argv[0])));
+    return vint((long)GET_STRING_LEN(argv[0]));
+}
+
+// A part of a string for the splitters, the longer ones share its bytes
+static Value *str_part(MString *str, const char *bytes, size_t len) {
+    if (len < MSTRING_VIEW_MIN)
+        return vstring_len(bytes, len);
+    return vstring_mstring(mstring_view(str, bytes, len));
 }
 
 Value *native_str_split(Env *env, int argc, Value **argv) {
@@ -799,19 +1084,138 @@ Value *native_str_split(Env *env, int argc, Value **argv) {
     if (GET_TYPE(argv[1]) != T_STRING)
         return verror(
             "str.split(string, deliminator): Must string be a string!");
-    char *save_ptr = NULL;
-    char *copy = mila_strdup(GET_STRING(argv[0]));
+    // any of the delimiter's bytes splits, empty parts are dropped
+    StrSet delim;
+    strset_init(&delim, GET_STRING_BYTES(argv[1]), GET_STRING_LEN(argv[1]));
+    const StrKernels *k = str_kernels();
+
+    // the parts are views of the string, only their headers are new
+    MString *str = GET_MSTRING(argv[0]);
+    const char *bytes = MSTRING_BYTES(str);
+    Value *list = make_list(NULL);
+    LinkedList *parts = (LinkedList *)GET_OPAQUE(list);
+    size_t start = 0;
+    while (start <= str->len) {
+        size_t i = start + k->scan(bytes + start, str->len - start, &delim);
+        if (i > start)
+            ll_append(parts, str_part(str, bytes + start, i - start));
+        start = i + 1;
+    }
+    return list;
+}
 
+// The next part of a split on the exact delimiter, NULL after the last
+Value *str_split_iter_next(StrSplitState *state) {
+    if (state->done)
+        return NULL;
+    const char *bytes = MSTRING_BYTES(state->str) + state->pos;
+    size_t rest = state->str->len - state->pos;
+    size_t len = state->left == 0 ? STR_NPOS
+                                  : str_kernels()->find(bytes, rest,
+                                                        state->delim,
+                                                        state->delim_len);
+    if (len == STR_NPOS) {
+        len = rest;
+        state->done = 1;
+    } else if (state->left > 0)
+        state->left--;
+    state->pos += len + state->delim_len;
+    return str_part(state->str, bytes, len);
+}
+
+static Value *str_split_args(int argc, Value **argv, long *max,
+                             const char *who) {
+    if (argc != 2 && argc != 3)
+        return verror("%s: Expected a string, a delimiter and a max", who);
+    if (GET_TYPE(argv[0]) != T_STRING || GET_TYPE(argv[1]) != T_STRING)
+        return verror("%s: Must string and delim be strings!", who);
+    if (GET_STRING_LEN(argv[1]) == 0)
+        return verror("%s: Can't split on an empty delim", who);
+    if (argc == 3 && GET_TYPE(argv[2]) != T_INT)
+        return verror("%s: Must max be an int!", who);
+    *max = argc == 3 && GET_INTEGER(argv[2]) >= 0 ? GET_INTEGER(argv[2]) : -1;
+    return NULL;
+}
+
+// Unlike str.split, the delimiter is matched as a whole and empty parts
+// are kept, "a,,b" is three parts and "" is one
+Value *native_str_split_exact(Env *env, int argc, Value **argv) {
+    (void)env;
+    long max = -1;
+    Value *err = str_split_args(argc, argv, &max,
+                                "str.split_exact(string, delim, max)");
+    if (err)
+        return err;
+    StrSplitState state = {
+        .str = GET_MSTRING(argv[0]),
+        .delim = GET_STRING_BYTES(argv[1]),
+        .delim_len = GET_STRING_LEN(argv[1]),
+        .left = max,
+    };
     Value *list = make_list(NULL);
+    LinkedList *parts = (LinkedList *)GET_OPAQUE(list);
+    Value *part;
+    while ((part = str_split_iter_next(&state)))
+        ll_append(parts, part);
+    return list;
+}
 
-    char *part = strtok_r(copy, GET_STRING(argv[1]), &save_ptr);
-    while (part) {
-        val_release(call_native_with(NULL, native_list_append, val_retain(list),
-                                     vstring_dup(part), NULL));
-        part = strtok_r(NULL, GET_STRING(argv[1]), &save_ptr);
+Value *native_str_split_iter(Env *env, int argc, Value **argv) {
+    (void)env;
+    long max = -1;
+    Value *err = str_split_args(argc, argv, &max,
+                                "str.split_iter(string, delim, max)");
+    if (err)
+        return err;
+    size_t delim_len = GET_STRING_LEN(argv[1]);
+    StrSplit *split = (StrSplit *)mila_malloc(sizeof(StrSplit));
+    if (!split || !(split->delim = (char *)mila_malloc(delim_len))) {
+        mila_free(split);
+        return verror("str.split_iter(string, delim, max): Out of memory");
     }
-    free(copy);
-    return list;
+    memcpy(split->delim, GET_STRING_BYTES(argv[1]), delim_len);
+    // pop_f and pop_b swap a string's buffer, the split keeps the one it
+    // was given
+    split->str = GET_MSTRING(argv[0]);
+    ML_REF_INC(split->str);
+    split->delim_len = delim_len;
+    split->max = max;
+    Value *res = vopaque_extra(split, NULL, MILA_LPREFIX "split_iter");
+    val_set_table(res, str_split_meta);
+    return res;
+}
+
+StrSplitState *str_split_iter_init(Value *self) {
+    StrSplit *split = (StrSplit *)GET_OPAQUE(self);
+    StrSplitState *state = (StrSplitState *)mila_malloc(sizeof(StrSplitState));
+    if (!state)
+        return NULL;
+    state->str = split->str;
+    ML_REF_INC(state->str);
+    state->delim = split->delim;
+    state->delim_len = split->delim_len;
+    state->pos = 0;
+    state->left = split->max;
+    state->done = 0;
+    return state;
+}
+
+void str_split_iter_cleanup(StrSplitState *state) {
+    mstring_release(state->str->data);
+    mila_free(state);
+}
+
+Value *str_split_str(Value *self) {
+    StrSplit *split = (StrSplit *)GET_OPAQUE(self);
+    return vstring_fmt("split_iter(<%zu bytes>)", split->str->len);
+}
+
+Value *str_split_free(Value *self) {
+    StrSplit *split = (StrSplit *)GET_OPAQUE(self);
+    mstring_release(split->str->data);
+    mila_free(split->delim);
+    mila_free(split);
+    return NULL;
 }
 
 Value *native_str_join(Env *env, int argc, Value **argv) {
@@ -822,24 +1226,36 @@ Value *native_str_join(Env *env, int argc, Value **argv) {
         return verror("str.join(delim, list): Must deliminator be a string!");
     if (strcmp(GET_TYPENAME(argv[1]), MILA_LPREFIX "list"))
         return verror("str.join(delim, list): Must list be a list!");
-    char *delim = GET_STRING(argv[0]), *string = NULL;
+    const char *delim = GET_STRING_BYTES(argv[0]);
+    size_t delim_len = GET_STRING_LEN(argv[0]);
     LinkedList *l = (LinkedList *)GET_OPAQUE(argv[1]);
-    for (LLNode *v = l->head; v; v = v->next) {
-        char *vstr = as_c_string(v->value);
-        malloc_sprintf(&string, "%s", vstr);
-        if (v->next)
-            malloc_sprintf(&string, "%s", delim);
-        free(vstr);
+    strbuf out;
+    sb_init(&out);
+    for (size_t i = 0; i < l->size; i++) {
+        Value *item = l->items[i];
+        if (item && item->type == T_STRING)
+            sb_append(&out, GET_STRING_BYTES(item), GET_STRING_LEN(item));
+        else {
+            char *vstr = as_c_string(item);
+            if (vstr)
+                sb_append_str(&out, vstr);
+            free(vstr);
+        }
+        if (i + 1 < l->size)
+            sb_append(&out, delim, delim_len);
     }
-    return vstring_take(string);
+    return vstring_mstring(sb_mstring(&out));
 }
 
 Value *native_str_startsw(Env *env, int argc, Value **argv) {
     if (argc != 2)
         return verror("str.startswith(str, pref): Expected 2 arguments!");
-    char *str = GET_STRING(argv[0]);
-    char *prefix = GET_STRING(argv[1]);
-    if (strncmp(prefix, str, strlen(prefix)) == 0)
+    if (GET_TYPE(argv[0]) != T_STRING || GET_TYPE(argv[1]) != T_STRING)
+        return verror("str.startswith(str, pref): Expected 2 strings!");
+    size_t pref_len = GET_STRING_LEN(argv[1]);
+    if (pref_len <= GET_STRING_LEN(argv[0]) &&
+        memcmp(GET_STRING_BYTES(argv[0]), GET_STRING_BYTES(argv[1]),
+               pref_len) == 0)
         return vbool(1);
     return vbool(0);
 }
@@ -847,79 +1263,80 @@ Value *native_str_startsw(Env *env, int argc, Value **argv) {
 Value *native_str_endsw(Env *env, int argc, Value **argv) {
     if (argc != 2)
         return verror("str.endswith(str, suf): Expected 2 arguments!");
-    char *str = GET_STRING(argv[0]);
-    char *prefix = GET_STRING(argv[1]);
-    if (strcmp(prefix, str + (strlen(str) - strlen(prefix))) == 0)
+    if (GET_TYPE(argv[0]) != T_STRING || GET_TYPE(argv[1]) != T_STRING)
+        return verror("str.endswith(str, suf): Expected 2 strings!");
+    size_t len = GET_STRING_LEN(argv[0]), suf_len = GET_STRING_LEN(argv[1]);
+    if (suf_len <= len && memcmp(GET_STRING_BYTES(argv[0]) + len - suf_len,
+                                 GET_STRING_BYTES(argv[1]), suf_len) == 0)
         return vbool(1);
     return vbool(0);
 }
 
+// Searches the bytes of haystack, strings with NUL bytes in them are
+// searched in full
+static size_t str_search(Value *needle, Value *haystack, int caseless) {
+    const StrKernels *k = str_kernels();
+    return (caseless ? k->find_caseless : k->find)(
+        GET_STRING_BYTES(haystack), GET_STRING_LEN(haystack),
+        GET_STRING_BYTES(needle), GET_STRING_LEN(needle));
+}
+
 Value *native_str_contains(Env *env, int argc, Value **argv) {
     if (argc != 2)
         return verror("str.contains(needle, haystack): Expected 2 arguments!");
-    char *needle = GET_STRING(argv[0]);
-    char *haystack = GET_STRING(argv[1]);
-    if (strstr(haystack, needle))
-        return vbool(1);
-    return vbool(0);
+    if (GET_TYPE(argv[0]) != T_STRING || GET_TYPE(argv[1]) != T_STRING)
+        return verror("str.contains(needle, haystack): Expected 2 strings!");
+    return vbool(str_search(argv[0], argv[1], 0) != STR_NPOS);
 }
 
 Value *native_str_contains_caseless(Env *env, int argc, Value **argv) {
     if (argc != 2)
         return verror(
             "str.contains_caseless(needle, haystack): Expected 2 arguments!");
-    char *needle = GET_STRING(argv[0]);
-    char *haystack = GET_STRING(argv[1]);
-    if (strcasestr(haystack, needle))
-        return vbool(1);
-    return vbool(0);
+    if (GET_TYPE(argv[0]) != T_STRING || GET_TYPE(argv[1]) != T_STRING)
+        return verror(
+            "str.contains_caseless(needle, haystack): Expected 2 strings!");
+    return vbool(str_search(argv[0], argv[1], 1) != STR_NPOS);
 }
 
 Value *native_str_find(Env *env, int argc, Value **argv) {
     if (argc != 2)
-        return verror(
-            "str.caseless_find(needle, haystack): Expected 2 arguments!");
-    char *needle = GET_STRING(argv[0]);
-    char *haystack = GET_STRING(argv[1]);
-    char *v = strstr(haystack, needle);
-    if (!v)
-        return vint(-1);
-    long index = v - haystack;
-    return vint(index);
+        return verror("str.find(needle, haystack): Expected 2 arguments!");
+    if (GET_TYPE(argv[0]) != T_STRING || GET_TYPE(argv[1]) != T_STRING)
+        return verror("str.find(needle, haystack): Expected 2 strings!");
+    size_t index = str_search(argv[0], argv[1], 0);
+    return vint(index == STR_NPOS ? -1 : (long)index);
 }
 
 Value *native_str_caseless_find(Env *env, int argc, Value **argv) {
     if (argc != 2)
-        return verror("str.find(needle, haystack): Expected 2 arguments!");
-    char *needle = GET_STRING(argv[0]);
-    char *haystack = GET_STRING(argv[1]);
-    char *v = strcasestr(haystack, needle);
-    if (!v)
-        return vint(-1);
-    long index = v - haystack;
-    return vint(index);
+        return verror(
+            "str.caseless_find(needle, haystack): Expected 2 arguments!");
+    if (GET_TYPE(argv[0]) != T_STRING || GET_TYPE(argv[1]) != T_STRING)
+        return verror(
+            "str.caseless_find(needle, haystack): Expected 2 strings!");
+    size_t index = str_search(argv[0], argv[1], 1);
+    return vint(index == STR_NPOS ? -1 : (long)index);
+}
+
+static Value *str_fold(Value *str, int upper) {
+    size_t len = GET_STRING_LEN(str);
+    char *buf = mstring_alloc(len);
+    if (!buf)
+        return verror("str.%s(str): Out of memory",
+                      upper ? "toupper" : "tolower");
+    str_kernels()->fold(GET_STRING_BYTES(str), buf, len, upper);
+    return vstring_mstring(buf);
 }
 
 Value *native_str_toupper(Env *env, int argc, Value **argv) {
-    if (argc != 1)
+    if (argc != 1 || GET_TYPE(argv[0]) != T_STRING)
         return verror("str.toupper(str): Expected 1 argument!");
-    char *str = GET_STRING(argv[0]);
-    size_t len = strlen(str);
-    char *upper = mila_malloc(sizeof(char) * len + 1);
-    upper[len - 1] = 0;
-    for (size_t i = 0; i < len; ++i)
-        upper[i] = toupper(str[i]);
-    return vstring_take(upper);
+    return str_fold(argv[0], 1);
 }
 
 Value *native_str_tolower(Env *env, int argc, Value **argv) {
-    if (argc != 1)
+    if (argc != 1 || GET_TYPE(argv[0]) != T_STRING)
         return verror("str.tolower(str): Expected 1 argument!");
-    char *str = GET_STRING(argv[0]);
-    size_t len = strlen(str);
-    char *upper = mila_malloc(sizeof(char) * len + 1);
-    upper[len - 1] = 0;
-    for (size_t i = 0; i < len; ++i)
-        upper[i] = tolower(str[i]);
-    return vstring_take(upper);
+    return str_fold(argv[0], 0);
 }
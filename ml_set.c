@@ -0,0 +1,253 @@
+// This project is licensed under the GNU Affero General Public License
+#pragma once
+
+#include "mila.h"
+#include "ml_dict.h"
+#include "ml_primitives.h"
+#include "ml_set.h"
+
+#define IS_SET(val)                                                            \
+    (GET_TYPE(val) == T_OPAQUE && (val)->method_table == set_meta && (val)->v)
+
+// Scalars are keys by value, anything else is keyed by its repr and also
+// kept as the entry's value so it comes back out of the set as it went in
+static int set_put(Dict *members, Value *item) {
+    switch (GET_TYPE(item)) {
+    case T_INT:
+    case T_UINT:
+    case T_FLOAT:
+    case T_BOOL:
+    case T_STRING:
+        return dict_set(members, item, NULL);
+    default: {
+        Value *member = val_copy(item);
+        int res = dict_set(members, item, member);
+        val_release(member);
+        return res;
+    }
+    }
+}
+
+static Value *set_member(DictEntry *entry) {
+    return entry->value ? val_copy(entry->value) : dict_entry_key(entry);
+}
+
+Value *set_new(Dict *members) {
+    Value *res = vopaque_extra(members, NULL, MILA_LPREFIX "set");
+    val_set_table(res, set_meta);
+    return res;
+}
+
+static Value *set_build(Value *self, int repr) {
+    Dict *members = (Dict *)self->v;
+    if (repr && members->size > MAX_ITEMS_DISPLAYED)
+        return vstring_fmt("set(<%zu items>)", members->size);
+
+    char *buffer = NULL;
+    malloc_sprintf(&buffer, "set(");
+    int first = 1;
+    ITERATE_DICT(members) {
+        char *key_str = entry->by_repr ? NULL : as_c_string_repr(entry->key);
+        malloc_sprintf(&buffer, "%s%s", first ? "" : ", ",
+                       entry->by_repr ? GET_STRING(entry->key) : key_str);
+        mila_free(key_str);
+        first = 0;
+    }
+    malloc_sprintf(&buffer, ")");
+    return vstring_take(buffer);
+}
+
+Value *set_str(Value *self) { return set_build(self, 0); }
+
+Value *set_repr(Value *self) { return set_build(self, 1); }
+
+Value *set_free(Value *self) {
+    Dict *members = (Dict *)self->v;
+    if (ML_REF_DEC(members) == 0)
+        dict_free(members);
+    return NULL;
+}
+
+Value *set_copy(Value *self) {
+    Dict *members = (Dict *)self->v;
+    if (val_copy_shares(self))
+        ML_REF_INC(members);
+    else {
+        val_copy_depth++;
+        members = dict_clone(members);
+        val_copy_depth--;
+        if (!members)
+            return verror("copy(set): Couldn't copy the set");
+    }
+    return set_new(members);
+}
+
+// The loop walks the members as they were when it started, adding or
+// removing from the set in the body unshares it first.
+SetIterState *set_iter_init(Value *self) {
+    SetIterState *state = (SetIterState *)mila_malloc(sizeof(SetIterState));
+    state->storage = (Dict *)self->v;
+    ML_REF_INC(state->storage);
+    state->index = 0;
+    return state;
+}
+
+Value *set_iter_next(SetIterState *state) {
+    Dict *members = state->storage;
+    while (state->index < members->used) {
+        DictEntry *entry = &members->entries[state->index++];
+        if (entry->key)
+            return set_member(entry);
+    }
+    return NULL;
+}
+
+void set_iter_cleanup(SetIterState *state) {
+    if (ML_REF_DEC(state->storage) == 0)
+        dict_free(state->storage);
+    free(state);
+}
+
+// Adds every item of a value that can be iterated with foreach
+static Value *set_add_all(Dict *members, Value *from) {
+    if (IS_SET(from)) {
+        ITERATE_DICT((Dict *)from->v) {
+            dict_set_entry(members, (Dict *)from->v, entry, entry->value);
+        }
+        return NULL;
+    }
+    if (!GET_METHOD(from, UMethodStepIterInit) ||
+        !GET_METHOD(from, UMethodStepIter) ||
+        !GET_METHOD(from, UMethodStepIterClean))
+        return verror("set.from(iterable): %s can't be iterated",
+                      GET_TYPENAME(from));
+    void *state = ((unary_method)from->method_table[UMethodStepIterInit])(from);
+    if (!state)
+        return verror("set.from(iterable): Iterable initialization failed");
+    Value *item, *err = NULL;
+    while ((item = ((unary_method)from->method_table[UMethodStepIter])(state))) {
+        if (IS_ERROR(item)) {
+            err = item;
+            break;
+        }
+        set_put(members, item);
+        val_release(item);
+    }
+    ((unary_method)from->method_table[UMethodStepIterClean])(state);
+    return err;
+}
+
+Value *native_set_new(Env *env, int argc, Value **argv) {
+    (void)env;
+    Dict *members = dict_create();
+    if (!members)
+        return verror("set(...): Couldn't make a set");
+    for (int i = 0; i < argc; i++)
+        set_put(members, argv[i]);
+    return set_new(members);
+}
+
+Value *native_set_from(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 1)
+        return verror("set.from(iterable): Expected one argument");
+    Dict *members = dict_create();
+    if (!members)
+        return verror("set.from(iterable): Couldn't make a set");
+    Value *err = set_add_all(members, argv[0]);
+    if (err) {
+        dict_free(members);
+        return err;
+    }
+    return set_new(members);
+}
+
+Value *native_set_add(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc < 1 || !IS_SET(argv[0]))
+        return verror("set.add(s, ...items): Expected a set");
+    if (IS_FROZEN(argv[0]))
+        return vtagged_error(E_CONST_ERROR, "set.add(s, ...items): set is frozen");
+    dict_unshare(argv[0]);
+    for (int i = 1; i < argc; i++)
+        set_put((Dict *)argv[0]->v, argv[i]);
+    return vnull();
+}
+
+Value *native_set_rem(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 2 || !IS_SET(argv[0]))
+        return verror("set.rem(s, item): Expected a set and an item");
+    if (IS_FROZEN(argv[0]))
+        return vtagged_error(E_CONST_ERROR, "set.rem(s, item): set is frozen");
+    dict_unshare(argv[0]);
+    return vbool(dict_remove((Dict *)argv[0]->v, argv[1]));
+}
+
+Value *native_set_contains(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 2 || !IS_SET(argv[0]))
+        return verror("set.contains(s, item): Expected a set and an item");
+    return vbool(dict_has((Dict *)argv[0]->v, argv[1]));
+}
+
+Value *native_set_len(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 1 || !IS_SET(argv[0]))
+        return verror("set.len(s): Expected a set");
+    return vint((long)((Dict *)argv[0]->v)->size);
+}
+
+Value *native_set_union(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 2 || !IS_SET(argv[0]) || !IS_SET(argv[1]))
+        return verror("set.union(a, b): Expected two sets");
+    Dict *members = dict_clone((Dict *)argv[0]->v);
+    if (!members)
+        return verror("set.union(a, b): Couldn't make a set");
+    set_add_all(members, argv[1]);
+    return set_new(members);
+}
+
+// Members of a that are (keep = 1) or are not (keep = 0) in b
+static Value *set_filter(Value *a, Value *b, int keep) {
+    Dict *from = (Dict *)a->v, *other = (Dict *)b->v;
+    Dict *members = dict_create();
+    if (!members)
+        return verror("set: Couldn't make a set");
+    ITERATE_DICT(from) {
+        if (dict_has_entry(other, from, entry) == keep)
+            dict_set_entry(members, from, entry, entry->value);
+    }
+    return set_new(members);
+}
+
+Value *native_set_intersection(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 2 || !IS_SET(argv[0]) || !IS_SET(argv[1]))
+        return verror("set.intersection(a, b): Expected two sets");
+    // walk the smaller one
+    if (((Dict *)argv[0]->v)->size > ((Dict *)argv[1]->v)->size)
+        return set_filter(argv[1], argv[0], 1);
+    return set_filter(argv[0], argv[1], 1);
+}
+
+Value *native_set_difference(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 2 || !IS_SET(argv[0]) || !IS_SET(argv[1]))
+        return verror("set.difference(a, b): Expected two sets");
+    return set_filter(argv[0], argv[1], 0);
+}
+
+Value *native_set_to_list(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 1 || !IS_SET(argv[0]))
+        return verror("set.to_list(s): Expected a set");
+    Dict *members = (Dict *)argv[0]->v;
+    LinkedList *list = ll_create();
+    ll_reserve(list, members->size);
+    ITERATE_DICT(members) { ll_append(list, set_member(entry)); }
+    Value *res = vopaque_extra(list, NULL, MILA_LPREFIX "list");
+    val_set_table(res, list_meta);
+    return res;
+}
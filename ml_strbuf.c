@@ -0,0 +1,266 @@
+// This project is licensed under the GNU Affero General Public License
+#pragma once
+
+#include <string.h>
+
+#include "mila.h"
+#include "ml_primitives.h"
+#include "ml_strbuf.h"
+#include "ml_string.h"
+
+#define IS_STRBUF(val)                                                         \
+    (GET_TYPE(val) == T_OPAQUE && (val)->method_table == strbuf_meta &&        \
+     (val)->v)
+
+// Longest conversion append_fmt takes, flags and width included
+#define STRBUF_SPEC_MAX 24
+
+strbuf *strbuf_create(void) {
+    strbuf *sb = (strbuf *)mila_malloc(sizeof(strbuf));
+    if (!sb)
+        return NULL;
+    sb_init(sb);
+    if (!sb->buf) {
+        mila_free(sb);
+        return NULL;
+    }
+    return sb;
+}
+
+void strbuf_destroy(strbuf *sb) {
+    if (!sb)
+        return;
+    sb_free(sb);
+    mila_free(sb);
+}
+
+Value *strbuf_new(strbuf *sb) {
+    Value *res = vopaque_extra(sb, NULL, MILA_LPREFIX "strbuf");
+    val_set_table(res, strbuf_meta);
+    return res;
+}
+
+Value *strbuf_str(Value *self) {
+    strbuf *sb = (strbuf *)self->v;
+    return vstring_len(sb->buf, sb->len);
+}
+
+Value *strbuf_repr(Value *self) {
+    return vstring_fmt("strbuf(<%zu bytes>)", ((strbuf *)self->v)->len);
+}
+
+Value *strbuf_free(Value *self) {
+    strbuf_destroy((strbuf *)self->v);
+    return NULL;
+}
+
+Value *strbuf_copy(Value *self) {
+    strbuf *sb = (strbuf *)self->v, *copy = strbuf_create();
+    if (!copy || !sb_append(copy, sb->buf, sb->len)) {
+        strbuf_destroy(copy);
+        return verror("copy(strbuf): Couldn't copy the builder");
+    }
+    return strbuf_new(copy);
+}
+
+// Strings go in as they are, anything else the way print shows it
+static int strbuf_append_value(strbuf *sb, Value *v) {
+    if (v && v->type == T_STRING)
+        return sb_append(sb, GET_STRING_BYTES(v), GET_STRING_LEN(v));
+    char *s = as_c_string(v);
+    if (!s)
+        return 0;
+    int ok = sb_append_str(sb, s);
+    mila_free(s);
+    return ok;
+}
+
+static Value *strbuf_check_mut(int argc, Value **argv, const char *who) {
+    if (argc < 1 || !IS_STRBUF(argv[0]))
+        return verror("%s: Expected a strbuf", who);
+    if (IS_FROZEN(argv[0]))
+        return vtagged_error(E_CONST_ERROR, "%s: strbuf is frozen", who);
+    return NULL;
+}
+
+// printf style formatting of args into sb, the conversion picks how each
+// argument is read: d i c as integers, u o x X as unsigned, e f g as
+// floats and s as a string
+static Value *strbuf_format(strbuf *sb, const char *fmt, int argc,
+                            Value **argv, const char *who) {
+    int used = 0;
+    for (const char *p = fmt; *p;) {
+        const char *pct = strchr(p, '%');
+        if (!pct) {
+            sb_append_str(sb, p);
+            break;
+        }
+        sb_append(sb, p, (size_t)(pct - p));
+        if (pct[1] == '%') {
+            sb_append(sb, "%", 1);
+            p = pct + 2;
+            continue;
+        }
+        const char *q = pct + 1;
+        q += strspn(q, "-+ #0");
+        q += strspn(q, "0123456789");
+        if (*q == '.') {
+            q++;
+            q += strspn(q, "0123456789");
+        }
+        size_t spec_len = (size_t)(q - pct);
+        if (!*q || spec_len > STRBUF_SPEC_MAX)
+            return verror("%s: Bad conversion at '%s'", who, pct);
+        if (used >= argc)
+            return verror("%s: Not enough arguments for the format", who);
+        Value *arg = argv[used++];
+        // the flags and width as written, then the C length for the value
+        char spec[STRBUF_SPEC_MAX + 4];
+        memcpy(spec, pct, spec_len);
+        char conv = *q;
+        int type = GET_TYPE(arg);
+        int number = type == T_INT || type == T_UINT || type == T_FLOAT ||
+                     type == T_BOOL;
+        double d = 0;
+        long i = 0;
+        if (type == T_FLOAT)
+            i = (long)(d = GET_FLOAT(arg));
+        else if (type == T_BOOL)
+            d = (double)(i = GET_BOOL(arg) != 0);
+        else if (type == T_UINT)
+            d = (double)GET_UINTEGER(arg), i = (long)GET_UINTEGER(arg);
+        else if (type == T_INT)
+            d = (double)(i = GET_INTEGER(arg));
+        switch (conv) {
+        case 'd':
+        case 'i':
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            if (!number)
+                return verror("%s: %%%c needs a number, got %s", who, conv,
+                              GET_TYPENAME(arg));
+            memcpy(spec + spec_len, (char[]){'l', conv, '\0'}, 3);
+            if (conv == 'd' || conv == 'i')
+                sb_appendf(sb, spec, i);
+            else
+                sb_appendf(sb, spec, (unsigned long)i);
+            break;
+        case 'c':
+            if (type != T_INT && type != T_UINT)
+                return verror("%s: %%c needs an integer, got %s", who,
+                              GET_TYPENAME(arg));
+            memcpy(spec + spec_len, "c", 2);
+            sb_appendf(sb, spec, (int)i);
+            break;
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G':
+            if (!number)
+                return verror("%s: %%%c needs a number, got %s", who, conv,
+                              GET_TYPENAME(arg));
+            memcpy(spec + spec_len, (char[]){conv, '\0'}, 2);
+            sb_appendf(sb, spec, d);
+            break;
+        case 's': {
+            memcpy(spec + spec_len, "s", 2);
+            // no width or precision, the bytes can go in as they are
+            if (spec_len == 1) {
+                if (!strbuf_append_value(sb, arg))
+                    return verror("%s: Out of memory", who);
+                break;
+            }
+            char *s = type == T_STRING ? NULL : as_c_string(arg);
+            sb_appendf(sb, spec, s ? s : GET_STRING(arg));
+            mila_free(s);
+            break;
+        }
+        default:
+            return verror("%s: Unknown conversion '%%%c'", who, conv);
+        }
+        p = q + 1;
+    }
+    if (used < argc)
+        return verror("%s: %d arguments left over after the format", who,
+                      argc - used);
+    return NULL;
+}
+
+Value *native_strbuf_new(Env *env, int argc, Value **argv) {
+    (void)env;
+    strbuf *sb = strbuf_create();
+    if (!sb)
+        return verror("strbuf(...parts): Couldn't make a builder");
+    for (int i = 0; i < argc; i++) {
+        if (!strbuf_append_value(sb, argv[i])) {
+            strbuf_destroy(sb);
+            return verror("strbuf(...parts): Out of memory");
+        }
+    }
+    return strbuf_new(sb);
+}
+
+Value *native_strbuf_append(Env *env, int argc, Value **argv) {
+    (void)env;
+    Value *err = strbuf_check_mut(argc, argv, "strbuf.append(sb, ...parts)");
+    if (err)
+        return err;
+    strbuf *sb = (strbuf *)argv[0]->v;
+    for (int i = 1; i < argc; i++)
+        if (!strbuf_append_value(sb, argv[i]))
+            return verror("strbuf.append(sb, ...parts): Out of memory");
+    return vnull();
+}
+
+Value *native_strbuf_append_fmt(Env *env, int argc, Value **argv) {
+    (void)env;
+    const char *who = "strbuf.append_fmt(sb, fmt, ...args)";
+    Value *err = strbuf_check_mut(argc, argv, who);
+    if (err)
+        return err;
+    if (argc < 2 || GET_TYPE(argv[1]) != T_STRING)
+        return verror("%s: fmt must be a string", who);
+    strbuf *sb = (strbuf *)argv[0]->v;
+    size_t len = sb->len;
+    err = strbuf_format(sb, GET_STRING(argv[1]), argc - 2, argv + 2, who);
+    if (err) {
+        // nothing of a bad format is kept
+        sb->len = len;
+        if (sb->buf)
+            sb->buf[len] = '\0';
+        return err;
+    }
+    return vnull();
+}
+
+Value *native_strbuf_to_string(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 1 || !IS_STRBUF(argv[0]))
+        return verror("strbuf.to_string(sb): Expected a strbuf");
+    return strbuf_str(argv[0]);
+}
+
+Value *native_strbuf_len(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 1 || !IS_STRBUF(argv[0]))
+        return verror("strbuf.len(sb): Expected a strbuf");
+    return vint((long)((strbuf *)argv[0]->v)->len);
+}
+
+// Empties the builder, what it has grown to is kept for the next string
+Value *native_strbuf_clear(Env *env, int argc, Value **argv) {
+    (void)env;
+    Value *err = strbuf_check_mut(argc, argv, "strbuf.clear(sb)");
+    if (err)
+        return err;
+    if (argc != 1)
+        return verror("strbuf.clear(sb): Expected a strbuf");
+    strbuf *sb = (strbuf *)argv[0]->v;
+    sb->len = 0;
+    sb->buf[0] = '\0';
+    return vnull();
+}
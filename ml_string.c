@@ -2,6 +2,7 @@
 #pragma once
 
 #include "mila.h"
+#include "ml_string.h"
 #include <string.h>
 
 char *mila_strdup(const char *s) {
@@ -59,4 +60,184 @@ char *mila_strcat_alloc(const char *a, const char *b) {
 
     out[len_a + len_b] = '\0';
     return out;
-}
\ No newline at end of file
+}
+
+// len bytes for a string value plus the NUL, zeroed
+char *mstring_alloc(size_t len) {
+    if (len > SIZE_MAX - sizeof(MString) - 1)
+        return NULL;
+    MString *s = (MString *)mila_malloc(sizeof(MString) + len + 1);
+    if (!s)
+        return NULL;
+    s->len = len;
+    s->refcount = 1;
+    return s->data;
+}
+
+char *mstring_new(const char *s, size_t len) {
+    char *out = mstring_alloc(len);
+    if (out && len)
+        memcpy(out, s, len);
+    return out;
+}
+
+// A view of len bytes of base starting at bytes, base may be a view too
+char *mstring_view(MString *base, const char *bytes, size_t len) {
+    if (base->view)
+        base = base->view->base;
+    MString *s = (MString *)mila_malloc(sizeof(MString) + sizeof(MStringView));
+    if (!s)
+        return NULL;
+    s->len = len;
+    s->refcount = 1;
+    s->view = (MStringView *)s->data;
+    s->view->base = base;
+    s->view->bytes = bytes;
+    ML_REF_INC(base);
+    return s->data;
+}
+
+char *mstring_view_cstr(MString *m) {
+    MStringView *view = m->view;
+    char *cstr = __atomic_load_n(&view->cstr, __ATOMIC_ACQUIRE);
+    if (cstr)
+        return cstr;
+    if (!(cstr = mstring_new(view->bytes, m->len)))
+        return NULL;
+    // two threads may race here, the one that lost drops its copy
+    char *none = NULL;
+    if (!__atomic_compare_exchange_n(&view->cstr, &none, cstr, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        mila_free(MSTRING(cstr));
+        return none;
+    }
+    return cstr;
+}
+
+void mstring_release(char *s) {
+    if (!s)
+        return;
+    MString *m = MSTRING(s);
+    if (ML_REF_DEC(m) > 0)
+        return;
+    if (m->view) {
+        mstring_release(m->view->base->data);
+        mstring_release(m->view->cstr);
+    }
+    mila_free(m);
+}
+
+int mstring_eq(MString *a, MString *b) {
+    if (a == b)
+        return 1;
+    if (a->len != b->len)
+        return 0;
+    if (a->hash_seed && a->hash_seed == b->hash_seed && a->hash != b->hash)
+        return 0;
+    return memcmp(MSTRING_BYTES(a), MSTRING_BYTES(b), a->len) == 0;
+}
+
+void sb_init(strbuf *b) {
+    b->buf = NULL;
+    b->len = b->cap = 0;
+    sb_reserve(b, 15);
+}
+
+// Makes room for n more bytes
+int sb_reserve(strbuf *b, size_t n) {
+    if (n > SIZE_MAX - sizeof(MString) - b->len - 1)
+        return 0;
+    if (b->buf && b->len + n + 1 <= b->cap)
+        return 1;
+    size_t cap = b->cap ? b->cap : 16;
+    while (cap < b->len + n + 1)
+        cap = cap > (SIZE_MAX - sizeof(MString)) / 2 ? b->len + n + 1
+                                                      : cap * 2;
+    MString *m = (MString *)mila_realloc(b->buf ? MSTRING(b->buf) : NULL,
+                                         sizeof(MString) + cap);
+    if (!m)
+        return 0;
+    if (!b->buf)
+        m->data[0] = '\0';
+    b->buf = m->data;
+    b->cap = cap;
+    return 1;
+}
+
+int sb_append(strbuf *b, const char *data, size_t n) {
+    if (!sb_reserve(b, n))
+        return 0;
+    memcpy(b->buf + b->len, data, n);
+    b->len += n;
+    b->buf[b->len] = '\0';
+    return 1;
+}
+
+int sb_append_str(strbuf *b, const char *s) {
+    return sb_append(b, s, strlen(s));
+}
+
+int sb_appendf(strbuf *b, const char *fmt, ...) {
+    va_list args;
+    if (!sb_reserve(b, 0))
+        return 0;
+    va_start(args, fmt);
+    int n = vsnprintf(b->buf + b->len, b->cap - b->len, fmt, args);
+    va_end(args);
+    if (n < 0) {
+        b->buf[b->len] = '\0';
+        return 0;
+    }
+    // didn't fit, format again into the bigger buffer
+    if ((size_t)n >= b->cap - b->len) {
+        if (!sb_reserve(b, (size_t)n)) {
+            b->buf[b->len] = '\0';
+            return 0;
+        }
+        va_start(args, fmt);
+        vsnprintf(b->buf + b->len, b->cap - b->len, fmt, args);
+        va_end(args);
+    }
+    b->len += (size_t)n;
+    return 1;
+}
+
+// Takes the bytes out as a plain malloc'd string, b is left empty
+char *sb_cstr(strbuf *b) {
+    if (!b->buf)
+        return NULL;
+    char *block = (char *)MSTRING(b->buf);
+    memmove(block, b->buf, b->len + 1);
+    char *out = (char *)mila_realloc(block, b->len + 1);
+    b->buf = NULL;
+    b->len = b->cap = 0;
+    return out ? out : block;
+}
+
+// Takes the bytes out as a string buffer for vstring_mstring, b is left
+// empty
+char *sb_mstring(strbuf *b) {
+    if (!b->buf)
+        return NULL;
+    MString *m = MSTRING(b->buf);
+    // give back what growing left over when it's a lot
+    if (b->cap - b->len > 4096 && b->cap - b->len > b->len / 8) {
+        MString *fit =
+            (MString *)mila_realloc(m, sizeof(MString) + b->len + 1);
+        if (fit)
+            m = fit;
+    }
+    memset(m, 0, offsetof(MString, data));
+    m->len = b->len;
+    m->refcount = 1;
+    b->buf = NULL;
+    b->len = b->cap = 0;
+    return m->data;
+}
+
+void sb_free(strbuf *b) {
+    if (b->buf)
+        mila_free(MSTRING(b->buf));
+    b->buf = NULL;
+    b->len = b->cap = 0;
+}
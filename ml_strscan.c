@@ -0,0 +1,316 @@
+// This project is licensed under the GNU Affero General Public License
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "mila.h"
+#include "ml_strscan.h"
+
+#if ML_VEC_X86
+#include <immintrin.h>
+#endif
+
+void strset_init(StrSet *set, const char *bytes, size_t len) {
+    memset(set, 0, sizeof(StrSet));
+    for (size_t i = 0; i < len; i++) {
+        unsigned char b = (unsigned char)bytes[i];
+        if (set->table[b])
+            continue;
+        set->table[b] = 1;
+        if (set->count >= 0 && set->count < STRSET_VEC_MAX)
+            set->bytes[set->count++] = b;
+        else
+            set->count = -1;
+    }
+    if (set->count < 0)
+        set->count = 0;
+}
+
+static inline unsigned char str_lower(unsigned char c) {
+    return (unsigned)(c - 'A') < 26u ? c | 0x20 : c;
+}
+
+static int str_caseless_eq(const char *a, const char *b, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        if (str_lower((unsigned char)a[i]) != str_lower((unsigned char)b[i]))
+            return 0;
+    return 1;
+}
+
+// Plain C kernels, also used for what's left after the vector loops
+
+static size_t str_find_c(const char *hay, size_t n, const char *needle,
+                         size_t m) {
+    if (m == 0)
+        return 0;
+    if (m > n)
+        return STR_NPOS;
+    const char *end = hay + n - m + 1, *p = hay;
+    while ((p = (const char *)memchr(p, needle[0], (size_t)(end - p)))) {
+        if (p[m - 1] == needle[m - 1] && memcmp(p, needle, m) == 0)
+            return (size_t)(p - hay);
+        p++;
+    }
+    return STR_NPOS;
+}
+
+static size_t str_find_caseless_c(const char *hay, size_t n,
+                                  const char *needle, size_t m) {
+    if (m == 0)
+        return 0;
+    if (m > n)
+        return STR_NPOS;
+    unsigned char first = str_lower((unsigned char)needle[0]);
+    for (size_t i = 0; i + m <= n; i++)
+        if (str_lower((unsigned char)hay[i]) == first &&
+            str_caseless_eq(hay + i, needle, m))
+            return i;
+    return STR_NPOS;
+}
+
+static size_t str_scan_c(const char *s, size_t n, const StrSet *set) {
+    if (set->count == 1) {
+        const char *p = (const char *)memchr(s, set->bytes[0], n);
+        return p ? (size_t)(p - s) : n;
+    }
+    for (size_t i = 0; i < n; i++)
+        if (set->table[(unsigned char)s[i]])
+            return i;
+    return n;
+}
+
+static void str_fold_c(const char *src, char *dst, size_t n, int upper) {
+    for (size_t i = 0; i < n; i++) {
+        unsigned char c = (unsigned char)src[i];
+        if (upper)
+            dst[i] = (unsigned)(c - 'a') < 26u ? (char)(c & ~0x20) : (char)c;
+        else
+            dst[i] = (char)str_lower(c);
+    }
+}
+
+static const StrKernels STR_KERNELS_C = {
+    "c", str_find_c, str_find_caseless_c, str_scan_c, str_fold_c,
+};
+
+#if ML_VEC_X86
+
+// The needle's first and last bytes are compared against a vector of
+// candidate starts at once, only starts where both match are checked
+// with memcmp. Vectors are loaded at i and i + m - 1, so the loop stops
+// once the second load would run past the end
+
+// SSE2, sixteen bytes
+
+// Sets 0x20 in the bytes that are in lo..lo+25, for lo 'A' that's
+// tolower. Shifting the range to start at -128 makes it one signed compare
+static inline __m128i str_range_sse2(__m128i v, char lo) {
+    __m128i shifted = _mm_add_epi8(v, _mm_set1_epi8((char)(0x80 - lo)));
+    return _mm_cmplt_epi8(shifted, _mm_set1_epi8((char)(-128 + 26)));
+}
+
+static inline __m128i str_lower_sse2(__m128i v) {
+    return _mm_or_si128(
+        v, _mm_and_si128(str_range_sse2(v, 'A'), _mm_set1_epi8(0x20)));
+}
+
+static size_t str_find_sse2(const char *hay, size_t n, const char *needle,
+                            size_t m) {
+    if (m < 2 || m > n)
+        return str_find_c(hay, n, needle, m);
+    __m128i first = _mm_set1_epi8(needle[0]);
+    __m128i last = _mm_set1_epi8(needle[m - 1]);
+    size_t i = 0;
+    for (; i + m - 1 + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(hay + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(hay + i + m - 1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        for (; mask; mask &= mask - 1) {
+            size_t at = i + (size_t)__builtin_ctz(mask);
+            if (memcmp(hay + at + 1, needle + 1, m - 2) == 0)
+                return at;
+        }
+    }
+    size_t rest = str_find_c(hay + i, n - i, needle, m);
+    return rest == STR_NPOS ? rest : i + rest;
+}
+
+static size_t str_find_caseless_sse2(const char *hay, size_t n,
+                                     const char *needle, size_t m) {
+    if (m < 2 || m > n)
+        return str_find_caseless_c(hay, n, needle, m);
+    __m128i first = _mm_set1_epi8((char)str_lower((unsigned char)needle[0]));
+    __m128i last =
+        _mm_set1_epi8((char)str_lower((unsigned char)needle[m - 1]));
+    size_t i = 0;
+    for (; i + m - 1 + 16 <= n; i += 16) {
+        __m128i a =
+            str_lower_sse2(_mm_loadu_si128((const __m128i *)(hay + i)));
+        __m128i b = str_lower_sse2(
+            _mm_loadu_si128((const __m128i *)(hay + i + m - 1)));
+        unsigned mask = (unsigned)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        for (; mask; mask &= mask - 1) {
+            size_t at = i + (size_t)__builtin_ctz(mask);
+            if (str_caseless_eq(hay + at + 1, needle + 1, m - 2))
+                return at;
+        }
+    }
+    size_t rest = str_find_caseless_c(hay + i, n - i, needle, m);
+    return rest == STR_NPOS ? rest : i + rest;
+}
+
+static size_t str_scan_sse2(const char *s, size_t n, const StrSet *set) {
+    if (set->count <= 1)
+        return str_scan_c(s, n, set);
+    __m128i want[STRSET_VEC_MAX];
+    for (int k = 0; k < set->count; k++)
+        want[k] = _mm_set1_epi8((char)set->bytes[k]);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i hit = _mm_cmpeq_epi8(v, want[0]);
+        for (int k = 1; k < set->count; k++)
+            hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, want[k]));
+        unsigned mask = (unsigned)_mm_movemask_epi8(hit);
+        if (mask)
+            return i + (size_t)__builtin_ctz(mask);
+    }
+    return i + str_scan_c(s + i, n - i, set);
+}
+
+static void str_fold_sse2(const char *src, char *dst, size_t n, int upper) {
+    __m128i bit = _mm_set1_epi8(0x20);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i in = str_range_sse2(v, upper ? 'a' : 'A');
+        v = upper ? _mm_andnot_si128(_mm_and_si128(in, bit), v)
+                  : _mm_or_si128(v, _mm_and_si128(in, bit));
+        _mm_storeu_si128((__m128i *)(dst + i), v);
+    }
+    str_fold_c(src + i, dst + i, n - i, upper);
+}
+
+static const StrKernels STR_KERNELS_SSE2 = {
+    "sse2", str_find_sse2, str_find_caseless_sse2, str_scan_sse2,
+    str_fold_sse2,
+};
+
+// AVX2, thirty two bytes. Only called once the CPU said it has it
+
+ML_AVX2 static inline __m256i str_range_avx2(__m256i v, char lo) {
+    __m256i shifted =
+        _mm256_add_epi8(v, _mm256_set1_epi8((char)(0x80 - lo)));
+    return _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(-128 + 26)), shifted);
+}
+
+ML_AVX2 static inline __m256i str_lower_avx2(__m256i v) {
+    return _mm256_or_si256(v, _mm256_and_si256(str_range_avx2(v, 'A'),
+                                               _mm256_set1_epi8(0x20)));
+}
+
+ML_AVX2 static size_t str_find_avx2(const char *hay, size_t n,
+                                    const char *needle, size_t m) {
+    if (m < 2 || m > n)
+        return str_find_c(hay, n, needle, m);
+    __m256i first = _mm256_set1_epi8(needle[0]);
+    __m256i last = _mm256_set1_epi8(needle[m - 1]);
+    size_t i = 0;
+    for (; i + m - 1 + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(hay + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(hay + i + m - 1));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(
+            _mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        for (; mask; mask &= mask - 1) {
+            size_t at = i + (size_t)__builtin_ctz(mask);
+            if (memcmp(hay + at + 1, needle + 1, m - 2) == 0)
+                return at;
+        }
+    }
+    size_t rest = str_find_sse2(hay + i, n - i, needle, m);
+    return rest == STR_NPOS ? rest : i + rest;
+}
+
+ML_AVX2 static size_t str_find_caseless_avx2(const char *hay, size_t n,
+                                             const char *needle, size_t m) {
+    if (m < 2 || m > n)
+        return str_find_caseless_c(hay, n, needle, m);
+    __m256i first =
+        _mm256_set1_epi8((char)str_lower((unsigned char)needle[0]));
+    __m256i last =
+        _mm256_set1_epi8((char)str_lower((unsigned char)needle[m - 1]));
+    size_t i = 0;
+    for (; i + m - 1 + 32 <= n; i += 32) {
+        __m256i a =
+            str_lower_avx2(_mm256_loadu_si256((const __m256i *)(hay + i)));
+        __m256i b = str_lower_avx2(
+            _mm256_loadu_si256((const __m256i *)(hay + i + m - 1)));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(
+            _mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        for (; mask; mask &= mask - 1) {
+            size_t at = i + (size_t)__builtin_ctz(mask);
+            if (str_caseless_eq(hay + at + 1, needle + 1, m - 2))
+                return at;
+        }
+    }
+    size_t rest = str_find_caseless_sse2(hay + i, n - i, needle, m);
+    return rest == STR_NPOS ? rest : i + rest;
+}
+
+ML_AVX2 static size_t str_scan_avx2(const char *s, size_t n,
+                                    const StrSet *set) {
+    if (set->count <= 1)
+        return str_scan_c(s, n, set);
+    __m256i want[STRSET_VEC_MAX];
+    for (int k = 0; k < set->count; k++)
+        want[k] = _mm256_set1_epi8((char)set->bytes[k]);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+        __m256i hit = _mm256_cmpeq_epi8(v, want[0]);
+        for (int k = 1; k < set->count; k++)
+            hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, want[k]));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(hit);
+        if (mask)
+            return i + (size_t)__builtin_ctz(mask);
+    }
+    return i + str_scan_sse2(s + i, n - i, set);
+}
+
+ML_AVX2 static void str_fold_avx2(const char *src, char *dst, size_t n,
+                                  int upper) {
+    __m256i bit = _mm256_set1_epi8(0x20);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i in = str_range_avx2(v, upper ? 'a' : 'A');
+        v = upper ? _mm256_andnot_si256(_mm256_and_si256(in, bit), v)
+                  : _mm256_or_si256(v, _mm256_and_si256(in, bit));
+        _mm256_storeu_si256((__m256i *)(dst + i), v);
+    }
+    str_fold_sse2(src + i, dst + i, n - i, upper);
+}
+
+static const StrKernels STR_KERNELS_AVX2 = {
+    "avx2", str_find_avx2, str_find_caseless_avx2, str_scan_avx2,
+    str_fold_avx2,
+};
+
+#endif // ML_VEC_X86
+
+const StrKernels *str_kernels(void) {
+    static const StrKernels *kernels = NULL;
+    if (kernels)
+        return kernels;
+#if ML_VEC_X86
+    __builtin_cpu_init();
+    kernels = __builtin_cpu_supports("avx2") ? &STR_KERNELS_AVX2
+                                             : &STR_KERNELS_SSE2;
+#else
+    kernels = &STR_KERNELS_C;
+#endif
+    return kernels;
+}
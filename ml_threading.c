@@ -3,6 +3,7 @@
 
 #include "ml_threading.h"
 #include "mila.h"
+#include "ml_typedarray.h"
 #include <string.h>
 
 static void thread_registry_init(void) {
@@ -65,6 +66,7 @@ static void *mila_thread_worker(void *arg) {
     ctx->status = 1;
     result =
         call_function_with(NULL, ctx->func, vint(ctx->public_thread_id), NULL);
+    tarray_read_boxes_release();
     ctx->status = 2;
 
     return NULL;
@@ -115,6 +117,9 @@ int make_cthread(Generator c_gen) {
 
     int thread_id = thread_registry_add(ctx);
 
+#ifndef ML_NO_THREADING
+    mila_refs_shared = 1;
+#endif
     pthread_create(&ctx->thread_id, NULL, mila_thread_worker, ctx);
     if (thread_id < 0) {
         mila_free(ctx);
@@ -155,6 +160,9 @@ Value *native_thread_create(Env *env, int argc, Value **argv) {
         return verror("Failed to register thread");
     }
 
+#ifndef ML_NO_THREADING
+    mila_refs_shared = 1;
+#endif
     int pth_result =
         pthread_create(&ctx->thread_id, NULL, mila_thread_worker, ctx);
     if (pth_result != 0) {
@@ -0,0 +1,443 @@
+// This project is licensed under the GNU Affero General Public License
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mila.h"
+#include "ml_primitives.h"
+#include "ml_typedarray.h"
+
+#define IS_TARRAY(val)                                                         \
+    (GET_TYPE(val) == T_OPAQUE && (val)->method_table == tarray_meta &&        \
+     (val)->v)
+
+static const char *TARRAY_NAMES[] = {"i64array", "f64array", "u8array"};
+static const char *TARRAY_TYPE_NAMES[] = {MILA_LPREFIX "i64array",
+                                          MILA_LPREFIX "f64array",
+                                          MILA_LPREFIX "u8array"};
+static const size_t TARRAY_ELEM_SIZE[] = {sizeof(int64_t), sizeof(double),
+                                          sizeof(uint8_t)};
+
+TypedArray *tarray_create(TypedArrayKind kind, size_t len) {
+    if (len > SIZE_MAX / TARRAY_ELEM_SIZE[kind])
+        return NULL;
+    TypedArray *arr = (TypedArray *)mila_malloc(sizeof(TypedArray));
+    if (!arr)
+        return NULL;
+    // calloc, large arrays get zeroed pages from the OS for free
+    arr->data = calloc(len ? len : 1, TARRAY_ELEM_SIZE[kind]);
+    if (!arr->data) {
+        mila_free(arr);
+        return NULL;
+    }
+    arr->len = len;
+    arr->kind = kind;
+    arr->refcount = 1;
+    return arr;
+}
+
+TypedArray *tarray_clone(TypedArray *arr) {
+    TypedArray *copy = tarray_create(arr->kind, arr->len);
+    if (copy)
+        memcpy(copy->data, arr->data, arr->len * TARRAY_ELEM_SIZE[arr->kind]);
+    return copy;
+}
+
+void tarray_destroy(TypedArray *arr) {
+    if (!arr)
+        return;
+    free(arr->data);
+    mila_free(arr);
+}
+
+// Gives self storage of its own before it is changed
+void tarray_unshare(Value *self) {
+    TypedArray *arr = (TypedArray *)self->v;
+    if (arr->refcount <= 1)
+        return;
+    TypedArray *own = tarray_clone(arr);
+    if (!own)
+        return;
+    self->v = (void *)own;
+    if (ML_REF_DEC(arr) == 0)
+        tarray_destroy(arr);
+}
+
+Value *tarray_new(TypedArray *arr) {
+    Value *res = vopaque_extra(arr, NULL, TARRAY_TYPE_NAMES[arr->kind]);
+    val_set_table(res, tarray_meta);
+    return res;
+}
+
+static int tarray_box_reusable(Value *b, TypedArrayKind kind) {
+    return b && b->refcount == 1 && !b->wrefs &&
+           GET_TYPE(b) == (kind == TA_F64 ? T_FLOAT : T_INT);
+}
+
+// Element i in *box, written in place when nobody else holds the box
+static Value *tarray_box(Value **box, TypedArray *arr, size_t i) {
+    Value *b = *box;
+    if (arr->kind == TA_F64) {
+        if (tarray_box_reusable(b, arr->kind)) {
+            b->v->f = TARRAY_F64(arr)[i];
+            return b;
+        }
+        val_release(b);
+        return *box = vfloat(TARRAY_F64(arr)[i]);
+    }
+    long x = arr->kind == TA_I64 ? (long)TARRAY_I64(arr)[i]
+                                 : (long)TARRAY_U8(arr)[i];
+    if (tarray_box_reusable(b, arr->kind)) {
+        b->v->i = x;
+        return b;
+    }
+    val_release(b);
+    return *box = vint(x);
+}
+
+// Index reads hand out a box borrowed from the reading thread, the storage
+// is shared by copies and frozen arrays across threads. Two of them so both
+// sides of a[i] + b[i] get reused
+#define TARRAY_READ_BOXES 2
+
+static _Thread_local Value *tarray_read_boxes[TARRAY_READ_BOXES];
+static _Thread_local unsigned tarray_read_next = 0;
+
+static Value *tarray_read_box(TypedArray *arr, size_t i) {
+    for (int k = 0; k < TARRAY_READ_BOXES; k++)
+        if (tarray_box_reusable(tarray_read_boxes[k], arr->kind))
+            return tarray_box(&tarray_read_boxes[k], arr, i);
+    return tarray_box(
+        &tarray_read_boxes[tarray_read_next++ % TARRAY_READ_BOXES], arr, i);
+}
+
+void tarray_read_boxes_release(void) {
+    for (int k = 0; k < TARRAY_READ_BOXES; k++) {
+        val_release(tarray_read_boxes[k]);
+        tarray_read_boxes[k] = NULL;
+    }
+}
+
+// Stores v at i, NULL when it was stored or the error why it wasn't
+static Value *tarray_store(TypedArray *arr, size_t i, Value *v,
+                           const char *who) {
+    switch (arr->kind) {
+    case TA_F64:
+        switch (GET_TYPE(v)) {
+        case T_INT:
+        case T_UINT:
+        case T_FLOAT:
+            TARRAY_F64(arr)[i] = to_double(v);
+            return NULL;
+        case T_BOOL:
+            TARRAY_F64(arr)[i] = GET_BOOL(v);
+            return NULL;
+        default:
+            break;
+        }
+        break;
+    case TA_I64:
+        switch (GET_TYPE(v)) {
+        case T_INT:
+        case T_UINT:
+            TARRAY_I64(arr)[i] = (int64_t)GET_INTEGER(v);
+            return NULL;
+        case T_BOOL:
+            TARRAY_I64(arr)[i] = GET_BOOL(v);
+            return NULL;
+        default:
+            break;
+        }
+        break;
+    case TA_U8:
+        if (GET_TYPE(v) == T_BOOL) {
+            TARRAY_U8(arr)[i] = GET_BOOL(v);
+            return NULL;
+        }
+        if (GET_TYPE(v) == T_INT || GET_TYPE(v) == T_UINT) {
+            if (GET_TYPE(v) == T_INT &&
+                (GET_INTEGER(v) < 0 || GET_INTEGER(v) > 255))
+                return verror("%s: %ld doesn't fit in a u8array", who,
+                              GET_INTEGER(v));
+            if (GET_TYPE(v) == T_UINT && GET_UINTEGER(v) > 255)
+                return verror("%s: %lu doesn't fit in a u8array", who,
+                              GET_UINTEGER(v));
+            TARRAY_U8(arr)[i] = (uint8_t)GET_INTEGER(v);
+            return NULL;
+        }
+        break;
+    default:
+        return verror("%s: Not a typed array", who);
+    }
+    return verror("%s: Can't store a %s in a %s", who, GET_TYPENAME(v),
+                  TARRAY_NAMES[arr->kind]);
+}
+
+static int tarray_index(TypedArray *arr, Value *index, size_t *out) {
+    if (GET_TYPE(index) == T_INT) {
+        if (GET_INTEGER(index) < 0)
+            return 0;
+        *out = (size_t)GET_INTEGER(index);
+    } else if (GET_TYPE(index) == T_UINT)
+        *out = (size_t)GET_UINTEGER(index);
+    else
+        return 0;
+    return *out < arr->len;
+}
+
+// Formats element i into out, 32 bytes fit any element. Floats are
+// written the way JSON writes them
+int tarray_format_elem(char *out, size_t size, TypedArray *arr, size_t i) {
+    switch (arr->kind) {
+    case TA_F64: {
+        double d = TARRAY_F64(arr)[i];
+        return snprintf(out, size, d == (long long)d ? "%.1f" : "%.17g", d);
+    }
+    case TA_I64:
+        return snprintf(out, size, "%lld", (long long)TARRAY_I64(arr)[i]);
+    default:
+        return snprintf(out, size, "%u", (unsigned)TARRAY_U8(arr)[i]);
+    }
+}
+
+static Value *tarray_build(Value *self, int repr) {
+    TypedArray *arr = (TypedArray *)self->v;
+    if (repr && arr->len > MAX_ITEMS_DISPLAYED)
+        return vstring_fmt("%s(<%zu items>)", TARRAY_NAMES[arr->kind],
+                           arr->len);
+    // appended in place, large arrays would go quadratic through
+    // malloc_sprintf
+    size_t cap = 64 + arr->len * 8, len = 0;
+    char *buffer = (char *)mila_malloc(cap);
+    len += snprintf(buffer, cap, "%s.from([", TARRAY_NAMES[arr->kind]);
+    for (size_t i = 0; i < arr->len; i++) {
+        if (cap - len < 40) {
+            cap *= 2;
+            buffer = (char *)mila_realloc(buffer, cap);
+        }
+        if (i) {
+            buffer[len++] = ',';
+            buffer[len++] = ' ';
+        }
+        len += tarray_format_elem(buffer + len, cap - len, arr, i);
+    }
+    if (cap - len < 3)
+        buffer = (char *)mila_realloc(buffer, cap + 3);
+    memcpy(buffer + len, "])", 3);
+    return vstring_take(buffer);
+}
+
+Value *tarray_str(Value *self) { return tarray_build(self, 0); }
+
+Value *tarray_repr(Value *self) { return tarray_build(self, 1); }
+
+Value *tarray_free(Value *self) {
+    TypedArray *arr = (TypedArray *)self->v;
+    if (ML_REF_DEC(arr) == 0)
+        tarray_destroy(arr);
+    return NULL;
+}
+
+Value *tarray_copy(Value *self) {
+    TypedArray *arr = (TypedArray *)self->v;
+    // weakrefs point straight at the storage, so those arrays never share it
+    if (!self->wrefs && self->refcount != ML_WEAK_REF_TRIGGER)
+        ML_REF_INC(arr);
+    else if (!(arr = tarray_clone(arr)))
+        return verror("copy(%s): Couldn't copy the array",
+                      TARRAY_NAMES[((TypedArray *)self->v)->kind]);
+    return tarray_new(arr);
+}
+
+Value *get_tarray(Value *self, Value *index) {
+    TypedArray *arr = (TypedArray *)self->v;
+    size_t i;
+    if (!tarray_index(arr, index, &i))
+        return NULL;
+    return tarray_read_box(arr, i);
+}
+
+Value *set_tarray(Value *self, Value *index, Value *value) {
+    if (IS_FROZEN(self))
+        return vtagged_error(E_CONST_ERROR, "Cannot set item of frozen array");
+    size_t i;
+    if (!tarray_index((TypedArray *)self->v, index, &i))
+        return verror("%s: index out of bounds (size %zu)",
+                      TARRAY_NAMES[((TypedArray *)self->v)->kind],
+                      ((TypedArray *)self->v)->len);
+    tarray_unshare(self);
+    return tarray_store((TypedArray *)self->v, i, value,
+                       TARRAY_NAMES[((TypedArray *)self->v)->kind]);
+}
+
+TypedArrayIterState *tarray_iter_init(Value *self) {
+    TypedArrayIterState *state =
+        (TypedArrayIterState *)mila_malloc(sizeof(TypedArrayIterState));
+    state->storage = (TypedArray *)self->v;
+    ML_REF_INC(state->storage);
+    state->index = 0;
+    state->box = NULL;
+    return state;
+}
+
+Value *tarray_iter_next(TypedArrayIterState *state) {
+    if (state->index >= state->storage->len)
+        return NULL;
+    return val_retain(tarray_box(&state->box, state->storage, state->index++));
+}
+
+void tarray_iter_cleanup(TypedArrayIterState *state) {
+    if (ML_REF_DEC(state->storage) == 0)
+        tarray_destroy(state->storage);
+    val_release(state->box);
+    free(state);
+}
+
+// Natives
+
+static Value *tarray_make(TypedArrayKind kind, int argc, Value **argv) {
+    if (argc != 1 || GET_TYPE(argv[0]) != T_INT || GET_INTEGER(argv[0]) < 0)
+        return verror("%s(len): Expected a length", TARRAY_NAMES[kind]);
+    TypedArray *arr = tarray_create(kind, (size_t)GET_INTEGER(argv[0]));
+    if (!arr)
+        return verror("%s(len): Couldn't allocate %ld items",
+                      TARRAY_NAMES[kind], GET_INTEGER(argv[0]));
+    return tarray_new(arr);
+}
+
+Value *native_i64array_new(Env *env, int argc, Value **argv) {
+    (void)env;
+    return tarray_make(TA_I64, argc, argv);
+}
+
+Value *native_f64array_new(Env *env, int argc, Value **argv) {
+    (void)env;
+    return tarray_make(TA_F64, argc, argv);
+}
+
+Value *native_u8array_new(Env *env, int argc, Value **argv) {
+    (void)env;
+    return tarray_make(TA_U8, argc, argv);
+}
+
+// Converts a list, another typed array, or anything foreach can walk
+static Value *tarray_from(TypedArrayKind kind, int argc, Value **argv) {
+    char who[32];
+    snprintf(who, sizeof(who), "%s.from(items)", TARRAY_NAMES[kind]);
+    if (argc != 1)
+        return verror("%s: Expected one argument", who);
+    Value *from = argv[0];
+    TypedArray *arr = NULL;
+    Value *err = NULL;
+
+    if (IS_TARRAY(from)) {
+        TypedArray *src = (TypedArray *)from->v;
+        if (src->kind == kind) {
+            if (!(arr = tarray_clone(src)))
+                return verror("%s: Out of memory", who);
+            return tarray_new(arr);
+        }
+        if (!(arr = tarray_create(kind, src->len)))
+            return verror("%s: Out of memory", who);
+        Value *box = NULL;
+        for (size_t i = 0; i < src->len && !err; i++)
+            err = tarray_store(arr, i, tarray_box(&box, src, i), who);
+        val_release(box);
+    } else if (from->method_table == list_meta) {
+        LinkedList *list = (LinkedList *)from->v;
+        if (!(arr = tarray_create(kind, list->size)))
+            return verror("%s: Out of memory", who);
+        for (size_t i = 0; i < list->size && !err; i++)
+            err = tarray_store(arr, i, list->items[i], who);
+    } else {
+        if (!GET_METHOD(from, UMethodStepIterInit) ||
+            !GET_METHOD(from, UMethodStepIter) ||
+            !GET_METHOD(from, UMethodStepIterClean))
+            return verror("%s: %s can't be iterated", who, GET_TYPENAME(from));
+        void *state =
+            ((unary_method)from->method_table[UMethodStepIterInit])(from);
+        if (!state)
+            return verror("%s: Iterable initialization failed", who);
+        size_t cap = 16, len = 0;
+        if (!(arr = tarray_create(kind, cap)))
+            err = verror("%s: Out of memory", who);
+        Value *item;
+        while (!err &&
+               (item = ((unary_method)from->method_table[UMethodStepIter])(
+                    state))) {
+            if (IS_ERROR(item)) {
+                err = item;
+                break;
+            }
+            if (len == cap) {
+                void *data = realloc(arr->data, 2 * cap * TARRAY_ELEM_SIZE[kind]);
+                if (!data)
+                    err = verror("%s: Out of memory", who);
+                else {
+                    arr->data = data;
+                    cap *= 2;
+                }
+            }
+            if (!err)
+                err = tarray_store(arr, len++, item, who);
+            val_release(item);
+        }
+        ((unary_method)from->method_table[UMethodStepIterClean])(state);
+        if (arr)
+            arr->len = len;
+    }
+    if (err) {
+        tarray_destroy(arr);
+        return err;
+    }
+    return tarray_new(arr);
+}
+
+Value *native_i64array_from(Env *env, int argc, Value **argv) {
+    (void)env;
+    return tarray_from(TA_I64, argc, argv);
+}
+
+Value *native_f64array_from(Env *env, int argc, Value **argv) {
+    (void)env;
+    return tarray_from(TA_F64, argc, argv);
+}
+
+Value *native_u8array_from(Env *env, int argc, Value **argv) {
+    (void)env;
+    return tarray_from(TA_U8, argc, argv);
+}
+
+Value *native_tarray_len(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 1 || !IS_TARRAY(argv[0]))
+        return verror("tarray.len(a): Expected a typed array");
+    return vint((long)((TypedArray *)argv[0]->v)->len);
+}
+
+Value *native_tarray_to_list(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 1 || !IS_TARRAY(argv[0]))
+        return verror("tarray.to_list(a): Expected a typed array");
+    TypedArray *arr = (TypedArray *)argv[0]->v;
+    LinkedList *list = ll_create();
+    ll_reserve(list, arr->len);
+    for (size_t i = 0; i < arr->len; i++) {
+        switch (arr->kind) {
+        case TA_F64:
+            ll_append(list, vfloat(TARRAY_F64(arr)[i]));
+            break;
+        case TA_I64:
+            ll_append(list, vint((long)TARRAY_I64(arr)[i]));
+            break;
+        case TA_U8:
+            ll_append(list, vint((long)TARRAY_U8(arr)[i]));
+            break;
+        }
+    }
+    Value *res = vopaque_extra(list, NULL, MILA_LPREFIX "list");
+    val_set_table(res, list_meta);
+    return res;
+}
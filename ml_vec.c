@@ -0,0 +1,937 @@
+// This project is licensed under the GNU Affero General Public License
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mila.h"
+#include "ml_primitives.h"
+#include "ml_typedarray.h"
+#include "ml_vec.h"
+
+#if ML_VEC_X86
+#include <immintrin.h>
+#endif
+
+// Plain C kernels, what everything else is checked against
+
+static double vec_sum_c(const double *x, size_t n) {
+    double s = 0;
+    for (size_t i = 0; i < n; i++)
+        s += x[i];
+    return s;
+}
+
+static double vec_dot_c(const double *x, const double *y, size_t n) {
+    double s = 0;
+    for (size_t i = 0; i < n; i++)
+        s += x[i] * y[i];
+    return s;
+}
+
+static double vec_min_c(const double *x, size_t n) {
+    double m = x[0];
+    for (size_t i = 1; i < n; i++)
+        m = x[i] < m ? x[i] : m;
+    return m;
+}
+
+static double vec_max_c(const double *x, size_t n) {
+    double m = x[0];
+    for (size_t i = 1; i < n; i++)
+        m = x[i] > m ? x[i] : m;
+    return m;
+}
+
+static void vec_axpy_c(double a, const double *x, double *y, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        y[i] += a * x[i];
+}
+
+// One loop per op, so the switch stays out of the loop
+#define VEC_LOOP(n, expr)                                                      \
+    for (size_t i = 0; i < (n); i++)                                           \
+        out[i] = (expr);
+
+static void vec_binop_c(VecOp op, const double *x, const double *y,
+                        double *out, size_t n) {
+    switch (op) {
+    case VEC_ADD:
+        VEC_LOOP(n, x[i] + y[i]);
+        break;
+    case VEC_SUB:
+        VEC_LOOP(n, x[i] - y[i]);
+        break;
+    case VEC_MUL:
+        VEC_LOOP(n, x[i] * y[i]);
+        break;
+    case VEC_DIV:
+        VEC_LOOP(n, x[i] / y[i]);
+        break;
+    case VEC_RSUB:
+        VEC_LOOP(n, y[i] - x[i]);
+        break;
+    case VEC_RDIV:
+        VEC_LOOP(n, y[i] / x[i]);
+        break;
+    }
+}
+
+static void vec_binop_scalar_c(VecOp op, const double *x, double s,
+                               double *out, size_t n) {
+    switch (op) {
+    case VEC_ADD:
+        VEC_LOOP(n, x[i] + s);
+        break;
+    case VEC_SUB:
+        VEC_LOOP(n, x[i] - s);
+        break;
+    case VEC_MUL:
+        VEC_LOOP(n, x[i] * s);
+        break;
+    case VEC_DIV:
+        VEC_LOOP(n, x[i] / s);
+        break;
+    case VEC_RSUB:
+        VEC_LOOP(n, s - x[i]);
+        break;
+    case VEC_RDIV:
+        VEC_LOOP(n, s / x[i]);
+        break;
+    }
+}
+
+#ifndef ML_NO_LIBM
+static void vec_math_c(VecMath fn, const double *x, double *out, size_t n) {
+    switch (fn) {
+    case VEC_SQRT:
+        VEC_LOOP(n, sqrt(x[i]));
+        break;
+    case VEC_FLOOR:
+        VEC_LOOP(n, floor(x[i]));
+        break;
+    case VEC_CEIL:
+        VEC_LOOP(n, ceil(x[i]));
+        break;
+    case VEC_FABS:
+        VEC_LOOP(n, fabs(x[i]));
+        break;
+    case VEC_SIN:
+        VEC_LOOP(n, sin(x[i]));
+        break;
+    case VEC_COS:
+        VEC_LOOP(n, cos(x[i]));
+        break;
+    }
+}
+#define VEC_MATH(fn) , fn
+#else
+#define VEC_MATH(fn)
+#endif // ML_NO_LIBM
+
+static const VecKernels VEC_KERNELS_C = {
+    "scalar",   vec_sum_c,  vec_dot_c,   vec_min_c,
+    vec_max_c, vec_axpy_c, vec_binop_c, vec_binop_scalar_c VEC_MATH(vec_math_c),
+};
+
+#if ML_VEC_X86
+
+// SSE2, two lanes. Always there on x86_64
+
+static double vec_hsum128(__m128d v) {
+    return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+static double vec_sum_sse2(const double *x, size_t n) {
+    __m128d a0 = _mm_setzero_pd(), a1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        a0 = _mm_add_pd(a0, _mm_loadu_pd(x + i));
+        a1 = _mm_add_pd(a1, _mm_loadu_pd(x + i + 2));
+    }
+    double s = vec_hsum128(_mm_add_pd(a0, a1));
+    for (; i < n; i++)
+        s += x[i];
+    return s;
+}
+
+static double vec_dot_sse2(const double *x, const double *y, size_t n) {
+    __m128d a0 = _mm_setzero_pd(), a1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        a0 = _mm_add_pd(a0,
+                        _mm_mul_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(y + i)));
+        a1 = _mm_add_pd(a1, _mm_mul_pd(_mm_loadu_pd(x + i + 2),
+                                       _mm_loadu_pd(y + i + 2)));
+    }
+    double s = vec_hsum128(_mm_add_pd(a0, a1));
+    for (; i < n; i++)
+        s += x[i] * y[i];
+    return s;
+}
+
+static double vec_min_sse2(const double *x, size_t n) {
+    if (n < 2)
+        return vec_min_c(x, n);
+    __m128d m = _mm_loadu_pd(x);
+    size_t i = 2;
+    for (; i + 2 <= n; i += 2)
+        m = _mm_min_pd(_mm_loadu_pd(x + i), m);
+    m = _mm_min_sd(_mm_unpackhi_pd(m, m), m);
+    double r = _mm_cvtsd_f64(m);
+    for (; i < n; i++)
+        r = x[i] < r ? x[i] : r;
+    return r;
+}
+
+static double vec_max_sse2(const double *x, size_t n) {
+    if (n < 2)
+        return vec_max_c(x, n);
+    __m128d m = _mm_loadu_pd(x);
+    size_t i = 2;
+    for (; i + 2 <= n; i += 2)
+        m = _mm_max_pd(_mm_loadu_pd(x + i), m);
+    m = _mm_max_sd(_mm_unpackhi_pd(m, m), m);
+    double r = _mm_cvtsd_f64(m);
+    for (; i < n; i++)
+        r = x[i] > r ? x[i] : r;
+    return r;
+}
+
+static void vec_axpy_sse2(double a, const double *x, double *y, size_t n) {
+    __m128d va = _mm_set1_pd(a);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+        _mm_storeu_pd(y + i, _mm_add_pd(_mm_loadu_pd(y + i),
+                                        _mm_mul_pd(va, _mm_loadu_pd(x + i))));
+    for (; i < n; i++)
+        y[i] += a * x[i];
+}
+
+#define VEC_LOOP_SSE2(x, y, n, op)                                             \
+    for (; i + 2 <= (n); i += 2)                                               \
+        _mm_storeu_pd(out + i, op(x, y));
+
+static void vec_binop_sse2(VecOp op, const double *x, const double *y,
+                           double *out, size_t n) {
+    size_t i = 0;
+#define XV _mm_loadu_pd(x + i)
+#define YV _mm_loadu_pd(y + i)
+    switch (op) {
+    case VEC_ADD:
+        VEC_LOOP_SSE2(XV, YV, n, _mm_add_pd);
+        break;
+    case VEC_SUB:
+        VEC_LOOP_SSE2(XV, YV, n, _mm_sub_pd);
+        break;
+    case VEC_MUL:
+        VEC_LOOP_SSE2(XV, YV, n, _mm_mul_pd);
+        break;
+    case VEC_DIV:
+        VEC_LOOP_SSE2(XV, YV, n, _mm_div_pd);
+        break;
+    case VEC_RSUB:
+        VEC_LOOP_SSE2(YV, XV, n, _mm_sub_pd);
+        break;
+    case VEC_RDIV:
+        VEC_LOOP_SSE2(YV, XV, n, _mm_div_pd);
+        break;
+    }
+#undef XV
+#undef YV
+    vec_binop_c(op, x + i, y + i, out + i, n - i);
+}
+
+static void vec_binop_scalar_sse2(VecOp op, const double *x, double s,
+                                  double *out, size_t n) {
+    size_t i = 0;
+    __m128d vs = _mm_set1_pd(s);
+#define XV _mm_loadu_pd(x + i)
+    switch (op) {
+    case VEC_ADD:
+        VEC_LOOP_SSE2(XV, vs, n, _mm_add_pd);
+        break;
+    case VEC_SUB:
+        VEC_LOOP_SSE2(XV, vs, n, _mm_sub_pd);
+        break;
+    case VEC_MUL:
+        VEC_LOOP_SSE2(XV, vs, n, _mm_mul_pd);
+        break;
+    case VEC_DIV:
+        VEC_LOOP_SSE2(XV, vs, n, _mm_div_pd);
+        break;
+    case VEC_RSUB:
+        VEC_LOOP_SSE2(vs, XV, n, _mm_sub_pd);
+        break;
+    case VEC_RDIV:
+        VEC_LOOP_SSE2(vs, XV, n, _mm_div_pd);
+        break;
+    }
+#undef XV
+    vec_binop_scalar_c(op, x + i, s, out + i, n - i);
+}
+
+#ifndef ML_NO_LIBM
+// sin and cos stay libm calls, floor and ceil need SSE4.1 to round
+static void vec_math_sse2(VecMath fn, const double *x, double *out, size_t n) {
+    size_t i = 0;
+    switch (fn) {
+    case VEC_SQRT:
+        for (; i + 2 <= n; i += 2)
+            _mm_storeu_pd(out + i, _mm_sqrt_pd(_mm_loadu_pd(x + i)));
+        break;
+    case VEC_FABS: {
+        __m128d sign = _mm_set1_pd(-0.0);
+        for (; i + 2 <= n; i += 2)
+            _mm_storeu_pd(out + i, _mm_andnot_pd(sign, _mm_loadu_pd(x + i)));
+        break;
+    }
+    default:
+        break;
+    }
+    vec_math_c(fn, x + i, out + i, n - i);
+}
+#endif // ML_NO_LIBM
+
+static const VecKernels VEC_KERNELS_SSE2 = {
+    "sse2",       vec_sum_sse2,  vec_dot_sse2,
+    vec_min_sse2, vec_max_sse2,  vec_axpy_sse2,
+    vec_binop_sse2, vec_binop_scalar_sse2 VEC_MATH(vec_math_sse2),
+};
+
+// AVX2, four lanes. Only called once the CPU said it has it
+
+ML_AVX2 static double vec_hsum256(__m256d v) {
+    __m128d lo = _mm256_castpd256_pd128(v);
+    __m128d hi = _mm256_extractf128_pd(v, 1);
+    lo = _mm_add_pd(lo, hi);
+    return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+ML_AVX2 static double vec_sum_avx2(const double *x, size_t n) {
+    __m256d a0 = _mm256_setzero_pd(), a1 = _mm256_setzero_pd();
+    __m256d a2 = _mm256_setzero_pd(), a3 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        a0 = _mm256_add_pd(a0, _mm256_loadu_pd(x + i));
+        a1 = _mm256_add_pd(a1, _mm256_loadu_pd(x + i + 4));
+        a2 = _mm256_add_pd(a2, _mm256_loadu_pd(x + i + 8));
+        a3 = _mm256_add_pd(a3, _mm256_loadu_pd(x + i + 12));
+    }
+    for (; i + 4 <= n; i += 4)
+        a0 = _mm256_add_pd(a0, _mm256_loadu_pd(x + i));
+    double s = vec_hsum256(
+        _mm256_add_pd(_mm256_add_pd(a0, a1), _mm256_add_pd(a2, a3)));
+    for (; i < n; i++)
+        s += x[i];
+    return s;
+}
+
+ML_AVX2 static double vec_dot_avx2(const double *x, const double *y,
+                                   size_t n) {
+    __m256d a0 = _mm256_setzero_pd(), a1 = _mm256_setzero_pd();
+    __m256d a2 = _mm256_setzero_pd(), a3 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        a0 = _mm256_add_pd(a0, _mm256_mul_pd(_mm256_loadu_pd(x + i),
+                                             _mm256_loadu_pd(y + i)));
+        a1 = _mm256_add_pd(a1, _mm256_mul_pd(_mm256_loadu_pd(x + i + 4),
+                                             _mm256_loadu_pd(y + i + 4)));
+        a2 = _mm256_add_pd(a2, _mm256_mul_pd(_mm256_loadu_pd(x + i + 8),
+                                             _mm256_loadu_pd(y + i + 8)));
+        a3 = _mm256_add_pd(a3, _mm256_mul_pd(_mm256_loadu_pd(x + i + 12),
+                                             _mm256_loadu_pd(y + i + 12)));
+    }
+    for (; i + 4 <= n; i += 4)
+        a0 = _mm256_add_pd(a0, _mm256_mul_pd(_mm256_loadu_pd(x + i),
+                                             _mm256_loadu_pd(y + i)));
+    double s = vec_hsum256(
+        _mm256_add_pd(_mm256_add_pd(a0, a1), _mm256_add_pd(a2, a3)));
+    for (; i < n; i++)
+        s += x[i] * y[i];
+    return s;
+}
+
+ML_AVX2 static double vec_min_avx2(const double *x, size_t n) {
+    if (n < 4)
+        return vec_min_c(x, n);
+    __m256d m = _mm256_loadu_pd(x);
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4)
+        m = _mm256_min_pd(_mm256_loadu_pd(x + i), m);
+    double lanes[4];
+    _mm256_storeu_pd(lanes, m);
+    double r = vec_min_c(lanes, 4);
+    for (; i < n; i++)
+        r = x[i] < r ? x[i] : r;
+    return r;
+}
+
+ML_AVX2 static double vec_max_avx2(const double *x, size_t n) {
+    if (n < 4)
+        return vec_max_c(x, n);
+    __m256d m = _mm256_loadu_pd(x);
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4)
+        m = _mm256_max_pd(_mm256_loadu_pd(x + i), m);
+    double lanes[4];
+    _mm256_storeu_pd(lanes, m);
+    double r = vec_max_c(lanes, 4);
+    for (; i < n; i++)
+        r = x[i] > r ? x[i] : r;
+    return r;
+}
+
+ML_AVX2 static void vec_axpy_avx2(double a, const double *x, double *y,
+                                  size_t n) {
+    __m256d va = _mm256_set1_pd(a);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm256_storeu_pd(y + i,
+                         _mm256_add_pd(_mm256_loadu_pd(y + i),
+                                       _mm256_mul_pd(va, _mm256_loadu_pd(x + i))));
+    for (; i < n; i++)
+        y[i] += a * x[i];
+}
+
+#define VEC_LOOP_AVX2(x, y, n, op)                                             \
+    for (; i + 4 <= (n); i += 4)                                               \
+        _mm256_storeu_pd(out + i, op(x, y));
+
+ML_AVX2 static void vec_binop_avx2(VecOp op, const double *x, const double *y,
+                                   double *out, size_t n) {
+    size_t i = 0;
+#define XV _mm256_loadu_pd(x + i)
+#define YV _mm256_loadu_pd(y + i)
+    switch (op) {
+    case VEC_ADD:
+        VEC_LOOP_AVX2(XV, YV, n, _mm256_add_pd);
+        break;
+    case VEC_SUB:
+        VEC_LOOP_AVX2(XV, YV, n, _mm256_sub_pd);
+        break;
+    case VEC_MUL:
+        VEC_LOOP_AVX2(XV, YV, n, _mm256_mul_pd);
+        break;
+    case VEC_DIV:
+        VEC_LOOP_AVX2(XV, YV, n, _mm256_div_pd);
+        break;
+    case VEC_RSUB:
+        VEC_LOOP_AVX2(YV, XV, n, _mm256_sub_pd);
+        break;
+    case VEC_RDIV:
+        VEC_LOOP_AVX2(YV, XV, n, _mm256_div_pd);
+        break;
+    }
+#undef XV
+#undef YV
+    vec_binop_c(op, x + i, y + i, out + i, n - i);
+}
+
+ML_AVX2 static void vec_binop_scalar_avx2(VecOp op, const double *x, double s,
+                                          double *out, size_t n) {
+    size_t i = 0;
+    __m256d vs = _mm256_set1_pd(s);
+#define XV _mm256_loadu_pd(x + i)
+    switch (op) {
+    case VEC_ADD:
+        VEC_LOOP_AVX2(XV, vs, n, _mm256_add_pd);
+        break;
+    case VEC_SUB:
+        VEC_LOOP_AVX2(XV, vs, n, _mm256_sub_pd);
+        break;
+    case VEC_MUL:
+        VEC_LOOP_AVX2(XV, vs, n, _mm256_mul_pd);
+        break;
+    case VEC_DIV:
+        VEC_LOOP_AVX2(XV, vs, n, _mm256_div_pd);
+        break;
+    case VEC_RSUB:
+        VEC_LOOP_AVX2(vs, XV, n, _mm256_sub_pd);
+        break;
+    case VEC_RDIV:
+        VEC_LOOP_AVX2(vs, XV, n, _mm256_div_pd);
+        break;
+    }
+#undef XV
+    vec_binop_scalar_c(op, x + i, s, out + i, n - i);
+}
+
+#ifndef ML_NO_LIBM
+ML_AVX2 static void vec_math_avx2(VecMath fn, const double *x, double *out,
+                                  size_t n) {
+    size_t i = 0;
+    switch (fn) {
+    case VEC_SQRT:
+        for (; i + 4 <= n; i += 4)
+            _mm256_storeu_pd(out + i, _mm256_sqrt_pd(_mm256_loadu_pd(x + i)));
+        break;
+    case VEC_FLOOR:
+        for (; i + 4 <= n; i += 4)
+            _mm256_storeu_pd(out + i, _mm256_round_pd(_mm256_loadu_pd(x + i),
+                                                      _MM_FROUND_TO_NEG_INF |
+                                                          _MM_FROUND_NO_EXC));
+        break;
+    case VEC_CEIL:
+        for (; i + 4 <= n; i += 4)
+            _mm256_storeu_pd(out + i, _mm256_round_pd(_mm256_loadu_pd(x + i),
+                                                      _MM_FROUND_TO_POS_INF |
+                                                          _MM_FROUND_NO_EXC));
+        break;
+    case VEC_FABS: {
+        __m256d sign = _mm256_set1_pd(-0.0);
+        for (; i + 4 <= n; i += 4)
+            _mm256_storeu_pd(out + i,
+                             _mm256_andnot_pd(sign, _mm256_loadu_pd(x + i)));
+        break;
+    }
+    default:
+        break;
+    }
+    vec_math_c(fn, x + i, out + i, n - i);
+}
+#endif // ML_NO_LIBM
+
+static const VecKernels VEC_KERNELS_AVX2 = {
+    "avx2",       vec_sum_avx2,  vec_dot_avx2,
+    vec_min_avx2, vec_max_avx2,  vec_axpy_avx2,
+    vec_binop_avx2, vec_binop_scalar_avx2 VEC_MATH(vec_math_avx2),
+};
+
+#endif // ML_VEC_X86
+
+const VecKernels *vec_kernels(void) {
+    static const VecKernels *kernels = NULL;
+    if (kernels)
+        return kernels;
+#if ML_VEC_X86
+    __builtin_cpu_init();
+    kernels = __builtin_cpu_supports("avx2") ? &VEC_KERNELS_AVX2
+                                             : &VEC_KERNELS_SSE2;
+#else
+    kernels = &VEC_KERNELS_C;
+#endif
+    return kernels;
+}
+
+// Element access for the i64 and u8 arrays, and for mixing kinds
+
+static inline int64_t vec_int_at(TypedArray *arr, size_t i) {
+    return arr->kind == TA_U8 ? (int64_t)TARRAY_U8(arr)[i]
+                              : TARRAY_I64(arr)[i];
+}
+
+static inline double vec_float_at(TypedArray *arr, size_t i) {
+    switch (arr->kind) {
+    case TA_F64:
+        return TARRAY_F64(arr)[i];
+    case TA_I64:
+        return (double)TARRAY_I64(arr)[i];
+    case TA_U8:
+        return TARRAY_U8(arr)[i];
+    }
+    return 0;
+}
+
+// Integer ops wrap around instead of being undefined on overflow
+static inline int64_t vec_int_op(VecOp op, int64_t x, int64_t y) {
+    switch (op) {
+    case VEC_ADD:
+        return (int64_t)((uint64_t)x + (uint64_t)y);
+    case VEC_SUB:
+        return (int64_t)((uint64_t)x - (uint64_t)y);
+    case VEC_RSUB:
+        return (int64_t)((uint64_t)y - (uint64_t)x);
+    case VEC_MUL:
+        return (int64_t)((uint64_t)x * (uint64_t)y);
+    default:
+        return 0; // division always gives an f64array
+    }
+}
+
+static inline double vec_float_op(VecOp op, double x, double y) {
+    switch (op) {
+    case VEC_ADD:
+        return x + y;
+    case VEC_SUB:
+        return x - y;
+    case VEC_MUL:
+        return x * y;
+    case VEC_DIV:
+        return x / y;
+    case VEC_RSUB:
+        return y - x;
+    case VEC_RDIV:
+        return y / x;
+    }
+    return 0;
+}
+
+static int vec_is_scalar(Value *v) {
+    return GET_TYPE(v) == T_INT || GET_TYPE(v) == T_UINT ||
+           GET_TYPE(v) == T_FLOAT || GET_TYPE(v) == T_BOOL;
+}
+
+static double vec_scalar_float(Value *v) {
+    return GET_TYPE(v) == T_BOOL ? (double)GET_BOOL(v) : to_double(v);
+}
+
+static int64_t vec_scalar_int(Value *v) {
+    return GET_TYPE(v) == T_BOOL ? (int64_t)GET_BOOL(v)
+                                 : (int64_t)GET_INTEGER(v);
+}
+
+#ifndef ML_NO_LIBM
+// The numbers of a typed array or list as a new f64 array of n items,
+// NULL with *err set when something isn't a number
+static TypedArray *vec_to_f64(Value *x, const char *who, Value **err) {
+    TypedArray *out;
+    if (IS_TARRAY(x)) {
+        TypedArray *src = (TypedArray *)x->v;
+        if (src->kind == TA_F64)
+            out = tarray_clone(src);
+        else if ((out = tarray_create(TA_F64, src->len)))
+            for (size_t i = 0; i < src->len; i++)
+                TARRAY_F64(out)[i] = vec_float_at(src, i);
+    } else {
+        LinkedList *list = (LinkedList *)x->v;
+        if ((out = tarray_create(TA_F64, list->size)))
+            for (size_t i = 0; i < list->size; i++) {
+                if (!vec_is_scalar(list->items[i])) {
+                    *err = verror("%s: Item %zu is a %s, not a number", who, i,
+                                  GET_TYPENAME(list->items[i]));
+                    tarray_destroy(out);
+                    return NULL;
+                }
+                TARRAY_F64(out)[i] = vec_scalar_float(list->items[i]);
+            }
+    }
+    if (!out)
+        *err = verror("%s: Out of memory", who);
+    return out;
+}
+
+// fn over every item of a typed array or list, as a new f64array
+Value *vec_map(VecMath fn, const char *who, Value *x) {
+    Value *err = NULL;
+    TypedArray *out = vec_to_f64(x, who, &err);
+    if (!out)
+        return err;
+    vec_kernels()->math(fn, TARRAY_F64(out), TARRAY_F64(out), out->len);
+    return tarray_new(out);
+}
+
+// pow with an array or list on either side, the other side an array of
+// the same length or a number
+Value *vec_pow(Value *base, Value *exp) {
+    const char *who = "pow(base, exp)";
+    Value *err = NULL;
+    int base_vec = IS_TARRAY(base) || base->method_table == list_meta;
+    int exp_vec = IS_TARRAY(exp) || exp->method_table == list_meta;
+    if ((!base_vec && !vec_is_scalar(base)) || (!exp_vec && !vec_is_scalar(exp)))
+        return verror("%s: Expected numbers, typed arrays or lists", who);
+    TypedArray *out = vec_to_f64(base_vec ? base : exp, who, &err);
+    if (!out)
+        return err;
+    double *o = TARRAY_F64(out);
+    if (base_vec && exp_vec) {
+        TypedArray *e = vec_to_f64(exp, who, &err);
+        if (!e) {
+            tarray_destroy(out);
+            return err;
+        }
+        if (e->len != out->len) {
+            err = verror("%s: Lengths differ (%zu and %zu)", who, out->len,
+                         e->len);
+            tarray_destroy(e);
+            tarray_destroy(out);
+            return err;
+        }
+        for (size_t i = 0; i < out->len; i++)
+            o[i] = pow(o[i], TARRAY_F64(e)[i]);
+        tarray_destroy(e);
+    } else if (base_vec) {
+        double e = vec_scalar_float(exp);
+        if (e == 2.0) // the common case, and exactly what pow gives
+            for (size_t i = 0; i < out->len; i++)
+                o[i] *= o[i];
+        else
+            for (size_t i = 0; i < out->len; i++)
+                o[i] = pow(o[i], e);
+    } else {
+        double b = vec_scalar_float(base);
+        for (size_t i = 0; i < out->len; i++)
+            o[i] = pow(b, o[i]);
+    }
+    return tarray_new(out);
+}
+#endif // ML_NO_LIBM
+
+// Natives
+
+#define VEC_ARRAY(who, v)                                                      \
+    if (!IS_TARRAY(v))                                                         \
+        return verror("vec." who ": Expected a typed array, got %s",           \
+                      GET_TYPENAME(v));
+
+Value *native_vec_sum(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 1)
+        return verror("vec.sum(a): Expected one argument");
+    VEC_ARRAY("sum(a)", argv[0]);
+    TypedArray *arr = (TypedArray *)argv[0]->v;
+    if (arr->kind == TA_F64)
+        return vfloat(vec_kernels()->sum(TARRAY_F64(arr), arr->len));
+    uint64_t s = 0;
+    if (arr->kind == TA_U8)
+        for (size_t i = 0; i < arr->len; i++)
+            s += TARRAY_U8(arr)[i];
+    else
+        for (size_t i = 0; i < arr->len; i++)
+            s += (uint64_t)TARRAY_I64(arr)[i];
+    return vint((long)(int64_t)s);
+}
+
+Value *native_vec_mean(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 1)
+        return verror("vec.mean(a): Expected one argument");
+    VEC_ARRAY("mean(a)", argv[0]);
+    TypedArray *arr = (TypedArray *)argv[0]->v;
+    if (!arr->len)
+        return vnull();
+    double s;
+    if (arr->kind == TA_F64)
+        s = vec_kernels()->sum(TARRAY_F64(arr), arr->len);
+    else {
+        // summed as doubles so big i64 arrays don't wrap
+        s = 0;
+        for (size_t i = 0; i < arr->len; i++)
+            s += (double)vec_int_at(arr, i);
+    }
+    return vfloat(s / (double)arr->len);
+}
+
+// Smallest (sign = -1) or largest (sign = 1) item, null when empty
+static Value *vec_extreme(TypedArray *arr, int sign) {
+    if (!arr->len)
+        return vnull();
+    if (arr->kind == TA_F64)
+        return vfloat(sign > 0 ? vec_kernels()->max(TARRAY_F64(arr), arr->len)
+                               : vec_kernels()->min(TARRAY_F64(arr), arr->len));
+    int64_t m = vec_int_at(arr, 0);
+    for (size_t i = 1; i < arr->len; i++) {
+        int64_t x = vec_int_at(arr, i);
+        if (sign > 0 ? x > m : x < m)
+            m = x;
+    }
+    return vint((long)m);
+}
+
+// Index of the first smallest or largest item, -1 when empty
+static long vec_arg_extreme(TypedArray *arr, int sign) {
+    if (!arr->len)
+        return -1;
+    if (arr->kind == TA_F64) {
+        // find the value with the wide kernel, then where it first is
+        const double *x = TARRAY_F64(arr);
+        double m = sign > 0 ? vec_kernels()->max(x, arr->len)
+                            : vec_kernels()->min(x, arr->len);
+        for (size_t i = 0; i < arr->len; i++)
+            if (x[i] == m)
+                return (long)i;
+        return 0; // only NaNs compared, the first one stands
+    }
+    size_t best = 0;
+    int64_t m = vec_int_at(arr, 0);
+    for (size_t i = 1; i < arr->len; i++) {
+        int64_t x = vec_int_at(arr, i);
+        if (sign > 0 ? x > m : x < m) {
+            m = x;
+            best = i;
+        }
+    }
+    return (long)best;
+}
+
+Value *native_vec_min(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 1)
+        return verror("vec.min(a): Expected one argument");
+    VEC_ARRAY("min(a)", argv[0]);
+    return vec_extreme((TypedArray *)argv[0]->v, -1);
+}
+
+Value *native_vec_max(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 1)
+        return verror("vec.max(a): Expected one argument");
+    VEC_ARRAY("max(a)", argv[0]);
+    return vec_extreme((TypedArray *)argv[0]->v, 1);
+}
+
+Value *native_vec_argmin(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 1)
+        return verror("vec.argmin(a): Expected one argument");
+    VEC_ARRAY("argmin(a)", argv[0]);
+    return vint(vec_arg_extreme((TypedArray *)argv[0]->v, -1));
+}
+
+Value *native_vec_argmax(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 1)
+        return verror("vec.argmax(a): Expected one argument");
+    VEC_ARRAY("argmax(a)", argv[0]);
+    return vint(vec_arg_extreme((TypedArray *)argv[0]->v, 1));
+}
+
+Value *native_vec_dot(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 2)
+        return verror("vec.dot(a, b): Expected two arguments");
+    VEC_ARRAY("dot(a, b)", argv[0]);
+    VEC_ARRAY("dot(a, b)", argv[1]);
+    TypedArray *a = (TypedArray *)argv[0]->v, *b = (TypedArray *)argv[1]->v;
+    if (a->len != b->len)
+        return verror("vec.dot(a, b): Lengths differ (%zu and %zu)", a->len,
+                      b->len);
+    if (a->kind == TA_F64 && b->kind == TA_F64)
+        return vfloat(vec_kernels()->dot(TARRAY_F64(a), TARRAY_F64(b), a->len));
+    if (a->kind != TA_F64 && b->kind != TA_F64) {
+        uint64_t s = 0;
+        for (size_t i = 0; i < a->len; i++)
+            s += (uint64_t)vec_int_at(a, i) * (uint64_t)vec_int_at(b, i);
+        return vint((long)(int64_t)s);
+    }
+    double s = 0;
+    for (size_t i = 0; i < a->len; i++)
+        s += vec_float_at(a, i) * vec_float_at(b, i);
+    return vfloat(s);
+}
+
+// y += alpha * x, in place
+Value *native_vec_axpy(Env *env, int argc, Value **argv) {
+    (void)env;
+    if (argc != 3 || !vec_is_scalar(argv[0]))
+        return verror("vec.axpy(alpha, x, y): Expected a number and two "
+                      "typed arrays");
+    VEC_ARRAY("axpy(alpha, x, y)", argv[1]);
+    VEC_ARRAY("axpy(alpha, x, y)", argv[2]);
+    Value *y = argv[2];
+    TypedArray *x = (TypedArray *)argv[1]->v;
+    if (((TypedArray *)y->v)->kind != TA_F64)
+        return verror("vec.axpy(alpha, x, y): y must be an f64array");
+    if (x->len != ((TypedArray *)y->v)->len)
+        return verror("vec.axpy(alpha, x, y): Lengths differ (%zu and %zu)",
+                      x->len, ((TypedArray *)y->v)->len);
+    if (IS_FROZEN(y))
+        return vtagged_error(E_CONST_ERROR, "Cannot modify frozen array");
+    // x may be y itself, hold it over the unshare
+    ML_REF_INC(x);
+    tarray_unshare(y);
+    TypedArray *ya = (TypedArray *)y->v;
+    double alpha = vec_scalar_float(argv[0]);
+    if (x->kind == TA_F64)
+        vec_kernels()->axpy(alpha, TARRAY_F64(x), TARRAY_F64(ya), ya->len);
+    else
+        for (size_t i = 0; i < ya->len; i++)
+            TARRAY_F64(ya)[i] += alpha * vec_float_at(x, i);
+    if (ML_REF_DEC(x) == 0)
+        tarray_destroy(x);
+    return vnull();
+}
+
+// a op b into a new array. Either side may be a number, the result is
+// an i64array when both sides are whole numbers, otherwise an f64array
+static Value *vec_binop(VecOp op, const char *who, int argc, Value **argv) {
+    if (argc != 2)
+        return verror("vec.%s(a, b): Expected two arguments", who);
+    Value *a = argv[0], *b = argv[1];
+    if (!IS_TARRAY(a)) {
+        if (!IS_TARRAY(b) || !vec_is_scalar(a))
+            return verror("vec.%s(a, b): Expected a typed array and a typed "
+                          "array or number",
+                          who);
+        // s op x, the same loop with the sides swapped
+        Value *t = a;
+        a = b;
+        b = t;
+        op = op == VEC_SUB ? VEC_RSUB : op == VEC_DIV ? VEC_RDIV : op;
+    } else if (!IS_TARRAY(b) && !vec_is_scalar(b))
+        return verror("vec.%s(a, b): Can't combine a typed array and a %s", who,
+                      GET_TYPENAME(b));
+
+    TypedArray *x = (TypedArray *)a->v;
+    TypedArray *y = IS_TARRAY(b) ? (TypedArray *)b->v : NULL;
+    if (y && y->len != x->len)
+        return verror("vec.%s(a, b): Lengths differ (%zu and %zu)", who, x->len,
+                      y->len);
+    int whole = x->kind != TA_F64 &&
+                (y ? y->kind != TA_F64 : GET_TYPE(b) != T_FLOAT) &&
+                op != VEC_DIV && op != VEC_RDIV;
+    TypedArray *out = tarray_create(whole ? TA_I64 : TA_F64, x->len);
+    if (!out)
+        return verror("vec.%s(a, b): Out of memory", who);
+    size_t n = x->len;
+
+    if (whole) {
+        int64_t *o = TARRAY_I64(out);
+        if (y)
+            for (size_t i = 0; i < n; i++)
+                o[i] = vec_int_op(op, vec_int_at(x, i), vec_int_at(y, i));
+        else {
+            int64_t s = vec_scalar_int(b);
+            for (size_t i = 0; i < n; i++)
+                o[i] = vec_int_op(op, vec_int_at(x, i), s);
+        }
+    } else if (x->kind == TA_F64 && (!y || y->kind == TA_F64)) {
+        if (y)
+            vec_kernels()->binop(op, TARRAY_F64(x), TARRAY_F64(y),
+                                 TARRAY_F64(out), n);
+        else
+            vec_kernels()->binop_scalar(op, TARRAY_F64(x), vec_scalar_float(b),
+                                        TARRAY_F64(out), n);
+    } else {
+        double *o = TARRAY_F64(out);
+        if (y)
+            for (size_t i = 0; i < n; i++)
+                o[i] = vec_float_op(op, vec_float_at(x, i), vec_float_at(y, i));
+        else {
+            double s = vec_scalar_float(b);
+            for (size_t i = 0; i < n; i++)
+                o[i] = vec_float_op(op, vec_float_at(x, i), s);
+        }
+    }
+    return tarray_new(out);
+}
+
+Value *native_vec_add(Env *env, int argc, Value **argv) {
+    (void)env;
+    return vec_binop(VEC_ADD, "add", argc, argv);
+}
+
+Value *native_vec_sub(Env *env, int argc, Value **argv) {
+    (void)env;
+    return vec_binop(VEC_SUB, "sub", argc, argv);
+}
+
+Value *native_vec_mul(Env *env, int argc, Value **argv) {
+    (void)env;
+    return vec_binop(VEC_MUL, "mul", argc, argv);
+}
+
+Value *native_vec_div(Env *env, int argc, Value **argv) {
+    (void)env;
+    return vec_binop(VEC_DIV, "div", argc, argv);
+}
+
+Value *native_vec_backend(Env *env, int argc, Value **argv) {
+    (void)env;
+    (void)argv;
+    if (argc != 0)
+        return verror("vec.backend(): Expected no arguments");
+    return vstring_dup(vec_kernels()->name);
+}
@@ -154,7 +154,7 @@ const char *_mtags(Src *s, char *file_name, char **buffer, int level,
         return match_char(s, ';') ? ERR_SUCCESS : ERR_EXPECTED_SEMICOLON;
     }
 
-    if (is_keyword_at(s, "set")) {
+    if (is_set_statement(s)) {
         s->pos += 3;
         Pos pos = _get_pos(s);
         skip_ws(s);